@@ -0,0 +1,301 @@
+/*
+Benchmark of StereoSGM over resolutions, disparity sizes, path counts and subpixel.
+
+Runs on synthetic pairs (a random texture shifted by a known disparity) or on
+a rectified pair from disk, resized to every resolution, and writes the
+results of all configurations as one JSON document to diff between commits.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "libsgm_ocl.h"
+
+namespace
+{
+    const char *PARAMS =
+        "{ help           | false                                   | print usage }"
+        "{ platform_idx   | 0                                       | (int) OpenCL platform index }"
+        "{ device_idx     | 0                                       | (int) OpenCL device index }"
+        "{ device_type    | all                                     | OpenCL device type: gpu, cpu (e.g. pocl) or all }"
+        "{ backend        | opencl                                  | opencl, cpu or cpu_reference }"
+        "{ resolutions    | 640x480,1280x720,1920x1080,3840x2160    | Comma separated WIDTHxHEIGHT list }"
+        "{ disparities    | 64,128,256                              | Comma separated disparity sizes }"
+        "{ paths          | 4,8                                     | Comma separated path counts }"
+        "{ subpixel       | 0,1                                     | Comma separated subpixel settings }"
+        "{ fused          | false                                   | Use Parameters::fused_aggregation }"
+        "{ hierarchical   | false                                   | Use Parameters::hierarchical, disparity size 64 is skipped }"
+        "{ memory_budget  | 0                                       | (int) Parameters::memory_budget in MiB, 0 for none }"
+        "{ iterations     | 50                                      | (int) Timed frames per configuration }"
+        "{ warmup         | 3                                       | (int) Untimed frames per configuration }"
+        "{ left           |                                         | Left image, synthetic pair if empty }"
+        "{ right          |                                         | Right image }"
+        "{ output         |                                         | JSON file, stdout if empty }";
+
+    std::vector<int> parse_ints(const std::string &list)
+    {
+        std::vector<int> values;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!item.empty())
+                values.push_back(std::stoi(item));
+        }
+        return values;
+    }
+
+    std::vector<cv::Size> parse_resolutions(const std::string &list)
+    {
+        std::vector<cv::Size> sizes;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            const size_t x = item.find('x');
+            if (x == std::string::npos)
+                throw std::runtime_error("Resolution must be WIDTHxHEIGHT: " + item);
+            sizes.emplace_back(std::stoi(item.substr(0, x)), std::stoi(item.substr(x + 1)));
+        }
+        return sizes;
+    }
+
+    std::string json_escape(const std::string &str)
+    {
+        std::string out;
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out;
+    }
+
+    // Random texture and the same texture shifted left by a disparity growing
+    // from top to bottom, so every disparity size has matches in range.
+    std::tuple<cv::Mat, cv::Mat> synthetic_pair(cv::Size size, int disparity_size)
+    {
+        cv::Mat texture(size.height, size.width + 2 * disparity_size, CV_8UC1);
+        cv::RNG rng(12345);
+        rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar(0), cv::Scalar(256));
+        cv::GaussianBlur(texture, texture, cv::Size(3, 3), 0.0);
+
+        cv::Mat left(size, CV_8UC1), right(size, CV_8UC1);
+        for (int y = 0; y < size.height; ++y)
+        {
+            const int d = y * (disparity_size - 1) / std::max(size.height - 1, 1);
+            const uint8_t *src = texture.ptr<uint8_t>(y);
+            std::copy(src + disparity_size, src + disparity_size + size.width, left.ptr<uint8_t>(y));
+            std::copy(src + disparity_size + d, src + disparity_size + d + size.width, right.ptr<uint8_t>(y));
+        }
+        return std::make_tuple(left, right);
+    }
+
+    double percentile(std::vector<double> sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        const size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+        return sorted[idx];
+    }
+
+    std::tuple<cl_context, cl_device_id> init_cl(int platform_idx, int device_idx, cl_device_type type)
+    {
+        cl_uint num_platforms = 0;
+        clGetPlatformIDs(0, nullptr, &num_platforms);
+        std::vector<cl_platform_id> platforms(num_platforms);
+        clGetPlatformIDs(num_platforms, platforms.data(), nullptr);
+        if (platform_idx < 0 || static_cast<cl_uint>(platform_idx) >= num_platforms)
+            throw std::runtime_error("Wrong platform index!");
+
+        cl_uint num_devices = 0;
+        clGetDeviceIDs(platforms[platform_idx], type, 0, nullptr, &num_devices);
+        std::vector<cl_device_id> devices(num_devices);
+        clGetDeviceIDs(platforms[platform_idx], type, num_devices, devices.data(), nullptr);
+        if (device_idx < 0 || static_cast<cl_uint>(device_idx) >= num_devices)
+            throw std::runtime_error("Wrong device index!");
+
+        cl_int err;
+        cl_context ctx = clCreateContext(nullptr, 1, &devices[device_idx], nullptr, nullptr, &err);
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Error creating context!");
+        return std::make_tuple(ctx, devices[device_idx]);
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cv::CommandLineParser config(argc, argv, PARAMS);
+    if (config.get<bool>("help"))
+    {
+        config.printMessage();
+        return 0;
+    }
+
+    const std::string backend_name = config.get<std::string>("backend");
+    sgmcl::ExecutionBackend backend = sgmcl::ExecutionBackend::OPENCL;
+    if (backend_name == "cpu")
+        backend = sgmcl::ExecutionBackend::CPU;
+    else if (backend_name == "cpu_reference")
+        backend = sgmcl::ExecutionBackend::CPU_REFERENCE;
+    else if (backend_name != "opencl")
+        throw std::runtime_error("Unknown backend: " + backend_name);
+
+    const std::string device_type_name = config.get<std::string>("device_type");
+    cl_device_type device_type = CL_DEVICE_TYPE_ALL;
+    if (device_type_name == "gpu")
+        device_type = CL_DEVICE_TYPE_GPU;
+    else if (device_type_name == "cpu")
+        device_type = CL_DEVICE_TYPE_CPU;
+
+    cl_context ctx;
+    cl_device_id device;
+    std::tie(ctx, device) = init_cl(config.get<int>("platform_idx"), config.get<int>("device_idx"), device_type);
+    cl_command_queue queue = clCreateCommandQueue(ctx, device, 0, nullptr);
+
+    cv::Mat disk_left, disk_right;
+    const std::string left_path = config.get<std::string>("left");
+    if (!left_path.empty())
+    {
+        disk_left = cv::imread(left_path, cv::IMREAD_GRAYSCALE);
+        disk_right = cv::imread(config.get<std::string>("right"), cv::IMREAD_GRAYSCALE);
+        if (disk_left.empty() || disk_right.empty() || disk_left.size() != disk_right.size())
+            throw std::runtime_error("Cannot read the stereo pair");
+    }
+
+    const int iterations = std::max(config.get<int>("iterations"), 1);
+    const int warmup = std::max(config.get<int>("warmup"), 0);
+    const bool fused = config.get<bool>("fused");
+    const bool hierarchical = config.get<bool>("hierarchical");
+    const size_t memory_budget = static_cast<size_t>(std::max(config.get<int>("memory_budget"), 0)) << 20;
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"device\": \"" << json_escape(sgmcl::device_info_string(device, CL_DEVICE_NAME)) << "\",\n"
+         << "  \"driver\": \"" << json_escape(sgmcl::device_info_string(device, CL_DRIVER_VERSION)) << "\",\n"
+         << "  \"backend\": \"" << backend_name << "\",\n"
+         << "  \"input\": \"" << (disk_left.empty() ? "synthetic" : json_escape(left_path)) << "\",\n"
+         << "  \"fused_aggregation\": " << (fused ? "true" : "false") << ",\n"
+         << "  \"hierarchical\": " << (hierarchical ? "true" : "false") << ",\n"
+         << "  \"iterations\": " << iterations << ",\n"
+         << "  \"runs\": [";
+
+    bool first_run = true;
+    for (const cv::Size &size : parse_resolutions(config.get<std::string>("resolutions")))
+    {
+        for (int disparity_size : parse_ints(config.get<std::string>("disparities")))
+        {
+            for (int num_paths : parse_ints(config.get<std::string>("paths")))
+            {
+                for (int subpixel : parse_ints(config.get<std::string>("subpixel")))
+                {
+                    json << (first_run ? "\n" : ",\n")
+                         << "    {\"width\": " << size.width << ", \"height\": " << size.height
+                         << ", \"disparity_size\": " << disparity_size
+                         << ", \"num_paths\": " << num_paths
+                         << ", \"subpixel\": " << (subpixel ? "true" : "false");
+                    first_run = false;
+
+                    if (hierarchical && disparity_size == 64)
+                    {
+                        json << ", \"skipped\": \"hierarchical matching needs 128 or 256 disparities\"}";
+                        continue;
+                    }
+
+                    cv::Mat left, right;
+                    if (disk_left.empty())
+                    {
+                        std::tie(left, right) = synthetic_pair(size, disparity_size);
+                    }
+                    else
+                    {
+                        cv::resize(disk_left, left, size, 0, 0, cv::INTER_AREA);
+                        cv::resize(disk_right, right, size, 0, 0, cv::INTER_AREA);
+                    }
+
+                    sgmcl::Parameters params;
+                    params.path_type = num_paths == 8 ? sgmcl::PathType::SCAN_8PATH : sgmcl::PathType::SCAN_4PATH;
+                    params.subpixel = subpixel != 0;
+                    params.fused_aggregation = fused;
+                    params.hierarchical = hierarchical;
+                    params.memory_budget = memory_budget;
+                    params.backend = backend;
+
+                    const size_t image_size = static_cast<size_t>(size.width) * size.height;
+                    sgmcl::DeviceBuffer<uint8_t> d_left(ctx, image_size);
+                    sgmcl::DeviceBuffer<uint8_t> d_right(ctx, image_size);
+                    sgmcl::DeviceBuffer<uint16_t> d_disp(ctx, image_size);
+                    clEnqueueWriteBuffer(queue, d_left.data(), true, 0, image_size, left.data, 0, nullptr, nullptr);
+                    clEnqueueWriteBuffer(queue, d_right.data(), true, 0, image_size, right.data, 0, nullptr, nullptr);
+
+                    const size_t memory_before = sgmcl::allocated_device_memory();
+                    std::vector<double> latencies;
+                    size_t device_memory = 0;
+                    int stripe_height = size.height;
+                    {
+                        sgmcl::StereoSGM ssgm(size.width, size.height, disparity_size, ctx, device, params);
+                        ssgm.prepare();
+                        stripe_height = ssgm.get_stripe_height();
+                        for (int i = 0; i < warmup; ++i)
+                            ssgm.execute(d_left.data(), d_right.data(), d_disp.data());
+
+                        for (int i = 0; i < iterations; ++i)
+                        {
+                            const auto t = std::chrono::steady_clock::now();
+                            ssgm.execute(d_left.data(), d_right.data(), d_disp.data());
+                            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count());
+                        }
+                        device_memory = sgmcl::allocated_device_memory() - memory_before;
+                    }
+
+                    std::sort(latencies.begin(), latencies.end());
+                    const double median = percentile(latencies, 0.5);
+                    const double p99 = percentile(latencies, 0.99);
+                    double mean = 0.0;
+                    for (double l : latencies)
+                        mean += l;
+                    mean /= latencies.size();
+
+                    json << ", \"median_ms\": " << median
+                         << ", \"p99_ms\": " << p99
+                         << ", \"mean_ms\": " << mean
+                         << ", \"fps\": " << (median > 0.0 ? 1000.0 / median : 0.0)
+                         << ", \"device_memory_bytes\": " << device_memory
+                         << ", \"stripe_height\": " << stripe_height << "}";
+                    std::cerr << size.width << "x" << size.height << " d" << disparity_size << " p" << num_paths
+                              << (subpixel ? " subpixel" : "") << ": " << median << " ms median, " << p99 << " ms p99" << std::endl;
+                }
+            }
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    const std::string output = config.get<std::string>("output");
+    if (output.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream file(output);
+        file << json.str();
+    }
+
+    clReleaseCommandQueue(queue);
+    clReleaseDevice(device);
+    clReleaseContext(ctx);
+    return 0;
+}
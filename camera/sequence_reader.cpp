@@ -0,0 +1,172 @@
+#include "sequence_reader.hpp"
+
+#include <sys/stat.h>
+
+namespace
+{
+    bool isDirectory(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    void toGray(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (src.channels() == 3)
+            cv::cvtColor(src, dst, cv::COLOR_BGR2GRAY);
+        else if (src.channels() == 4)
+            cv::cvtColor(src, dst, cv::COLOR_BGRA2GRAY);
+        else
+            src.copyTo(dst);
+    }
+
+    // KITTI odometry sequences are recorded at 10 Hz
+    const uint64_t DEFAULT_FRAME_PERIOD_MS = 100;
+} // namespace
+
+StereoSequenceReader::StereoSequenceReader(const std::string &left, const std::string &right, int pool_size, bool loop)
+    : m_loop(loop), m_poolSize(pool_size)
+{
+    if (pool_size < 1)
+        throw Withrobot::WithRobotException("StereoSequenceReader needs at least one pool slot");
+
+    m_slots.reset(new Slot[pool_size]);
+    sem_init(&m_freeSem, 0, pool_size);
+    sem_init(&m_readySem, 0, 0);
+
+    std::string leftSource = left;
+    std::string rightSource = right;
+    if (right.empty() && isDirectory(left + "/image_0"))
+    {
+        leftSource = left + "/image_0/%06d.png";
+        rightSource = left + "/image_1/%06d.png";
+    }
+    m_sideBySide = rightSource.empty();
+
+    if (!m_left.open(leftSource) || (!m_sideBySide && !m_right.open(rightSource)))
+        return;
+
+    // the first pair gives the image size
+    sem_wait(&m_freeSem);
+    if (!decode(m_slots[0]))
+        return;
+    m_tail = 1;
+    sem_post(&m_readySem);
+
+    m_running = true;
+    m_opened = m_thread.start(&StereoSequenceReader::decodeProc, this);
+    m_running = m_opened;
+}
+
+StereoSequenceReader::~StereoSequenceReader()
+{
+    if (m_running.exchange(false))
+    {
+        // wake a worker waiting for a free slot
+        sem_post(&m_freeSem);
+        m_thread.join();
+    }
+    sem_destroy(&m_freeSem);
+    sem_destroy(&m_readySem);
+}
+
+void *StereoSequenceReader::decodeProc(void *arg)
+{
+    static_cast<StereoSequenceReader *>(arg)->decodeLoop();
+    return nullptr;
+}
+
+void StereoSequenceReader::decodeLoop()
+{
+    while (m_running)
+    {
+        // check m_running now and then while the consumer is slow
+        if (!Withrobot::sem_wait_until(&m_freeSem, Withrobot::deadline_after(100)) || !m_running)
+            continue;
+
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[tail % m_poolSize];
+        if (!decode(slot) && !(m_loop && rewind() && decode(slot)))
+        {
+            m_eof = true;
+            sem_post(&m_readySem);
+            return;
+        }
+        m_tail.store(tail + 1, std::memory_order_release);
+        sem_post(&m_readySem);
+    }
+}
+
+bool StereoSequenceReader::decode(Slot &slot)
+{
+    if (!m_left.read(m_decoded) || m_decoded.empty())
+        return false;
+
+    if (m_sideBySide)
+    {
+        const int half = m_decoded.cols / 2;
+        toGray(m_decoded(cv::Rect(0, 0, half, m_decoded.rows)), slot.left);
+        toGray(m_decoded(cv::Rect(half, 0, half, m_decoded.rows)), slot.right);
+    }
+    else
+    {
+        toGray(m_decoded, slot.left);
+        if (!m_right.read(m_decoded) || m_decoded.empty())
+            return false;
+        toGray(m_decoded, slot.right);
+    }
+
+    if (slot.left.size() != slot.right.size())
+        return false;
+    if (m_width == 0)
+    {
+        m_width = slot.left.cols;
+        m_height = slot.left.rows;
+    }
+    else if (slot.left.cols != m_width || slot.left.rows != m_height)
+    {
+        return false;
+    }
+
+    // image sequences have no position in time
+    const double pos_ms = m_left.get(cv::CAP_PROP_POS_MSEC);
+    slot.timestamp_ms = pos_ms > 0.0 ? static_cast<uint64_t>(pos_ms) : m_frameIndex * DEFAULT_FRAME_PERIOD_MS;
+    ++m_frameIndex;
+    return true;
+}
+
+bool StereoSequenceReader::rewind()
+{
+    m_left.set(cv::CAP_PROP_POS_FRAMES, 0);
+    if (!m_sideBySide)
+        m_right.set(cv::CAP_PROP_POS_FRAMES, 0);
+    return true;
+}
+
+bool StereoSequenceReader::getCamData(StereoCameraData &camData)
+{
+    if (!m_opened || !Withrobot::sem_wait_until(&m_readySem, Withrobot::deadline_after(1000)))
+        return false;
+
+    if (m_head == m_tail.load(std::memory_order_acquire))
+    {
+        // end of the sequence, keep it signalled for the following calls
+        sem_post(&m_readySem);
+        return false;
+    }
+
+    // the caller's previous images become the slot's decode target
+    Slot &slot = m_slots[m_head % m_poolSize];
+    std::swap(camData.frame_0, slot.left);
+    std::swap(camData.frame_1, slot.right);
+    camData.timestamp_ms = slot.timestamp_ms;
+    ++m_head;
+    ++m_read;
+    sem_post(&m_freeSem);
+    return true;
+}
+
+bool StereoSequenceReader::finished()
+{
+    return !m_opened || (m_eof && m_head == m_tail.load(std::memory_order_acquire));
+}
@@ -0,0 +1,84 @@
+#ifndef _SEQUENCE_READER_HPP__
+#define _SEQUENCE_READER_HPP__
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <semaphore.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "stereo_source.hpp"
+#include "withrobot_utility.hpp"
+
+/**
+ * Replays a recorded stereo sequence as a StereoSource, so the camera pipeline runs without hardware.
+ *
+ * Sources, anything cv::VideoCapture opens:
+ *  - a KITTI sequence directory with image_0/ and image_1/ (right empty),
+ *  - two image patterns such as image_0/%06d.png and image_1/%06d.png, or two video files,
+ *  - a single side by side video, left half left camera (right empty).
+ *
+ * A worker thread decodes ahead into a pool of pool_size frame pairs and waits when the pool is
+ * full. getCamData swaps the decoded images into the caller's StereoCameraData, so neither side
+ * copies or allocates once the pool is warm. Frames are delivered as fast as they are taken.
+ */
+class StereoSequenceReader : public StereoSource
+{
+public:
+    typedef std::shared_ptr<StereoSequenceReader> Ptr;
+
+    StereoSequenceReader(const std::string &left, const std::string &right = "", int pool_size = 4, bool loop = false);
+    ~StereoSequenceReader();
+
+    bool isOpened() override { return m_opened; }
+    int width() override { return m_width; }
+    int height() override { return m_height; }
+
+    // waits for the worker, false at the end of the sequence
+    bool getCamData(StereoCameraData &camData) override;
+    bool finished() override;
+
+    // pairs delivered so far
+    uint64_t framesRead() const { return m_read; }
+
+private:
+    struct Slot
+    {
+        uint64_t timestamp_ms = 0;
+        cv::Mat left;
+        cv::Mat right;
+    };
+
+    static void *decodeProc(void *arg);
+    void decodeLoop();
+    bool decode(Slot &slot);
+    bool rewind();
+
+    cv::VideoCapture m_left;
+    cv::VideoCapture m_right;
+    bool m_sideBySide = false;
+    bool m_loop;
+    bool m_opened = false;
+    int m_width = 0;
+    int m_height = 0;
+
+    // ring of pool_size slots, the worker fills m_tail and the consumer takes m_head
+    std::unique_ptr<Slot[]> m_slots;
+    int m_poolSize;
+    uint64_t m_head = 0;
+    std::atomic<uint64_t> m_tail{0};
+    sem_t m_freeSem;
+    sem_t m_readySem;
+
+    cv::Mat m_decoded;
+    uint64_t m_frameIndex = 0;
+
+    Withrobot::Thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_eof{false};
+    std::atomic<uint64_t> m_read{0};
+};
+
+#endif //_SEQUENCE_READER_HPP__
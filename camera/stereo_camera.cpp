@@ -27,6 +27,8 @@ void StereoCamera::setup()
     camera->get_current_format(camFormat);
     camFormat.print();
 
+    camera->set_buffer_count(_cameraConfig.buffer_count);
+    camera->set_late_threshold(_cameraConfig.late_threshold_us);
     if (camera->start())
     {
         m_isCameraStarted = true;
@@ -84,18 +86,61 @@ void StereoCamera::updateConfig(struct StereoCameraConfig config)
 
 bool StereoCamera::getCamData(StereoCameraData &camData)
 {
-    cv::Mat temp(cv::Size(camFormat.width, camFormat.height), CV_8UC2);
-    if (camera->get_frame(temp.data, camFormat.image_size, 1) != -1)
-    {
-        memcpy(&camData.timestamp_ms, temp.data, sizeof(uint32_t));
+    // convert straight from the driver's buffer
+    if (!borrowFrame(m_frame, camData.timestamp_ms))
+        return false;
+
+    const cv::Mat temp(cv::Size(camFormat.width, camFormat.height), CV_8UC2, const_cast<unsigned char *>(m_frame.data()));
+    convertRaw(temp, camData.frame_0, camData.frame_1);
+    m_frame.release();
 
-        cv::Mat stereo_raw[2];
-        cv::split(temp, stereo_raw);
+    return true;
+}
+
+void StereoCamera::convertRaw(const cv::Mat &raw, cv::Mat &left, cv::Mat &right)
+{
+    cv::Mat stereo_raw[2];
+    cv::split(raw, stereo_raw);
 
-        cv::cvtColor(stereo_raw[1], camData.frame_0, CV_BayerGR2GRAY);
-        cv::cvtColor(stereo_raw[0], camData.frame_1, CV_BayerGR2GRAY);
+    cv::cvtColor(stereo_raw[1], left, CV_BayerGR2GRAY);
+    cv::cvtColor(stereo_raw[0], right, CV_BayerGR2GRAY);
+}
+
+bool StereoCamera::getRawCamData(StereoCameraData &camData)
+{
+    if (!borrowFrame(m_frame, camData.timestamp_ms))
+        return false;
+
+    // the only copy, the ring of StereoCapture keeps frames longer than the driver's queue allows
+    camData.raw.create(cv::Size(camFormat.width, camFormat.height), CV_8UC2);
+    memcpy(camData.raw.data, m_frame.data(), camFormat.image_size);
+    m_frame.release();
+    return true;
+}
 
-        return true;
+bool StereoCamera::borrowFrame(Withrobot::BorrowedFrame &frame, uint64_t &timestamp_ms)
+{
+    if (!camera->try_borrow_frame(frame, _cameraConfig.frame_timeout_us))
+        return false;
+
+    if (frame.size() != camFormat.image_size)
+    {
+        frame.release();
+        return false;
     }
-    return false;
+
+    uint32_t timestamp = 0;
+    memcpy(&timestamp, frame.data(), sizeof(uint32_t));
+    timestamp_ms = timestamp;
+
+    if (m_recorder)
+        m_recorder->append(frame.data(), timestamp_ms);
+    return true;
+}
+
+void StereoCamera::setRecorder(StereoRecorder::Ptr recorder)
+{
+    if (recorder && (recorder->width() != static_cast<int>(camFormat.width) || recorder->height() != static_cast<int>(camFormat.height)))
+        throw Withrobot::WithRobotException("The recording's frame size differs from the camera's");
+    m_recorder = recorder;
 }
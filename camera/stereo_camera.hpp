@@ -8,16 +8,10 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "stereo_recording.hpp"
+#include "stereo_source.hpp"
 #include "withrobot_camera.hpp"
 
-struct StereoCameraData
-{
-    uint64_t timestamp_ms;
-
-    cv::Mat frame_0; // left camera
-    cv::Mat frame_1; // right camera
-};
-
 struct StereoCameraConfig
 {
     std::string devPath = "/dev/video0";
@@ -29,9 +23,15 @@ struct StereoCameraConfig
     int white_balance_blue = 180;
     int white_balance_red = 150;
     bool ae = false;
+    // V4L2 capture buffers: fewer keep the latency low, more absorb jitter of the processing
+    int buffer_count = 4;
+    // frames older than this when dequeued count as late, 0 disables the check
+    int late_threshold_us = 0;
+    // wait for a frame in getCamData, getRawCamData and borrowFrame
+    int frame_timeout_us = 1000000;
 };
 
-class StereoCamera
+class StereoCamera : public StereoSource
 {
 public:
     typedef std::shared_ptr<StereoCamera> Ptr;
@@ -43,9 +43,27 @@ public:
     struct StereoCameraConfig getCurrentConfig() { return _cameraConfig; }
     void updateConfig(struct StereoCameraConfig config);
 
-    bool getCamData(StereoCameraData &camData);
+    bool isOpened() override { return m_isCameraStarted; }
+    int width() override { return camFormat.width; }
+    int height() override { return camFormat.height; }
+
+    bool getCamData(StereoCameraData &camData) override;
+    // leaves the frame as captured for StereoSGM::execute_interleaved, frame_0 and frame_1 stay untouched
+    bool getRawCamData(StereoCameraData &camData) override;
+    // zero copy access to the interleaved frame, the camera's timestamp is read from its first bytes.
+    // Release the frame soon, the driver only has a few buffers.
+    bool borrowFrame(Withrobot::BorrowedFrame &frame, uint64_t &timestamp_ms);
+
+    // every frame handed out from now on is appended to the recording, nullptr stops recording.
+    // Not while a StereoCapture reads the camera.
+    void setRecorder(StereoRecorder::Ptr recorder);
+
+    // splits an interleaved Bayer GR frame into the gray left and right images
+    static void convertRaw(const cv::Mat &raw, cv::Mat &left, cv::Mat &right);
 
     inline bool checkCameraStarted() { return m_isCameraStarted; }
+    // frames, dropped and late frames since the camera started
+    inline Withrobot::capture_stats getCaptureStats() { return camera->get_capture_stats(); }
 
 private:
     void setup();
@@ -53,6 +71,9 @@ private:
     void enum_device_list();
 
     std::shared_ptr<Withrobot::Camera> camera;
+    // released before getCamData and getRawCamData return
+    Withrobot::BorrowedFrame m_frame;
+    StereoRecorder::Ptr m_recorder;
     Withrobot::camera_format camFormat;
 
     bool m_isCameraStarted;
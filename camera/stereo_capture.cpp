@@ -0,0 +1,183 @@
+#include "stereo_capture.hpp"
+
+StereoCapture::StereoCapture(StereoSource::Ptr source, int num_slots, CapturePolicy policy, bool raw)
+    : m_source(source), m_policy(policy), m_raw(raw), m_numSlots(num_slots)
+{
+    // one slot held by the consumer, one being written and at least one queued
+    if (num_slots < 3)
+        throw Withrobot::WithRobotException("StereoCapture needs at least 3 slots");
+
+    m_slots.reset(new Slot[num_slots]);
+    sem_init(&m_readySem, 0, 0);
+    sem_init(&m_freeSem, 0, 0);
+}
+
+StereoCapture::~StereoCapture()
+{
+    stop();
+    sem_destroy(&m_readySem);
+    sem_destroy(&m_freeSem);
+}
+
+bool StereoCapture::start()
+{
+    if (m_running.exchange(true))
+        return true;
+
+    if (!m_thread.start(&StereoCapture::captureProc, this))
+    {
+        m_running = false;
+        return false;
+    }
+    return true;
+}
+
+void StereoCapture::stop()
+{
+    if (!m_running.exchange(false))
+        return;
+
+    // wake a capture thread waiting for a free slot
+    sem_post(&m_freeSem);
+    m_thread.join();
+}
+
+void *StereoCapture::captureProc(void *arg)
+{
+    static_cast<StereoCapture *>(arg)->captureLoop();
+    return nullptr;
+}
+
+void StereoCapture::captureLoop()
+{
+    while (m_running)
+    {
+        const int index = claimWriteSlot();
+        if (index < 0)
+            continue;
+
+        Slot &slot = m_slots[index];
+        const bool ok = m_raw ? m_source->getRawCamData(slot.data) : m_source->getCamData(slot.data);
+        if (!ok)
+        {
+            slot.tag.store(makeTag(0, FREE), std::memory_order_release);
+            if (m_source->finished())
+            {
+                // wake the consumer, acquire returns at once from now on
+                m_sourceFinished = true;
+                sem_post(&m_readySem);
+                return;
+            }
+            continue;
+        }
+
+        ++m_captured;
+        slot.tag.store(makeTag(m_nextFrame++, READY), std::memory_order_release);
+        sem_post(&m_readySem);
+    }
+}
+
+int StereoCapture::claimWriteSlot()
+{
+    for (int i = 0; i < m_numSlots; ++i)
+    {
+        uint64_t tag = m_slots[i].tag.load(std::memory_order_acquire);
+        if (stateOf(tag) == FREE && m_slots[i].tag.compare_exchange_strong(tag, makeTag(0, WRITING), std::memory_order_acq_rel))
+            return i;
+    }
+
+    if (m_policy == CapturePolicy::BLOCK)
+    {
+        // the camera keeps queueing meanwhile, check m_running now and then
+        Withrobot::sem_wait_until(&m_freeSem, Withrobot::deadline_after(100));
+        return -1;
+    }
+
+    // reclaim the oldest frame the consumer has not taken yet, it may take it first
+    uint64_t tag = 0;
+    const int oldest = findReady(false, tag);
+    if (oldest >= 0 && m_slots[oldest].tag.compare_exchange_strong(tag, makeTag(0, WRITING), std::memory_order_acq_rel))
+    {
+        ++m_dropped;
+        return oldest;
+    }
+    return -1;
+}
+
+int StereoCapture::findReady(bool newest, uint64_t &tag)
+{
+    int found = -1;
+    for (int i = 0; i < m_numSlots; ++i)
+    {
+        const uint64_t t = m_slots[i].tag.load(std::memory_order_acquire);
+        if (stateOf(t) != READY)
+            continue;
+        if (found < 0 || (newest ? t > tag : t < tag))
+        {
+            found = i;
+            tag = t;
+        }
+    }
+    return found;
+}
+
+const StereoCameraData *StereoCapture::acquire(unsigned int timeout_ms)
+{
+    release();
+
+    const timespec ts = Withrobot::deadline_after(timeout_ms);
+    for (;;)
+    {
+        const bool newest = m_policy == CapturePolicy::LATEST_ONLY;
+        uint64_t tag = 0;
+        const int index = findReady(newest, tag);
+        if (index < 0)
+        {
+            if (m_sourceFinished)
+                return nullptr;
+            // posts of dropped frames only cost an extra round
+            if (!Withrobot::sem_wait_until(&m_readySem, ts))
+                return nullptr;
+            continue;
+        }
+
+        const uint64_t frame = tag >> 2;
+        if (!m_slots[index].tag.compare_exchange_strong(tag, makeTag(frame, READING), std::memory_order_acq_rel))
+            continue;
+
+        if (newest)
+        {
+            // the older frames would only be handed out late
+            for (int i = 0; i < m_numSlots; ++i)
+            {
+                uint64_t t = m_slots[i].tag.load(std::memory_order_acquire);
+                if (stateOf(t) == READY && (t >> 2) < frame &&
+                    m_slots[i].tag.compare_exchange_strong(t, makeTag(0, FREE), std::memory_order_acq_rel))
+                {
+                    ++m_dropped;
+                }
+            }
+        }
+
+        m_held = index;
+        return &m_slots[index].data;
+    }
+}
+
+void StereoCapture::release()
+{
+    if (m_held < 0)
+        return;
+
+    m_slots[m_held].tag.store(makeTag(0, FREE), std::memory_order_release);
+    m_held = -1;
+    // only a blocked capture thread waits for free slots
+    if (m_policy == CapturePolicy::BLOCK)
+        sem_post(&m_freeSem);
+}
+
+bool StereoCapture::finished()
+{
+    uint64_t tag = 0;
+    return m_sourceFinished && findReady(false, tag) < 0;
+}
@@ -0,0 +1,105 @@
+#ifndef _STEREO_CAPTURE_HPP__
+#define _STEREO_CAPTURE_HPP__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <semaphore.h>
+
+#include "stereo_source.hpp"
+#include "withrobot_utility.hpp"
+
+/**
+ * What the capture thread does with a new frame when every slot of the ring is taken.
+ */
+enum class CapturePolicy
+{
+    DROP_OLDEST, // overwrite the oldest queued frame, the consumer gets the frames in order
+    BLOCK,       // wait for the consumer, frames pile up in the V4L2 queue instead
+    LATEST_ONLY  // like DROP_OLDEST, but the consumer always gets the newest frame and the older ones are dropped
+};
+
+/**
+ * Captures frames of a StereoSource on its own thread into a ring of preallocated slots.
+ *
+ * One producer (the capture thread) and one consumer. Every slot carries its state and a
+ * frame number in one atomic word, both sides claim slots with compare and swap, so neither
+ * takes a lock and the slot handed to the consumer is never overwritten before release().
+ * Two semaphores only wake the sides up when they wait.
+ */
+class StereoCapture
+{
+public:
+    /**
+     * @param source    Opened source, getCamData or getRawCamData is only called from the capture thread.
+     * @param num_slots Frames in the ring including the one held by the consumer, at least 3.
+     * @param policy    See CapturePolicy.
+     * @param raw       Capture with getRawCamData (StereoCameraData::raw) instead of getCamData.
+     */
+    StereoCapture(StereoSource::Ptr source, int num_slots = 3, CapturePolicy policy = CapturePolicy::LATEST_ONLY, bool raw = false);
+    ~StereoCapture();
+
+    bool start();
+    void stop();
+
+    /**
+     * Waits up to timeout_ms for a frame not handed out yet.
+     * @return The frame, valid until release(), or nullptr on timeout.
+     */
+    const StereoCameraData *acquire(unsigned int timeout_ms);
+
+    // Gives the frame of the last acquire back to the capture thread.
+    void release();
+
+    // the source has finished and every frame was handed out
+    bool finished();
+
+    // frames captured and frames overwritten or skipped before the consumer got them
+    uint64_t capturedFrames() const { return m_captured.load(); }
+    uint64_t droppedFrames() const { return m_dropped.load(); }
+
+private:
+    enum SlotState : uint64_t
+    {
+        FREE = 0,
+        WRITING = 1,
+        READY = 2,
+        READING = 3
+    };
+
+    struct Slot
+    {
+        // state in the low two bits, frame number above
+        std::atomic<uint64_t> tag{FREE};
+        StereoCameraData data;
+    };
+
+    static void *captureProc(void *arg);
+    void captureLoop();
+    int claimWriteSlot();
+    int findReady(bool newest, uint64_t &tag);
+
+    static uint64_t makeTag(uint64_t frame, SlotState state) { return (frame << 2) | state; }
+    static SlotState stateOf(uint64_t tag) { return static_cast<SlotState>(tag & 3); }
+
+    StereoSource::Ptr m_source;
+    CapturePolicy m_policy;
+    bool m_raw;
+
+    std::unique_ptr<Slot[]> m_slots;
+    int m_numSlots;
+    int m_held = -1;
+    uint64_t m_nextFrame = 1;
+
+    sem_t m_readySem;
+    sem_t m_freeSem;
+
+    Withrobot::Thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_sourceFinished{false};
+    std::atomic<uint64_t> m_captured{0};
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+#endif //_STEREO_CAPTURE_HPP__
@@ -0,0 +1,271 @@
+#include "stereo_recording.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stereo_camera.hpp"
+#include "withrobot_utility.hpp"
+
+namespace
+{
+    const char RECORDING_MAGIC[8] = {'S', 'G', 'M', 'R', 'A', 'W', '0', '1'};
+    const uint32_t RECORDING_VERSION = 1;
+
+    uint64_t pageAlign(uint64_t size)
+    {
+        const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        return (size + page - 1) / page * page;
+    }
+
+    // the header of a file of file_size bytes describes frames inside the file
+    bool validHeader(const RecordingHeader &header, uint64_t file_size)
+    {
+        if (memcmp(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 || header.version != RECORDING_VERSION)
+            return false;
+        if (header.width == 0 || header.height == 0 || header.frame_bytes != static_cast<uint64_t>(header.width) * header.height * 2)
+            return false;
+        if (header.frame_stride < header.frame_bytes || header.frame_count > header.capacity)
+            return false;
+        // no overflow in the sums below
+        if (header.capacity > file_size / sizeof(RecordingIndexEntry) || header.frame_count > file_size / header.frame_stride ||
+            header.index_offset > file_size || header.data_offset > file_size)
+            return false;
+        return header.index_offset + header.capacity * sizeof(RecordingIndexEntry) <= header.data_offset &&
+               header.data_offset + header.frame_count * header.frame_stride <= file_size;
+    }
+
+    // every frame of the index lies inside the file, checked once instead of on every access
+    bool validIndex(const RecordingHeader &header, const uint8_t *map, uint64_t file_size)
+    {
+        const RecordingIndexEntry *index = reinterpret_cast<const RecordingIndexEntry *>(map + header.index_offset);
+        for (uint64_t i = 0; i < header.frame_count; ++i)
+        {
+            if (index[i].offset < header.data_offset || index[i].offset > file_size ||
+                file_size - index[i].offset < header.frame_bytes)
+                return false;
+        }
+        return true;
+    }
+} // namespace
+
+StereoRecorder::StereoRecorder(const std::string &path, int width, int height, uint64_t max_frames)
+    : m_width(width), m_height(height), m_capacity(max_frames)
+{
+    if (width <= 0 || height <= 0 || max_frames == 0)
+        throw Withrobot::WithRobotException("StereoRecorder needs a frame size and at least one frame");
+
+    m_frameBytes = static_cast<uint64_t>(width) * height * 2;
+    m_stride = pageAlign(m_frameBytes);
+    m_indexOffset = pageAlign(sizeof(RecordingHeader));
+    m_dataOffset = m_indexOffset + pageAlign(max_frames * sizeof(RecordingIndexEntry));
+    m_mapSize = m_dataOffset + max_frames * m_stride;
+
+    auto fail = [&](const std::string &what, int err) {
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+            unlink(path.c_str());
+        }
+        throw Withrobot::WithRobotException(what + " " + path + ": " + strerror(err));
+    };
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        fail("Cannot create recording", errno);
+
+    // real blocks instead of a sparse file, the recording cannot run out of space halfway
+    const int err = posix_fallocate(m_fd, 0, m_mapSize);
+    if (err != 0)
+        fail("Cannot allocate recording", err);
+
+    void *map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+        fail("Cannot map recording", errno);
+    m_map = static_cast<uint8_t *>(map);
+    madvise(m_map + m_dataOffset, m_mapSize - m_dataOffset, MADV_SEQUENTIAL);
+
+    RecordingHeader *header = reinterpret_cast<RecordingHeader *>(m_map);
+    memcpy(header->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    header->version = RECORDING_VERSION;
+    header->width = width;
+    header->height = height;
+    header->frame_bytes = static_cast<uint32_t>(m_frameBytes);
+    header->frame_stride = m_stride;
+    header->capacity = max_frames;
+    header->frame_count = 0;
+    header->index_offset = m_indexOffset;
+    header->data_offset = m_dataOffset;
+}
+
+StereoRecorder::~StereoRecorder()
+{
+    close();
+}
+
+bool StereoRecorder::append(const void *frame, uint64_t timestamp_ms)
+{
+    if (m_map == nullptr || m_count >= m_capacity)
+        return false;
+
+    const uint64_t offset = m_dataOffset + m_count * m_stride;
+    memcpy(m_map + offset, frame, m_frameBytes);
+
+    RecordingIndexEntry *index = reinterpret_cast<RecordingIndexEntry *>(m_map + m_indexOffset);
+    index[m_count].timestamp_ms = timestamp_ms;
+    index[m_count].offset = offset;
+
+    // the count last, the file never claims a frame not written completely
+    std::atomic_thread_fence(std::memory_order_release);
+    reinterpret_cast<RecordingHeader *>(m_map)->frame_count = ++m_count;
+
+    // write this frame back now, an older one is on disk by now and leaves the page cache
+    sync_file_range(m_fd, offset, m_stride, SYNC_FILE_RANGE_WRITE);
+    if (m_count > WRITEBACK_LAG)
+    {
+        const uint64_t old = offset - WRITEBACK_LAG * m_stride;
+        sync_file_range(m_fd, old, m_stride, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        madvise(m_map + old, m_stride, MADV_DONTNEED);
+        posix_fadvise(m_fd, old, m_stride, POSIX_FADV_DONTNEED);
+    }
+    return true;
+}
+
+void StereoRecorder::close()
+{
+    if (m_map == nullptr)
+        return;
+
+    munmap(m_map, m_mapSize);
+    m_map = nullptr;
+
+    // the index keeps its preallocated size, only the unused frames are cut off
+    if (ftruncate(m_fd, m_dataOffset + m_count * m_stride) != 0)
+        std::cerr << "Cannot truncate the recording: " << strerror(errno) << std::endl;
+    fdatasync(m_fd);
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+StereoRecordingReader::StereoRecordingReader(const std::string &path, bool loop)
+    : m_loop(loop)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(RecordingHeader))
+        return;
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+        return;
+
+    const RecordingHeader *header = static_cast<const RecordingHeader *>(map);
+    if (!validHeader(*header, st.st_size) || !validIndex(*header, static_cast<const uint8_t *>(map), st.st_size))
+    {
+        munmap(map, st.st_size);
+        return;
+    }
+
+    m_map = static_cast<uint8_t *>(map);
+    m_mapSize = st.st_size;
+    m_index = reinterpret_cast<const RecordingIndexEntry *>(m_map + header->index_offset);
+    m_width = header->width;
+    m_height = header->height;
+    m_frameBytes = header->frame_bytes;
+    m_count = header->frame_count;
+    madvise(m_map + header->data_offset, m_mapSize - header->data_offset, MADV_SEQUENTIAL);
+}
+
+StereoRecordingReader::~StereoRecordingReader()
+{
+    if (m_map != nullptr)
+        munmap(m_map, m_mapSize);
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+bool StereoRecordingReader::probe(const std::string &path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    char magic[sizeof(RECORDING_MAGIC)];
+    const bool match = read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, RECORDING_MAGIC, sizeof(magic)) == 0;
+    ::close(fd);
+    return match;
+}
+
+bool StereoRecordingReader::getCamData(StereoCameraData &camData)
+{
+    uint64_t index = 0;
+    if (!next(index))
+        return false;
+
+    const cv::Mat raw(cv::Size(m_width, m_height), CV_8UC2, const_cast<uint8_t *>(frameData(index)));
+    StereoCamera::convertRaw(raw, camData.frame_0, camData.frame_1);
+    camData.timestamp_ms = m_index[index].timestamp_ms;
+    return true;
+}
+
+bool StereoRecordingReader::getRawCamData(StereoCameraData &camData)
+{
+    uint64_t index = 0;
+    if (!next(index))
+        return false;
+
+    // only a header on the mapped frame, the pages are read only
+    camData.raw = cv::Mat(cv::Size(m_width, m_height), CV_8UC2, const_cast<uint8_t *>(frameData(index)));
+    camData.timestamp_ms = m_index[index].timestamp_ms;
+    return true;
+}
+
+bool StereoRecordingReader::finished()
+{
+    return m_map == nullptr || (!m_loop && m_position >= m_count);
+}
+
+bool StereoRecordingReader::seek(uint64_t index)
+{
+    if (index >= m_count)
+        return false;
+    m_position = index;
+    return true;
+}
+
+const uint8_t *StereoRecordingReader::frameData(uint64_t index) const
+{
+    return index < m_count ? m_map + m_index[index].offset : nullptr;
+}
+
+uint64_t StereoRecordingReader::timestamp(uint64_t index) const
+{
+    return index < m_count ? m_index[index].timestamp_ms : 0;
+}
+
+bool StereoRecordingReader::next(uint64_t &index)
+{
+    if (m_map == nullptr || m_count == 0)
+        return false;
+    if (m_position >= m_count)
+    {
+        if (!m_loop)
+            return false;
+        m_position = 0;
+    }
+    index = m_position++;
+
+    // read the following frame ahead while this one is matched, frames start on pages
+    if (m_position < m_count)
+        madvise(const_cast<uint8_t *>(frameData(m_position)), m_frameBytes, MADV_WILLNEED);
+    return true;
+}
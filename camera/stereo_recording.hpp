@@ -0,0 +1,141 @@
+#ifndef _STEREO_RECORDING_HPP__
+#define _STEREO_RECORDING_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "stereo_source.hpp"
+
+/**
+ * Raw stereo recording, one file:
+ *
+ *   RecordingHeader | RecordingIndexEntry[capacity] | frame 0 | frame 1 | ...
+ *
+ * The header and the index fill whole pages, every frame starts on a page boundary and holds
+ * the interleaved frame exactly as the camera delivered it (StereoCameraData::raw).
+ * frame_count is written after the frame and its index entry, so a recording cut short by a
+ * crash of the recording program still reads up to its last complete frame.
+ */
+struct RecordingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_bytes;  // width * height * 2
+    uint64_t frame_stride; // frame_bytes rounded up to pages
+    uint64_t capacity;     // frames the file was preallocated for
+    uint64_t frame_count;
+    uint64_t index_offset;
+    uint64_t data_offset;
+};
+
+struct RecordingIndexEntry
+{
+    uint64_t timestamp_ms;
+    uint64_t offset; // of the frame from the start of the file
+};
+
+/**
+ * Appends raw interleaved frames to a preallocated, memory mapped recording.
+ *
+ * The whole file is allocated up front, so appending never waits for the file system to find
+ * space: a frame is one memcpy into the mapping. Written frames are handed to the kernel's
+ * writeback at once and dropped from the page cache a few frames later, so a long recording
+ * neither piles up dirty pages nor pushes everything else out of memory.
+ */
+class StereoRecorder
+{
+public:
+    typedef std::shared_ptr<StereoRecorder> Ptr;
+
+    // throws Withrobot::WithRobotException if the file cannot be created or allocated
+    StereoRecorder(const std::string &path, int width, int height, uint64_t max_frames);
+    ~StereoRecorder();
+
+    // copies width * height * 2 bytes, false once the recording is full or closed
+    bool append(const void *frame, uint64_t timestamp_ms);
+    // truncates the file to the frames written, called by the destructor
+    void close();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    uint64_t frameCount() const { return m_count; }
+    uint64_t capacity() const { return m_capacity; }
+
+private:
+    // frames behind the newest one still allowed in the page cache
+    static const uint64_t WRITEBACK_LAG = 8;
+
+    int m_fd = -1;
+    uint8_t *m_map = nullptr;
+    size_t m_mapSize = 0;
+    uint64_t m_indexOffset = 0;
+    uint64_t m_dataOffset = 0;
+
+    int m_width;
+    int m_height;
+    uint64_t m_frameBytes;
+    uint64_t m_stride;
+    uint64_t m_capacity;
+    uint64_t m_count = 0;
+};
+
+/**
+ * Replays a StereoRecorder file as a StereoSource.
+ *
+ * The file is mapped read only. getRawCamData hands out the mapped frame itself, no copy and no
+ * decoding, so the replay runs as fast as the matching takes the frames. The frames stay valid
+ * as long as the reader lives.
+ */
+class StereoRecordingReader : public StereoSource
+{
+public:
+    typedef std::shared_ptr<StereoRecordingReader> Ptr;
+
+    explicit StereoRecordingReader(const std::string &path, bool loop = false);
+    ~StereoRecordingReader();
+
+    // true if path starts with a recording header
+    static bool probe(const std::string &path);
+
+    bool isOpened() override { return m_map != nullptr; }
+    int width() override { return m_width; }
+    int height() override { return m_height; }
+
+    // converts the next frame to gray images like StereoCamera::getCamData
+    bool getCamData(StereoCameraData &camData) override;
+    // the next frame in camData.raw, pointing into the mapping
+    bool getRawCamData(StereoCameraData &camData) override;
+    bool finished() override;
+
+    uint64_t frameCount() const { return m_count; }
+    // index of the frame the next getCamData or getRawCamData returns
+    uint64_t position() const { return m_position; }
+    // false past the last frame, not while a StereoCapture reads the reader
+    bool seek(uint64_t index);
+
+    // random access to the recorded frames, nullptr past the last frame
+    const uint8_t *frameData(uint64_t index) const;
+    uint64_t timestamp(uint64_t index) const;
+
+private:
+    bool next(uint64_t &index);
+
+    int m_fd = -1;
+    uint8_t *m_map = nullptr;
+    size_t m_mapSize = 0;
+    const RecordingIndexEntry *m_index = nullptr;
+
+    int m_width = 0;
+    int m_height = 0;
+    uint64_t m_frameBytes = 0;
+    uint64_t m_count = 0;
+    uint64_t m_position = 0;
+    bool m_loop;
+};
+
+#endif //_STEREO_RECORDING_HPP__
@@ -0,0 +1,44 @@
+#ifndef _STEREO_SOURCE_HPP__
+#define _STEREO_SOURCE_HPP__
+
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+struct StereoCameraData
+{
+    uint64_t timestamp_ms;
+
+    cv::Mat frame_0; // left camera
+    cv::Mat frame_1; // right camera
+
+    // interleaved Bayer GR frame of getRawCamData, byte 0 right and byte 1 left camera
+    cv::Mat raw;
+};
+
+/**
+ * Producer of stereo frames, the live camera or a recording on disk.
+ */
+class StereoSource
+{
+public:
+    typedef std::shared_ptr<StereoSource> Ptr;
+
+    virtual ~StereoSource() {}
+
+    // false if the source could not be opened
+    virtual bool isOpened() = 0;
+    virtual int width() = 0;
+    virtual int height() = 0;
+
+    // next pair as gray images in frame_0 and frame_1, false on timeout or at the end of a recording
+    virtual bool getCamData(StereoCameraData &camData) = 0;
+
+    // next frame in StereoCameraData::raw, only sources delivering interleaved frames implement it
+    virtual bool getRawCamData(StereoCameraData &) { return false; }
+
+    // true once a recording has delivered its last frame, a live camera never finishes
+    virtual bool finished() { return false; }
+};
+
+#endif //_STEREO_SOURCE_HPP__
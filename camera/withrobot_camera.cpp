@@ -27,11 +27,14 @@
 
 #include "withrobot_camera.hpp"
 
+#include <sys/syscall.h>
+#include <limits.h>
+
 
 using namespace Withrobot;
 
 #define WITHROBOT_CAMERA_IOCTL_RETRY     5
-#define WITHROBOT_CAMERA_REQUEST_BUFFER_COUNT   1
+#define WITHROBOT_CAMERA_REQUEST_BUFFER_COUNT   4  /* default, the driver keeps filling while frames are borrowed */
 
 /**
  * Cam class constructor
@@ -58,7 +61,25 @@ Camera::Camera(const char* dev_name, struct camera_format* conf, const char* for
      */
     streaming = false;
     buffer_count = 0;
+    request_buffer_count = WITHROBOT_CAMERA_REQUEST_BUFFER_COUNT;
     buffers = 0;
+    late_threshold_us = 0;
+    has_sequence = false;
+    last_sequence = 0;
+
+    /* readiness of the capture queue, see wait_readable */
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd != -1) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            DBG_PERROR("epoll_ctl");
+            close(epoll_fd);
+            epoll_fd = -1;
+        }
+    }
 
     memset(&v4l2_s, 0, sizeof(v4l2_s));
 
@@ -99,6 +120,10 @@ Camera::~Camera()
     /* free memory */
     remove_buffers();
 
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+    }
+
     /* close device */
     if (fd > 0) {
         close(fd);
@@ -151,6 +176,9 @@ bool Camera::remove_buffers()
     /* free memory */
     for (unsigned int i=0; i < buffer_count; i++) {
         munmap(buffers[i].buffer, buffers[i].length);
+        if (buffers[i].dmabuf_fd >= 0) {
+            close(buffers[i].dmabuf_fd);
+        }
     }
     buffer_count = 0;
 
@@ -209,7 +237,7 @@ bool Camera::set_buffer()
 {
     /* request buffers */
     memset(&v4l2_s.requestbuffers, 0, sizeof(v4l2_s.requestbuffers));
-    v4l2_s.requestbuffers.count = WITHROBOT_CAMERA_REQUEST_BUFFER_COUNT;
+    v4l2_s.requestbuffers.count = request_buffer_count;
     v4l2_s.requestbuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     v4l2_s.requestbuffers.memory = V4L2_MEMORY_MMAP;
     if (xioctl(VIDIOC_REQBUFS, &v4l2_s.requestbuffers) == -1) {
@@ -219,6 +247,9 @@ bool Camera::set_buffer()
 
     buffer_count = v4l2_s.requestbuffers.count;
     buffers = new _buffer[v4l2_s.requestbuffers.count];
+    for (unsigned int i = 0; i < buffer_count; i++) {
+        buffers[i].dmabuf_fd = -1;
+    }
 
     /* memory */
     unsigned int buffer_max = 0;
@@ -264,6 +295,9 @@ bool Camera::set_outbuffer()
 
     buffer_count = v4l2_s.requestbuffers.count;
     buffers = new _buffer[v4l2_s.requestbuffers.count];
+    for (unsigned int i = 0; i < buffer_count; i++) {
+        buffers[i].dmabuf_fd = -1;
+    }
 
     /* memory */
     unsigned int buffer_max = 0;
@@ -503,6 +537,10 @@ bool Camera::start()
         return false;
     }
 
+    stats = capture_stats();
+    stats.queue_depth = buffer_count;
+    has_sequence = false;
+
     streaming = true;
 
     for (unsigned int i = 0; i < buffer_count; i++) {
@@ -611,26 +649,58 @@ bool Camera::stop_out()
  */
 int Camera::get_frame(unsigned char* out_buffer, const unsigned int size, unsigned int timeout_sec)
 {
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
-    struct timeval timeout;
-    timeout.tv_sec = timeout_sec;
-    timeout.tv_usec = 0;
-    int r = select(fd+1, &fds, NULL, NULL, &timeout);
-
-    if (r == -1) {
-        DBG_PERROR("Timeout");
-        // exit(EXIT_FAILURE);
+    if (!wait_readable(static_cast<uint64_t>(timeout_sec) * 1000000u)) {
         return -1;
     }
 
-    if (r == 0) {
-        return -1;
+    return get_buffer(out_buffer, size);
+}
+/**
+ * 장치 드라이버에서 한 프레임을 복사 없이 빌려주는 함수 (zero-copy version of get_frame)
+ * @param frame         [출력] mmap 버퍼를 가리키는 frame, a frame it held before is released first
+ * @param timeout_sec   [입력] 타임아웃 시간(초)
+ * @return true if a frame was dequeued
+ */
+bool Camera::borrow_frame(BorrowedFrame& frame, unsigned int timeout_sec)
+{
+    return try_borrow_frame(frame, static_cast<uint64_t>(timeout_sec) * 1000000u);
+}
+
+/**
+ * borrow_frame 의 non-blocking 버전
+ * @param frame         [출력] mmap 버퍼를 가리키는 frame, a frame it held before is released first
+ * @param timeout_us    [입력] 타임아웃 시간(마이크로초), 0 returns at once if no frame is ready
+ * @return true if a frame was dequeued
+ */
+bool Camera::try_borrow_frame(BorrowedFrame& frame, uint64_t timeout_us)
+{
+    frame.release();
+
+    if (!wait_readable(timeout_us)) {
+        return false;
     }
 
-    return get_buffer(out_buffer, size);
+    /* v4l2_s.buffer is shared with get_buffer, the borrowed one lives on the stack */
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(VIDIOC_DQBUF, &buffer) == -1) {
+        DBG_PERROR("VIDIOC_DQBUF");
+        return false;
+    }
+
+    count_frame(buffer);
+
+    frame.camera = this;
+    frame.buffer = buffers[buffer.index].buffer;
+    frame.bytesused = buffer.bytesused;
+    frame.index = buffer.index;
+    frame.sequence = buffer.sequence;
+    frame.timestamp = buffer.timestamp;
+    return true;
 }
+
 int Camera::set_frame(unsigned char* in_buffer, const unsigned int size, unsigned int timeout_sec)
 {
 #if 0
@@ -979,6 +1049,7 @@ int Camera::get_buffer(unsigned char* buffer, const unsigned int size)
         DBG_PERROR("VIDIOC_DQBUF");
         return retval;
     }
+    count_frame(v4l2_s.buffer);
 
     if (v4l2_s.buffer.bytesused == size || v4l2_s.format.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG) {
         retval = v4l2_s.buffer.bytesused;
@@ -1026,6 +1097,188 @@ int Camera::write_buffer(unsigned char* buffer, const unsigned int size)
     return retval;
 }
 
+/**
+ * 캡처 버퍼 개수 설정
+ * @param count [입력] requested buffers
+ * @return false while streaming
+ */
+bool Camera::set_buffer_count(unsigned int count)
+{
+    if (streaming || count < 1) {
+        return false;
+    }
+    request_buffer_count = count;
+    return true;
+}
+
+capture_stats Camera::get_capture_stats()
+{
+    LockGuard l(mutex);
+    return stats;
+}
+
+/**
+ * 캡처 큐에 프레임이 준비될 때까지 대기 (epoll)
+ * @param timeout_us    [입력] 타임아웃 시간(마이크로초), 0 only polls
+ * @return true if a frame can be dequeued
+ */
+bool Camera::wait_readable(uint64_t timeout_us)
+{
+    if (epoll_fd == -1) {
+        /* no epoll instance, fall back to select */
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        struct timeval timeout;
+        timeout.tv_sec = timeout_us / 1000000u;
+        timeout.tv_usec = timeout_us % 1000000u;
+        return select(fd+1, &fds, NULL, NULL, &timeout) > 0;
+    }
+
+    struct epoll_event event;
+    int r;
+    do {
+#if defined(SYS_epoll_pwait2)
+        /* nanosecond timeout, Linux 5.11 */
+        struct timespec timeout;
+        timeout.tv_sec = timeout_us / 1000000u;
+        timeout.tv_nsec = (timeout_us % 1000000u) * 1000;
+        r = syscall(SYS_epoll_pwait2, epoll_fd, &event, 1, &timeout, NULL, 0);
+        if (r == -1 && errno == ENOSYS)
+#endif
+        {
+            /* millisecond timeout, rounded up so short waits do not become polls */
+            const uint64_t timeout_ms = (timeout_us + 999u) / 1000u;
+            r = epoll_wait(epoll_fd, &event, 1, timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms);
+        }
+    } while (r == -1 && errno == EINTR);
+
+    if (r == -1) {
+        DBG_PERROR("epoll_wait");
+        return false;
+    }
+    return r > 0;
+}
+
+/**
+ * dropped and late frame counters
+ * @param buffer    [입력] dequeued buffer
+ */
+void Camera::count_frame(const struct v4l2_buffer& buffer)
+{
+    LockGuard l(mutex);
+
+    stats.frames++;
+    if (has_sequence && buffer.sequence > last_sequence + 1) {
+        stats.dropped += buffer.sequence - last_sequence - 1;
+    }
+    has_sequence = true;
+    last_sequence = buffer.sequence;
+
+    /* the age is only known for monotonic timestamps */
+    if (late_threshold_us > 0 && (buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const long long age_us = (now.tv_sec - buffer.timestamp.tv_sec) * 1000000LL
+                               + now.tv_nsec / 1000 - buffer.timestamp.tv_usec;
+        if (age_us > (long long)late_threshold_us) {
+            stats.late++;
+        }
+    }
+}
+
+/**
+ * 빌려준 버퍼를 장치에 반환
+ * @param index [입력] buffer index
+ * @return
+ */
+bool Camera::requeue_buffer(unsigned int index)
+{
+    if (!streaming || index >= buffer_count) {
+        return false;
+    }
+
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    if (xioctl(VIDIOC_QBUF, &buffer) == -1) {
+        DBG_PERROR("VIDIOC_QBUF");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 버퍼를 DMABUF file descriptor 로 export (VIDIOC_EXPBUF), once per buffer
+ * @param index [입력] buffer index
+ * @return file descriptor, -1 on failure
+ */
+int Camera::export_dmabuf(unsigned int index)
+{
+    LockGuard l(mutex);
+
+    if (index >= buffer_count) {
+        return -1;
+    }
+    if (buffers[index].dmabuf_fd >= 0) {
+        return buffers[index].dmabuf_fd;
+    }
+
+    struct v4l2_exportbuffer expbuf;
+    memset(&expbuf, 0, sizeof(expbuf));
+    expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = index;
+    expbuf.flags = O_RDONLY | O_CLOEXEC;
+    if (xioctl(VIDIOC_EXPBUF, &expbuf) == -1) {
+        DBG_PERROR("VIDIOC_EXPBUF");
+        return -1;
+    }
+    buffers[index].dmabuf_fd = expbuf.fd;
+    return expbuf.fd;
+}
+
+/*
+ * BorrowedFrame
+ */
+BorrowedFrame::BorrowedFrame(BorrowedFrame&& other)
+{
+    *this = std::move(other);
+}
+
+BorrowedFrame& BorrowedFrame::operator=(BorrowedFrame&& other)
+{
+    if (this != &other) {
+        release();
+        camera = other.camera;
+        buffer = other.buffer;
+        bytesused = other.bytesused;
+        index = other.index;
+        sequence = other.sequence;
+        timestamp = other.timestamp;
+        other.camera = 0;
+        other.buffer = 0;
+        other.bytesused = 0;
+    }
+    return *this;
+}
+
+int BorrowedFrame::dmabuf_fd() const
+{
+    return camera ? camera->export_dmabuf(index) : -1;
+}
+
+void BorrowedFrame::release()
+{
+    if (camera) {
+        camera->requeue_buffer(index);
+        camera = 0;
+        buffer = 0;
+        bytesused = 0;
+    }
+}
+
 /**
  * ioctl with a number of retries in the case of I/O failure
  *
@@ -24,6 +24,7 @@
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/epoll.h>
 #include <libv4l2.h>
 #include <fcntl.h>
 #include <string.h>
@@ -37,6 +38,7 @@
 #include <map>
 #include <sstream>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "withrobot_utility.hpp"
 
@@ -198,6 +200,65 @@ namespace Withrobot {
     };
 
 
+    /**
+     * Capture counters since start()
+     */
+    struct capture_stats {
+        unsigned long long frames;      //!< frames dequeued
+        unsigned long long dropped;     //!< gaps in the frame sequence, frames the driver had no free buffer for
+        unsigned long long late;        //!< frames older than the late threshold when dequeued
+        unsigned int queue_depth;       //!< capture buffers granted by the driver
+
+        capture_stats() : frames(0), dropped(0), late(0), queue_depth(0) {}
+    };
+
+    class Camera;
+
+    /**
+     * Frame borrowed from the mmap'd V4L2 capture buffers by Camera::borrow_frame, without a copy.
+     * The buffer is given back to the driver (VIDIOC_QBUF) by release() or the destructor,
+     * which must happen before the camera is stopped.
+     */
+    class BorrowedFrame
+    {
+    public:
+        BorrowedFrame() {}
+        ~BorrowedFrame() { release(); }
+
+        BorrowedFrame(BorrowedFrame&& other);
+        BorrowedFrame& operator=(BorrowedFrame&& other);
+        BorrowedFrame(const BorrowedFrame&) = delete;
+        BorrowedFrame& operator=(const BorrowedFrame&) = delete;
+
+        inline bool valid() const { return camera != 0; }
+        inline const unsigned char* data() const { return buffer; }
+        inline unsigned int size() const { return bytesused; }
+        inline unsigned int get_index() const { return index; }
+        inline unsigned int get_sequence() const { return sequence; }
+        inline const timeval& get_timestamp() const { return timestamp; }
+
+        /**
+         * DMABUF file descriptor of the buffer (VIDIOC_EXPBUF), exported on first use and owned by the camera
+         * @return file descriptor, -1 if the driver cannot export
+         */
+        int dmabuf_fd() const;
+
+        /**
+         * 버퍼를 장치에 반환 (re-queue), the frame is invalid afterwards
+         */
+        void release();
+
+    private:
+        friend class Camera;
+
+        Camera* camera = 0;
+        const unsigned char* buffer = 0;
+        unsigned int bytesused = 0;
+        unsigned int index = 0;
+        unsigned int sequence = 0;
+        timeval timestamp = {0, 0};
+    };
+
     /**
      * Camera Class
      */
@@ -240,6 +301,24 @@ namespace Withrobot {
         bool get_current_format(camera_format& fmt);
 
         int get_frame(unsigned char* out_buffer, const unsigned int size, unsigned int timeout_sec=1);
+        bool borrow_frame(BorrowedFrame& frame, unsigned int timeout_sec=1);
+        bool try_borrow_frame(BorrowedFrame& frame, uint64_t timeout_us=0);
+
+        /**
+         * 캡처 버퍼 개수 설정 (V4L2 queue depth), applied by the next start()
+         * Fewer buffers keep the latency low, more buffers absorb jitter of the consumer.
+         * @param count [입력] requested buffers, the driver may grant a different number
+         * @return false while streaming
+         */
+        bool set_buffer_count(unsigned int count);
+
+        /**
+         * Frames older than this when dequeued count as late, 0 disables the check
+         * @param threshold_us [입력] microseconds
+         */
+        inline void set_late_threshold(unsigned int threshold_us) { late_threshold_us = threshold_us; }
+
+        capture_stats get_capture_stats();
         int set_frame(unsigned char* in_buffer, const unsigned int size, unsigned int timeout_sec=1);
 
         bool set_format(const char* format_description);
@@ -272,8 +351,11 @@ namespace Withrobot {
         struct _buffer {
             unsigned char* buffer;
             unsigned int length;
+            int dmabuf_fd;  /* -1 until exported by BorrowedFrame::dmabuf_fd */
         };
 
+        friend class BorrowedFrame;
+
 
         struct _v4l2 {
             enum v4l2_buf_type buf_type;
@@ -301,6 +383,13 @@ namespace Withrobot {
         _buffer* buffers;
 
         unsigned int buffer_count;
+        unsigned int request_buffer_count;
+
+        int epoll_fd;
+        unsigned int late_threshold_us;
+        capture_stats stats;
+        bool has_sequence;
+        unsigned int last_sequence;
         unsigned char disable_libv4l2; /* set to 1 to disable libv4l2 calls */
 
         std::map<std::string, v4l2_queryctrl> valid_control_list;
@@ -332,6 +421,10 @@ namespace Withrobot {
         bool enumerate_frame_intervals(const unsigned int pixelformat, const unsigned int width, const unsigned int height, std::string& description);
 
         int get_buffer(unsigned char* yuy2_buffer, const unsigned int size);
+        bool requeue_buffer(unsigned int index);
+        bool wait_readable(uint64_t timeout_us);
+        void count_frame(const struct v4l2_buffer& buffer);
+        int export_dmabuf(unsigned int index);
         int write_buffer(unsigned char* yuy2_buffer, const unsigned int size);
 
         bool remove_buffers();
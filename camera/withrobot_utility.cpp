@@ -27,6 +27,8 @@
 
 #include "withrobot_utility.hpp"
 
+#include <cerrno>
+
 using namespace Withrobot;
 
 /*
@@ -216,6 +218,32 @@ Mutex::~Mutex()
 }
 
 
+/*
+ * semaphore waits with a deadline
+ */
+timespec Withrobot::deadline_after(unsigned int timeout_ms)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += static_cast<long>(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+bool Withrobot::sem_wait_until(sem_t* sem, const timespec& deadline)
+{
+    while (sem_timedwait(sem, &deadline) == -1) {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+
 /*
  * Timer
  */
@@ -29,6 +29,8 @@
 #define WITHROBOT_UTILITY_HPP_
 
 #include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <cstring>
@@ -161,6 +163,17 @@ namespace Withrobot {
      */
     static inline void msleep(unsigned int msec) { usleep(msec*1000); }
 
+    /**
+     * Absolute CLOCK_REALTIME deadline timeout_ms from now, for sem_timedwait.
+     */
+    timespec deadline_after(unsigned int timeout_ms);
+
+    /**
+     * Waits on sem until the deadline, a signal does not end the wait.
+     * @return false once the deadline has passed
+     */
+    bool sem_wait_until(sem_t* sem, const timespec& deadline);
+
     /**
      * Timer
      */
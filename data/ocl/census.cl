@@ -17,8 +17,8 @@
 // census transfrom defines
 #define WINDOW_WIDTH  9
 #define WINDOW_HEIGHT  7
-#define BLOCK_SIZE_CENSUS 128
-#define LINES_PER_BLOCK 16
+@BLOCK_SIZE_CENSUS@
+@LINES_PER_BLOCK@
 #define SMEM_BUFFER_SIZE (WINDOW_HEIGHT + 1)
 
 
@@ -34,6 +34,11 @@ kernel void census_transform_kernel(
 
     local pixel_type smem_lines[SMEM_BUFFER_SIZE][BLOCK_SIZE_CENSUS];
 
+    // images of a batch are stored one after another
+    const int batch = get_group_id(2);
+    src += batch * pitch * height;
+    dest += batch * width * height;
+
     const int tid = get_local_id(0);
     const int x0 = get_group_id(0) * (BLOCK_SIZE_CENSUS - WINDOW_WIDTH + 1) - half_kw;
     const int y0 = get_group_id(1) * LINES_PER_BLOCK;
@@ -20,6 +20,11 @@ kernel void check_consistency_kernel(global DST_T* d_leftDisp,
     if (i >= height || j >= width)
         return;
 
+    const int batch = get_global_id(2);
+    d_leftDisp += batch * dst_pitch * height;
+    d_rightDisp += batch * dst_pitch * height;
+    d_left += batch * src_pitch * height;
+
     // left-right consistency check, only on leftDisp, but could be done for rightDisp too
 
     SRC_T mask = d_left[i * src_pitch + j];
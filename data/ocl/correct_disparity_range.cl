@@ -15,6 +15,8 @@ kernel void correct_disparity_range_kernel(global uint16_t* d_disp,
         return;
     }
 
+    d_disp += get_global_id(2) * pitch * height;
+
     uint16_t d = d_disp[y * pitch + x];
     if (d == INVALID_DISP)
     {
@@ -0,0 +1,27 @@
+//include inttypes
+#define INVALID_DISP ((uint16_t)(-1))
+
+// Adds the number of invalid pixels to count, one global atomic per work group.
+kernel void count_invalid_kernel(
+    global const uint16_t* disp,
+    volatile global uint32_t* count,
+    int width,
+    int height,
+    int pitch)
+{
+    local uint32_t group_count;
+    const bool first = get_local_id(0) == 0 && get_local_id(1) == 0;
+    if (first)
+        group_count = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    const int batch = get_global_id(2);
+    if (x < width && y < height && disp[(batch * height + y) * pitch + x] == INVALID_DISP)
+        atomic_inc(&group_count);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (first)
+        atomic_add(count, group_count);
+}
@@ -0,0 +1,83 @@
+//include inttypes
+// fixed point RGB to gray weights of OpenCV
+#define R2Y 4899
+#define G2Y 9617
+#define B2Y 1868
+#define GRAY_SHIFT 14
+
+// reflect 101 keeps the colour of the mirrored pixel
+inline int reflect(int i, int n)
+{
+    return i < 0 ? -i : (i >= n ? 2 * n - 2 - i : i);
+}
+
+inline uint32_t bayer_to_gray(global const uchar2* src, int channel, int x, int y,
+                              int width, int height, int red_x, int red_y)
+{
+    const int xl = reflect(x - 1, width);
+    const int xr = reflect(x + 1, width);
+    const int yu = reflect(y - 1, height);
+    const int yd = reflect(y + 1, height);
+#define PIXEL(X, Y) ((uint32_t)(channel ? src[(Y) * width + (X)].y : src[(Y) * width + (X)].x))
+    const uint32_t c = PIXEL(x, y);
+    const uint32_t cross = PIXEL(xl, y) + PIXEL(xr, y) + PIXEL(x, yu) + PIXEL(x, yd);
+    const uint32_t diagonal = PIXEL(xl, yu) + PIXEL(xr, yu) + PIXEL(xl, yd) + PIXEL(xr, yd);
+    const uint32_t horizontal = PIXEL(xl, y) + PIXEL(xr, y);
+    const uint32_t vertical = PIXEL(x, yu) + PIXEL(x, yd);
+#undef PIXEL
+
+    // bilinear colours times 4
+    uint32_t r, g, b;
+    const bool red_row = ((y ^ red_y) & 1) == 0;
+    const bool red_column = ((x ^ red_x) & 1) == 0;
+    if (red_row && red_column)
+    {
+        r = 4 * c;
+        g = cross;
+        b = diagonal;
+    }
+    else if (!red_row && !red_column)
+    {
+        r = diagonal;
+        g = cross;
+        b = 4 * c;
+    }
+    else if (red_row)
+    {
+        r = 2 * horizontal;
+        g = 4 * c;
+        b = 2 * vertical;
+    }
+    else
+    {
+        r = 2 * vertical;
+        g = 4 * c;
+        b = 2 * horizontal;
+    }
+    return (r * R2Y + g * G2Y + b * B2Y + (1u << (GRAY_SHIFT + 1))) >> (GRAY_SHIFT + 2);
+}
+
+// Splits interleaved stereo frames (two bytes per pixel, the first one of the right camera and the
+// second one of the left camera like the YUYV stream of the oCamS) and converts the Bayer mosaic
+// of both to gray, (red_x, red_y) is the parity of the red pixels.
+kernel void deinterleave_bayer_kernel(
+    global uint8_t* left,
+    global uint8_t* right,
+    global const uchar2* src,
+    int width,
+    int height,
+    int red_x,
+    int red_y)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    const int batch = get_global_id(2);
+    const size_t offset = (size_t)batch * width * height;
+    src += offset;
+
+    left[offset + y * width + x] = (uint8_t)bayer_to_gray(src, 1, x, y, width, height, red_x, red_y);
+    right[offset + y * width + x] = (uint8_t)bayer_to_gray(src, 0, x, y, width, height, red_x, red_y);
+}
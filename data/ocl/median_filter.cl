@@ -19,6 +19,10 @@ kernel void median3x3(
     const int idy = get_global_id(1);
     const int id = idx + idy * pitch;
 
+    const int batch = get_global_id(2);
+    input += batch * pitch * ny;
+    output += batch * pitch * ny;
+
     if (idx >= nx || idy >= ny)
         return;
 
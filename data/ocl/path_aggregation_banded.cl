@@ -0,0 +1,124 @@
+//include inttypes
+@BAND_WIDTH@
+@PATHS_PER_BLOCK@
+@DX@
+@DY@
+@FUSED_AGGREGATION@
+
+#if FUSED_AGGREGATION
+#define cost_type uint16_t
+#else
+#define cost_type uint8_t
+#endif
+
+// Scanline aggregation along (DX, DY) restricted to a band of BAND_WIDTH disparities
+// starting at band[pixel]. A work item is one disparity of the band, a work group
+// holds PATHS_PER_BLOCK paths. When the band moves between neighbouring pixels the
+// previous costs are read at the same absolute disparity, disparities which were
+// outside the previous band only get the P2 transition.
+kernel void aggregate_banded_kernel(
+    global cost_type* dest,
+    global const uint32_t* left,
+    global const uint32_t* right,
+    global const uint16_t* band,
+    int width,
+    int height,
+    uint32_t p1,
+    uint32_t p2,
+    int min_disp,
+    int path_index,
+    int accumulate)
+{
+    local uint32_t prev_cost[PATHS_PER_BLOCK][BAND_WIDTH];
+    local uint32_t min_buffer[PATHS_PER_BLOCK][BAND_WIDTH];
+
+    const int lane = get_local_id(0) % BAND_WIDTH;
+    const int slot = get_local_id(0) / BAND_WIDTH;
+    const int path = get_group_id(0) * PATHS_PER_BLOCK + slot;
+
+    // the per path volumes hold the whole batch, like the ones of PathAggregation
+    const size_t pixels = (size_t)width * height;
+    const int batch = get_group_id(1);
+    dest += ((size_t)path_index * get_num_groups(1) + batch) * pixels * BAND_WIDTH;
+    left += batch * pixels;
+    right += batch * pixels;
+    band += batch * pixels;
+
+    // every path starts on the image border, diagonals first on the top or
+    // bottom row and then on the left or right column
+    const int num_paths = DY == 0 ? height : (DX == 0 ? width : width + height - 1);
+    const int num_steps = DY == 0 ? width : (DX == 0 ? height : min(width, height));
+    int x, y;
+    if (DY == 0)
+    {
+        x = DX > 0 ? 0 : width - 1;
+        y = path;
+    }
+    else if (DX == 0 || path < width)
+    {
+        x = path;
+        y = DY > 0 ? 0 : height - 1;
+    }
+    else
+    {
+        const int i = path - width + 1;
+        x = DX > 0 ? 0 : width - 1;
+        y = DY > 0 ? i : height - 1 - i;
+    }
+
+    int prev_offset = 0;
+    uint32_t prev_min = 0;
+    bool first = true;
+    for (int step = 0; step < num_steps; ++step)
+    {
+        // the barriers below need every work item, finished paths keep looping
+        const bool inside = path < num_paths && 0 <= x && x < width && 0 <= y && y < height;
+        int offset = 0;
+        uint32_t out = 0;
+        if (inside)
+        {
+            const int idx = y * width + x;
+            offset = band[idx];
+            const int xr = x - (min_disp + offset + lane);
+            const uint32_t right_feature = (0 <= xr && xr < width) ? right[y * width + xr] : 0;
+            out = popcount(left[idx] ^ right_feature);
+            if (!first)
+            {
+                const int i = offset + lane - prev_offset;
+                uint32_t best = prev_min + p2;
+                if (0 <= i && i < BAND_WIDTH)
+                    best = min(best, prev_cost[slot][i]);
+                if (1 <= i && i <= BAND_WIDTH)
+                    best = min(best, prev_cost[slot][i - 1] + p1);
+                if (-1 <= i && i < BAND_WIDTH - 1)
+                    best = min(best, prev_cost[slot][i + 1] + p1);
+                out += best - prev_min;
+            }
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        prev_cost[slot][lane] = out;
+        min_buffer[slot][lane] = out;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int s = BAND_WIDTH / 2; s > 0; s >>= 1)
+        {
+            if (lane < s)
+                min_buffer[slot][lane] = min(min_buffer[slot][lane], min_buffer[slot][lane + s]);
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        if (inside)
+        {
+            prev_min = min_buffer[slot][0];
+            prev_offset = offset;
+            first = false;
+            global cost_type* d = dest + (size_t)(y * width + x) * BAND_WIDTH + lane;
+            if (accumulate)
+                *d += (cost_type)out;
+            else
+                *d = (cost_type)out;
+        }
+        x += DX;
+        y += DY;
+    }
+}
@@ -2,6 +2,39 @@
 @SUBGROUP_SIZE@
 @SIZE@
 @BLOCK_SIZE@
+@FUSED_AGGREGATION@
+@SUBGROUP_SHUFFLE@
+
+// hardware shuffles between the lanes of a path: 0 emulates them in local memory,
+// 1 uses cl_intel_subgroups, 2 cl_khr_subgroup_shuffle and cl_khr_subgroup_shuffle_relative
+#if SUBGROUP_SHUFFLE == 1
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#define subgroup_shuffle_up(x) intel_sub_group_shuffle_up((x), (x), 1u)
+#define subgroup_shuffle_down(x) intel_sub_group_shuffle_down((x), (x), 1u)
+#define subgroup_shuffle_xor(x, m) intel_sub_group_shuffle_xor((x), (m))
+#elif SUBGROUP_SHUFFLE == 2
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle_relative : enable
+#define subgroup_shuffle_up(x) sub_group_shuffle_up((x), 1u)
+#define subgroup_shuffle_down(x) sub_group_shuffle_down((x), 1u)
+#define subgroup_shuffle_xor(x, m) sub_group_shuffle_xor((x), (m))
+#endif
+
+#if SUBGROUP_SHUFFLE
+// The lanes of a path must lie in one hardware subgroup. The hardware width is
+// only known on the device, the test is uniform over the work group.
+#define NATIVE_SUBGROUPS (get_max_sub_group_size() % SUBGROUP_SIZE == 0)
+#else
+#define NATIVE_SUBGROUPS 0
+#endif
+
+// fused aggregation sums every path into one uint16 cost volume
+#if FUSED_AGGREGATION
+#define cost_type uint16_t
+#else
+#define cost_type uint8_t
+#endif
 
 typedef struct
 {
@@ -17,6 +50,68 @@ void init(DynamicProgramming* dp, local uint32_t* dp_local)
     //barrier(CLK_LOCAL_MEM_FENCE);
 }
 
+#if SUBGROUP_SHUFFLE
+// Minimum over the lanes of a path.
+uint32_t path_min(uint32_t value)
+{
+    if (get_max_sub_group_size() == SUBGROUP_SIZE)
+    {
+        // one path per hardware subgroup
+        return sub_group_reduce_min(value);
+    }
+    for (unsigned int i = SUBGROUP_SIZE / 2; i > 0; i >>= 1)
+    {
+        value = min(value, subgroup_shuffle_xor(value, i));
+    }
+    return value;
+}
+
+// Same recurrence as update, the neighbouring lanes are read with hardware
+// shuffles instead of local memory, so it needs no barrier.
+void update_native(DynamicProgramming* dp,
+    uint32_t* local_costs,
+    uint32_t p1,
+    uint32_t p2)
+{
+    const unsigned int lane_id = get_local_id(0) % SUBGROUP_SIZE;
+
+    const uint32_t dp0 = dp->dp[0];
+    const uint32_t prev = subgroup_shuffle_up(dp->dp[DP_BLOCK_SIZE - 1]);
+    const uint32_t next = subgroup_shuffle_down(dp0);
+
+    uint32_t lazy_out = 0, local_min = 0;
+    {
+        const unsigned int k = 0;
+        uint32_t out = min(dp->dp[k] - dp->last_min, p2);
+        if (lane_id != 0) { out = min(out, prev - dp->last_min + p1); }
+        out = min(out, dp->dp[k + 1] - dp->last_min + p1);
+        lazy_out = local_min = out + local_costs[k];
+    }
+    for (unsigned int k = 1; k + 1 < DP_BLOCK_SIZE; ++k)
+    {
+        uint32_t out = min(dp->dp[k] - dp->last_min, p2);
+        out = min(out, dp->dp[k - 1] - dp->last_min + p1);
+        out = min(out, dp->dp[k + 1] - dp->last_min + p1);
+        dp->dp[k - 1] = lazy_out;
+        lazy_out = out + local_costs[k];
+        local_min = min(local_min, lazy_out);
+    }
+    {
+        const unsigned int k = DP_BLOCK_SIZE - 1;
+        uint32_t out = min(dp->dp[k] - dp->last_min, p2);
+        out = min(out, dp->dp[k - 1] - dp->last_min + p1);
+        if (lane_id + 1 != SUBGROUP_SIZE)
+        {
+            out = min(out, next - dp->last_min + p1);
+        }
+        dp->dp[k - 1] = lazy_out;
+        dp->dp[k] = out + local_costs[k];
+        local_min = min(local_min, dp->dp[k]);
+    }
+    dp->last_min = path_min(local_min);
+}
+#endif
+
 void update(DynamicProgramming* dp,
     uint32_t* local_costs,
     uint32_t p1,
@@ -24,6 +119,13 @@ void update(DynamicProgramming* dp,
     uint32_t mask,
     local uint32_t * shfl_memory)
 {
+#if SUBGROUP_SHUFFLE
+    if (NATIVE_SUBGROUPS)
+    {
+        update_native(dp, local_costs, p1, p2);
+        return;
+    }
+#endif
     const unsigned int lane_id = get_local_id(0) % SUBGROUP_SIZE;
 
     const uint32_t dp0 = dp->dp[0];
@@ -100,6 +202,16 @@ void update(DynamicProgramming* dp,
 }
 
 
+void store_path_costs(global cost_type* dest, const int N,
+    const uint32_t* ptr, int accumulate)
+{
+#if FUSED_AGGREGATION
+    accumulate_uint16_vector(dest, N, ptr, accumulate);
+#else
+    store_uint8_vector(dest, N, ptr);
+#endif
+}
+
 unsigned int generate_mask()
 {
     return (unsigned int)((1ul << SIZE) - 1u);
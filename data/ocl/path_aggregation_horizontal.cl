@@ -5,7 +5,7 @@
 @DIRECTION@
 @MAX_DISPARITY@
 @DP_BLOCKS_PER_THREAD@
-#define WARP_SIZE 32
+@WARP_SIZE@
 
 #define feature_type uint32_t
 
@@ -15,20 +15,27 @@
 
 
 kernel void aggregate_horizontal_path_kernel(
-    global uint8_t* dest,
+    global cost_type* dest,
     global const feature_type* left,
     global const feature_type* right,
     int width,
     int height,
     unsigned int p1,
     unsigned int p2,
-    int min_disp)
+    int min_disp,
+    int accumulate)
 {
     if (width == 0 || height == 0)
     {
         return;
     }
 
+    // images of a batch are stored one after another, one per group row
+    const unsigned int batch = get_group_id(1);
+    left += batch * width * height;
+    right += batch * width * height;
+    dest += (size_t)batch * MAX_DISPARITY * width * height;
+
     feature_type right_buffer[DP_BLOCKS_PER_THREAD][DP_BLOCK_SIZE];
     local feature_type shfl_buffer[BLOCK_SIZE];
     local feature_type shfl_buffer_local[BLOCK_SIZE];
@@ -101,16 +108,30 @@ kernel void aggregate_horizontal_path_kernel(
                 const feature_type left_value = left[j * feature_step + x];
                 if (DIRECTION > 0) 
                 {
-                    shfl_buffer_local[get_local_id(0)] = right_buffer[j][DP_BLOCK_SIZE - 1];
-                    //Maybe it is not necessary
-                    barrier(CLK_LOCAL_MEM_FENCE);
-                    for (unsigned int k = DP_BLOCK_SIZE - 1; k > 0; --k)
+                    if (NATIVE_SUBGROUPS)
                     {
-                        right_buffer[j][k] = right_buffer[j][k - 1];
+#if SUBGROUP_SHUFFLE
+                        const feature_type t = subgroup_shuffle_up(right_buffer[j][DP_BLOCK_SIZE - 1]);
+                        for (unsigned int k = DP_BLOCK_SIZE - 1; k > 0; --k)
+                        {
+                            right_buffer[j][k] = right_buffer[j][k - 1];
+                        }
+                        right_buffer[j][0] = t;
+#endif
+                    }
+                    else
+                    {
+                        shfl_buffer_local[get_local_id(0)] = right_buffer[j][DP_BLOCK_SIZE - 1];
+                        //Maybe it is not necessary
+                        barrier(CLK_LOCAL_MEM_FENCE);
+                        for (unsigned int k = DP_BLOCK_SIZE - 1; k > 0; --k)
+                        {
+                            right_buffer[j][k] = right_buffer[j][k - 1];
+                        }
+                        const int shfl_prev_idx = max(0, (int)get_local_id(0) - 1);
+                        right_buffer[j][0] = shfl_buffer_local[shfl_prev_idx];
+                        barrier(CLK_LOCAL_MEM_FENCE);
                     }
-                    const int shfl_prev_idx = max(0, (int)get_local_id(0) - 1);
-                    right_buffer[j][0] = shfl_buffer_local[shfl_prev_idx];
-                    barrier(CLK_LOCAL_MEM_FENCE);
 //#if CUDA_VERSION >= 9000
 //                    right_buffer[j][0] = __shfl_up_sync(shfl_mask, t, 1, SUBGROUP_SIZE);
 //#else
@@ -123,16 +144,29 @@ kernel void aggregate_horizontal_path_kernel(
                     }
                 }
                 else {
-                    shfl_buffer_local[get_local_id(0)] = right_buffer[j][0];
-                    //Maybe it is not necessary
-                    barrier(CLK_LOCAL_MEM_FENCE);
-                    for (unsigned int k = 1; k < DP_BLOCK_SIZE; ++k) {
-                        right_buffer[j][k - 1] = right_buffer[j][k];
+                    if (NATIVE_SUBGROUPS)
+                    {
+#if SUBGROUP_SHUFFLE
+                        const feature_type t = subgroup_shuffle_down(right_buffer[j][0]);
+                        for (unsigned int k = 1; k < DP_BLOCK_SIZE; ++k) {
+                            right_buffer[j][k - 1] = right_buffer[j][k];
+                        }
+                        right_buffer[j][DP_BLOCK_SIZE - 1] = t;
+#endif
+                    }
+                    else
+                    {
+                        shfl_buffer_local[get_local_id(0)] = right_buffer[j][0];
+                        //Maybe it is not necessary
+                        barrier(CLK_LOCAL_MEM_FENCE);
+                        for (unsigned int k = 1; k < DP_BLOCK_SIZE; ++k) {
+                            right_buffer[j][k - 1] = right_buffer[j][k];
+                        }
+                        //Maybe it is not necessary
+                        const int shfl_next_idx = min(BLOCK_SIZE - 1, (int)get_local_id(0) + 1);
+                        right_buffer[j][DP_BLOCK_SIZE - 1] = shfl_buffer_local[shfl_next_idx];
+                        barrier(CLK_LOCAL_MEM_FENCE);
                     }
-                    //Maybe it is not necessary
-                    const int shfl_next_idx = min(BLOCK_SIZE - 1, (int)get_local_id(0) + 1);
-                    right_buffer[j][DP_BLOCK_SIZE - 1] = shfl_buffer_local[shfl_next_idx];
-                    barrier(CLK_LOCAL_MEM_FENCE);
                     //#if CUDA_VERSION >= 9000
 //                    right_buffer[j][DP_BLOCK_SIZE - 1] =
 //                        __shfl_down_sync(shfl_mask, t, 1, SUBGROUP_SIZE);
@@ -155,9 +189,9 @@ kernel void aggregate_horizontal_path_kernel(
                     local_costs[k] = popcount(left_value ^ right_buffer[j][k]);
                 }
                 update(&dp[j],local_costs, p1, p2, shfl_mask, shfl_buffer);
-                store_uint8_vector_8u(
-                    &dest[j * dest_step + x * MAX_DISPARITY + dp_offset],
-                    dp[j].dp);
+                store_path_costs(
+                    &dest[j * dest_step + x * MAX_DISPARITY + dp_offset], DP_BLOCK_SIZE,
+                    dp[j].dp, accumulate);
             }
         }
         x0 += (int)(DP_BLOCK_SIZE) * DIRECTION;
@@ -5,7 +5,7 @@
 @X_DIRECTION@
 @Y_DIRECTION@
 @MAX_DISPARITY@
-#define WARP_SIZE 32
+@WARP_SIZE@
 
 #define PATHS_PER_WARP (WARP_SIZE / SUBGROUP_SIZE)
 #define PATHS_PER_BLOCK (BLOCK_SIZE / SUBGROUP_SIZE)
@@ -15,20 +15,27 @@
 #define feature_type uint32_t
 
 kernel void aggregate_oblique_path_kernel(
-    global uint8_t* dest,
+    global cost_type* dest,
     const global feature_type* left,
     const global feature_type* right,
     int width,
     int height,
     unsigned int p1,
     unsigned int p2,
-    int min_disp)
+    int min_disp,
+    int accumulate)
 {
     if (width == 0 || height == 0) 
     {
         return;
     }
 
+    // images of a batch are stored one after another, one per group row
+    const unsigned int batch = get_group_id(1);
+    left += batch * width * height;
+    right += batch * width * height;
+    dest += (size_t)batch * MAX_DISPARITY * width * height;
+
     local feature_type right_buffer[2 * DP_BLOCK_SIZE][RIGHT_BUFFER_ROWS];
     local feature_type shfl_buffer[BLOCK_SIZE];
     DynamicProgramming dp;
@@ -97,9 +104,9 @@ kernel void aggregate_oblique_path_kernel(
                 local_costs[j] = popcount(left_value ^ right_values[j]);
             }
             update(&dp, local_costs, p1, p2, shfl_mask, shfl_buffer);
-            store_uint8_vector(
+            store_path_costs(
                 &dest[dp_offset + x * MAX_DISPARITY + y * MAX_DISPARITY * width], DP_BLOCK_SIZE,
-                dp.dp);
+                dp.dp, accumulate);
         }
         barrier(CLK_LOCAL_MEM_FENCE);
     }
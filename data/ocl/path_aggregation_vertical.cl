@@ -4,7 +4,7 @@
 
 @DIRECTION@
 @MAX_DISPARITY@
-#define WARP_SIZE 32
+@WARP_SIZE@
 
 #define feature_type uint32_t
 
@@ -15,19 +15,26 @@
 
 
 kernel void aggregate_vertical_path_kernel(
-    global uint8_t* dest,
+    global cost_type* dest,
     global const feature_type* left,
     global const feature_type* right,
     int width,
     int height,
     unsigned int p1,
     unsigned int p2,
-    int min_disp)
+    int min_disp,
+    int accumulate)
 {
     if (width == 0 || height == 0) {
         return;
     }
 
+    // images of a batch are stored one after another, one per group row
+    const unsigned int batch = get_group_id(1);
+    left += batch * width * height;
+    right += batch * width * height;
+    dest += (size_t)batch * MAX_DISPARITY * width * height;
+
     local feature_type right_buffer[2 * DP_BLOCK_SIZE][RIGHT_BUFFER_ROWS + 1];
     //buffer for shuffle 
     local feature_type shfl_buffer[BLOCK_SIZE];
@@ -97,9 +104,9 @@ kernel void aggregate_vertical_path_kernel(
                 local_costs[j] = popcount(left_value ^ right_values[j]);
             }
             update(&dp, local_costs, p1, p2, shfl_mask, shfl_buffer);
-            store_uint8_vector(
+            store_path_costs(
                 &dest[dp_offset + x * MAX_DISPARITY + y * MAX_DISPARITY * width], DP_BLOCK_SIZE,
-                dp.dp);
+                dp.dp, accumulate);
         }
         //barrier(CLK_LOCAL_MEM_FENCE);
     }
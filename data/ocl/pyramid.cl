@@ -0,0 +1,86 @@
+//include inttypes
+#define INVALID_DISP ((uint16_t)(-1))
+@BAND_WIDTH@
+
+// factor x factor box filter, the last incomplete blocks are dropped
+kernel void downsample_kernel(
+    global uint8_t* dest,
+    global const uint8_t* src,
+    int width,
+    int height,
+    int src_pitch,
+    int factor)
+{
+    const int dest_width = width / factor;
+    const int dest_height = height / factor;
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= dest_width || y >= dest_height)
+        return;
+
+    const int batch = get_global_id(2);
+    src += batch * src_pitch * height;
+    dest += batch * dest_width * dest_height;
+
+    uint32_t sum = 0;
+    for (int dy = 0; dy < factor; ++dy)
+    {
+        global const uint8_t* row = src + (y * factor + dy) * src_pitch + x * factor;
+        for (int dx = 0; dx < factor; ++dx)
+        {
+            sum += row[dx];
+        }
+    }
+    const uint32_t n = factor * factor;
+    dest[y * dest_width + x] = (uint8_t)((sum + n / 2) / n);
+}
+
+// First disparity of the BAND_WIDTH wide band aggregated at every full resolution
+// pixel, centered on the upscaled coarse disparity (shifted right by shift to drop
+// subpixel bits). Invalid coarse pixels take the smallest valid disparity of their
+// 5x5 neighbourhood (the background side of an occlusion), the bottom of the range
+// if there is none.
+kernel void disparity_band_kernel(
+    global uint16_t* band,
+    global const uint16_t* coarse,
+    int width,
+    int height,
+    int coarse_width,
+    int coarse_height,
+    int factor,
+    int shift,
+    int coarse_base,
+    int max_offset)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    const int batch = get_global_id(2);
+    band += batch * width * height;
+    coarse += batch * coarse_width * coarse_height;
+
+    const int cx = min(x / factor, coarse_width - 1);
+    const int cy = min(y / factor, coarse_height - 1);
+    uint32_t d = coarse[cy * coarse_width + cx];
+    if (d == INVALID_DISP)
+    {
+        for (int dy = -2; dy <= 2; ++dy)
+        {
+            for (int dx = -2; dx <= 2; ++dx)
+            {
+                const int nx = clamp(cx + dx, 0, coarse_width - 1);
+                const int ny = clamp(cy + dy, 0, coarse_height - 1);
+                d = min(d, (uint32_t)coarse[ny * coarse_width + nx]);
+            }
+        }
+    }
+
+    int offset = 0;
+    if (d != INVALID_DISP)
+    {
+        offset = clamp((int)(d >> shift) * factor + coarse_base - BAND_WIDTH / 2, 0, max_offset);
+    }
+    band[y * width + x] = (uint16_t)offset;
+}
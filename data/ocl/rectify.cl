@@ -0,0 +1,45 @@
+//include inttypes
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+
+inline uint32_t fetch(global const uint8_t* src, int x, int y, int width, int height, int pitch)
+{
+    // constant border like cv::remap
+    return (0 <= x && x < width && 0 <= y && y < height) ? src[y * pitch + x] : 0;
+}
+
+// Bilinear remap with the fixed point maps of cv::convertMaps (CV_16SC2 + CV_16UC1):
+// the integer source coordinate and the fraction index fy * INTER_TAB_SIZE + fx.
+kernel void remap_kernel(
+    global uint8_t* dest,
+    global const uint8_t* src,
+    global const short2* coords,
+    global const uint16_t* fractions,
+    int width,
+    int height,
+    int pitch)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    // every image of a batch comes from the same camera
+    const int batch = get_global_id(2);
+    src += batch * pitch * height;
+    dest += batch * pitch * height;
+
+    const short2 c = coords[y * width + x];
+    const uint32_t f = fractions[y * width + x];
+    const uint32_t fx = f & (INTER_TAB_SIZE - 1);
+    const uint32_t fy = f >> INTER_BITS;
+
+    const uint32_t p00 = fetch(src, c.x, c.y, width, height, pitch);
+    const uint32_t p01 = fetch(src, c.x + 1, c.y, width, height, pitch);
+    const uint32_t p10 = fetch(src, c.x, c.y + 1, width, height, pitch);
+    const uint32_t p11 = fetch(src, c.x + 1, c.y + 1, width, height, pitch);
+    const uint32_t top = p00 * (INTER_TAB_SIZE - fx) + p01 * fx;
+    const uint32_t bottom = p10 * (INTER_TAB_SIZE - fx) + p11 * fx;
+    const uint32_t value = (top * (INTER_TAB_SIZE - fy) + bottom * fy + (1u << (2 * INTER_BITS - 1))) >> (2 * INTER_BITS);
+    dest[y * pitch + x] = (uint8_t)value;
+}
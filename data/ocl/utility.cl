@@ -49,6 +49,37 @@ void store_uint8_vector(global uint8_t* dest, const int N,
 }
 
 
+void accumulate_uint16_vector(global uint16_t* dest, const int N,
+    const uint32_t* ptr, int accumulate)
+{
+    // path costs are truncated to 8 bit exactly like store_uint8_vector does
+    if (N == 16)
+    {
+        ushort16 vv = accumulate ? *((global ushort16*)dest) : (ushort16)(0);
+        ushort* v = (ushort*)&vv;
+#pragma unroll
+        for (int i = 0; i < 16; ++i)
+            v[i] += (uint8_t)ptr[i];
+        *((global ushort16*)dest) = vv;
+    }
+    else if (N == 8)
+    {
+        ushort8 vv = accumulate ? *((global ushort8*)dest) : (ushort8)(0);
+        ushort* v = (ushort*)&vv;
+#pragma unroll
+        for (int i = 0; i < 8; ++i)
+            v[i] += (uint8_t)ptr[i];
+        *((global ushort8*)dest) = vv;
+    }
+    else
+    {
+#pragma unroll
+        for (int i = 0; i < N; ++i)
+            dest[i] = (accumulate ? dest[i] : 0) + (uint8_t)ptr[i];
+    }
+}
+
+
 inline void load_uint8_vector(uint32_t* dest, const int num, const local uint8_t* ptr) 
 {
 #pragma unroll
@@ -85,6 +116,25 @@ inline void g_load_uint8_vector(uint32_t* dest, const int num, const global uint
 }
 
 
+inline void g_load_uint16_vector(uint32_t* dest, const int num, const global uint16_t* ptr)
+{
+    if (num == 16)
+    {
+        ushort16 vv = *((global ushort16*)ptr);
+        ushort* v = (ushort*)&vv;
+#pragma unroll
+        for (int i = 0; i < 16; ++i)
+            dest[i] = (uint32_t)v[i];
+    }
+    else
+    {
+#pragma unroll
+        for (int i = 0; i < num; ++i)
+            dest[i] = (uint32_t)(ptr[i]);
+    }
+}
+
+
 inline void lload_uint8_vector(uint32_t* dest, const int num,  const uint8_t* ptr)
 {
     for (int i = 0; i < num; ++i)
@@ -6,15 +6,22 @@
 @WARPS_PER_BLOCK@
 @BLOCK_SIZE@
 @SUBPIXEL_SHIFT@
+@FUSED_AGGREGATION@
 
 
-#define WARP_SIZE 32
+@WARP_SIZE@
 #define ACCUMULATION_PER_THREAD 16u
 #define REDUCTION_PER_THREAD (MAX_DISPARITY / WARP_SIZE)
 #define ACCUMULATION_INTERVAL (ACCUMULATION_PER_THREAD / REDUCTION_PER_THREAD)
 #define UNROLL_DEPTH ((REDUCTION_PER_THREAD > ACCUMULATION_INTERVAL) ? REDUCTION_PER_THREAD : ACCUMULATION_INTERVAL)
 #define INVALID_DISP (uint16_t)(-1)
 
+#if FUSED_AGGREGATION
+#define cost_type uint16_t
+#else
+#define cost_type uint8_t
+#endif
+
 inline uint32_t pack_cost_index(uint32_t cost, uint32_t index)
 {
     union {
@@ -59,17 +66,23 @@ inline uint32_t compute_disparity_subpixel(uint32_t disp, uint32_t cost, const l
 kernel void winner_takes_all_kernel(
     global uint16_t * left_dest,
     global uint16_t * right_dest,
-    const global uint8_t * src,
+    const global cost_type * src,
     int width,
     int height,
     int pitch,
     float uniqueness)
 {
 
-    const unsigned int cost_step = MAX_DISPARITY * width * height;
+    // the per path volumes hold the whole batch, see PathAggregation
+    const size_t cost_step = (size_t)MAX_DISPARITY * width * height * get_num_groups(1);
     const unsigned int warp_id = get_local_id(0) / WARP_SIZE;
     const unsigned int lane_id = get_local_id(0) % WARP_SIZE;
 
+    const unsigned int batch = get_group_id(1);
+    src += (size_t)batch * MAX_DISPARITY * width * height;
+    left_dest += batch * pitch * height;
+    right_dest += batch * pitch * height;
+
     const unsigned int y = get_group_id(0) * WARPS_PER_BLOCK + warp_id;
     src += y * MAX_DISPARITY * width;
     left_dest += y * pitch;
@@ -105,6 +118,10 @@ kernel void winner_takes_all_kernel(
                 {
                     const unsigned int offset = x * MAX_DISPARITY + k_lo;
                     uint32_t sum[ACCUMULATION_PER_THREAD];
+#if FUSED_AGGREGATION
+                    // paths were already summed during aggregation
+                    g_load_uint16_vector(sum, ACCUMULATION_PER_THREAD, &src[offset]);
+#else
                     for (unsigned int i = 0; i < ACCUMULATION_PER_THREAD; ++i)
                     {
                         sum[i] = 0;
@@ -118,6 +135,7 @@ kernel void winner_takes_all_kernel(
                             sum[i] += load_buffer[i];
                         }
                     }
+#endif
                     store_uint16_vector(&smem_cost_sum[warp_id][k_hi][k_lo], ACCUMULATION_PER_THREAD, sum);
                 }
 //#if CUDA_VERSION >= 9000
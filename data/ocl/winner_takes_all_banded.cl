@@ -0,0 +1,122 @@
+//include inttypes
+@BAND_WIDTH@
+@NUM_PATHS@
+@COMPUTE_SUBPIXEL@
+@SUBPIXEL_SHIFT@
+@FUSED_AGGREGATION@
+
+#define INVALID_DISP ((uint16_t)(-1))
+
+#if FUSED_AGGREGATION
+#define cost_type uint16_t
+#else
+#define cost_type uint8_t
+#endif
+
+// Winner takes all over the band of every pixel. The disparity is written relative
+// to min_disp like the one of winner_takes_all_kernel. The right disparity is the
+// best of the left winners falling on a right pixel, collected with atomic_min on
+// (cost << 16 | disparity) and written by finish_right_disparity_kernel.
+kernel void winner_takes_all_banded_kernel(
+    global uint16_t* left_dest,
+    global uint32_t* right_best,
+    const global cost_type* src,
+    const global uint16_t* band,
+    int width,
+    int height,
+    int pitch,
+    float uniqueness)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    const int batch = get_global_id(2);
+    const size_t pixels = (size_t)width * height;
+    const size_t cost_step = BAND_WIDTH * pixels * get_global_size(2);
+    src += (batch * pixels + y * width + x) * BAND_WIDTH;
+    band += batch * pixels;
+    left_dest += batch * pitch * height;
+    right_best += batch * pitch * height;
+
+    uint32_t sum[BAND_WIDTH];
+    for (int k = 0; k < BAND_WIDTH; ++k)
+    {
+        sum[k] = 0;
+    }
+#if FUSED_AGGREGATION
+    const int num_volumes = 1;
+#else
+    const int num_volumes = NUM_PATHS;
+#endif
+    for (int p = 0; p < num_volumes; ++p)
+    {
+        for (int k = 0; k < BAND_WIDTH; ++k)
+        {
+            sum[k] += src[p * cost_step + k];
+        }
+    }
+
+    uint32_t best_cost = sum[0];
+    int best = 0;
+    for (int k = 1; k < BAND_WIDTH; ++k)
+    {
+        if (sum[k] < best_cost)
+        {
+            best_cost = sum[k];
+            best = k;
+        }
+    }
+    bool uniq = true;
+    for (int k = 0; k < BAND_WIDTH; ++k)
+    {
+        uniq &= sum[k] * uniqueness >= best_cost || abs(k - best) <= 1;
+    }
+    if (!uniq)
+    {
+        left_dest[y * pitch + x] = INVALID_DISP;
+        return;
+    }
+
+    const int disp = band[y * width + x] + best;
+    int result = disp;
+#if COMPUTE_SUBPIXEL
+    result <<= SUBPIXEL_SHIFT;
+    if (best > 0 && best < BAND_WIDTH - 1)
+    {
+        const int left = sum[best - 1];
+        const int right = sum[best + 1];
+        const int numer = left - right;
+        const int denom = left - 2 * (int)best_cost + right;
+        result += ((numer << SUBPIXEL_SHIFT) + denom) / (2 * denom);
+    }
+#endif
+    left_dest[y * pitch + x] = (uint16_t)result;
+
+    const int xr = x - disp;
+    if (xr >= 0)
+    {
+        atomic_min(&right_best[y * pitch + xr], (best_cost << 16) | (uint32_t)disp);
+    }
+}
+
+// Unpacks the right disparities and resets the buffer for the next frame.
+kernel void finish_right_disparity_kernel(
+    global uint16_t* right_dest,
+    global uint32_t* right_best,
+    int width,
+    int height,
+    int pitch)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    const int batch = get_global_id(2);
+    const int idx = (batch * height + y) * pitch + x;
+    const uint32_t packed = right_best[idx];
+    right_dest[idx] = packed == 0xffffffffu ? INVALID_DISP : (uint16_t)(packed & 0xffffu);
+    right_best[idx] = 0xffffffffu;
+}
@@ -0,0 +1,278 @@
+#include "headless_pipeline.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+#include "src/libsgm_ocl.h"
+
+namespace
+{
+    cl_mem create_buffer(cl_context ctx, cl_mem_flags flags, size_t size)
+    {
+        cl_int err;
+        cl_mem mem = clCreateBuffer(ctx, flags, size, nullptr, &err);
+        CHECK_OCL_ERROR(err, "Failed to create a headless pipeline buffer");
+        if (err != CL_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create a headless pipeline buffer");
+        }
+        return mem;
+    }
+
+    cl_command_queue create_queue(cl_context ctx, cl_device_id device, const char *what)
+    {
+        cl_int err;
+        cl_command_queue queue = clCreateCommandQueue(ctx, device, 0, &err);
+        CHECK_OCL_ERROR(err, what);
+        if (err != CL_SUCCESS)
+        {
+            throw std::runtime_error(what);
+        }
+        return queue;
+    }
+} // namespace
+
+HeadlessPipeline::HeadlessPipeline(sgmcl::StereoSGM &sgm,
+                                   StereoCapture &capture,
+                                   cl_context ctx,
+                                   cl_device_id device,
+                                   int width,
+                                   int height,
+                                   const HeadlessOptions &options)
+    : m_sgm(sgm),
+      m_capture(capture),
+      m_width(width),
+      m_height(height),
+      m_options(options),
+      m_slots(std::max(options.depth, 1)),
+      m_free(m_slots.size()),
+      m_in_flight(m_slots.size())
+{
+    if (options.depth < 1)
+    {
+        throw std::logic_error("the headless pipeline needs at least one frame slot");
+    }
+
+    m_upload_queue = create_queue(ctx, device, "Failed to create the upload queue");
+    m_readback_queue = create_queue(ctx, device, "Failed to create the readback queue");
+
+    const size_t image_size = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        Slot &slot = m_slots[i];
+        slot.left = create_buffer(ctx, CL_MEM_READ_ONLY, options.raw ? 2 * image_size : image_size);
+        if (!options.raw)
+        {
+            slot.right = create_buffer(ctx, CL_MEM_READ_ONLY, image_size);
+        }
+        slot.disparity = create_buffer(ctx, CL_MEM_READ_WRITE, image_size * sizeof(uint16_t));
+        slot.host_disparity.resize(image_size);
+        m_free.push(static_cast<int>(i));
+    }
+}
+
+HeadlessPipeline::~HeadlessPipeline()
+{
+    m_stop = true;
+    m_free.close();
+    m_in_flight.close();
+    if (m_submit_thread.joinable())
+    {
+        m_submit_thread.join();
+    }
+    if (m_readback_thread.joinable())
+    {
+        m_readback_thread.join();
+    }
+
+    for (Slot &slot : m_slots)
+    {
+        if (slot.readback)
+        {
+            clWaitForEvents(1, &slot.readback);
+            clReleaseEvent(slot.readback);
+        }
+        for (cl_mem mem : {slot.left, slot.right, slot.disparity})
+        {
+            if (mem)
+            {
+                clReleaseMemObject(mem);
+            }
+        }
+    }
+    for (cl_command_queue queue : {m_upload_queue, m_readback_queue})
+    {
+        if (queue)
+        {
+            clReleaseCommandQueue(queue);
+        }
+    }
+}
+
+void HeadlessPipeline::run(const bool &streaming)
+{
+    m_submit_thread = std::thread(&HeadlessPipeline::submit_loop, this);
+    m_readback_thread = std::thread(&HeadlessPipeline::readback_loop, this);
+
+    Clock::time_point last_report = Clock::now();
+    while (streaming && !m_done)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const double seconds = std::chrono::duration<double>(Clock::now() - last_report).count();
+        if (seconds >= m_options.report_interval)
+        {
+            report(seconds);
+            last_report = Clock::now();
+        }
+    }
+
+    // the frames already submitted are still read back
+    m_stop = true;
+    m_submit_thread.join();
+    m_readback_thread.join();
+    report(std::chrono::duration<double>(Clock::now() - last_report).count());
+}
+
+void HeadlessPipeline::submit_loop()
+{
+    const size_t image_size = static_cast<size_t>(m_width) * m_height;
+    while (!m_stop)
+    {
+        // short waits, m_stop is checked in between
+        const StereoCameraData *frame = m_capture.acquire(100);
+        if (frame == nullptr)
+        {
+            if (m_capture.finished())
+            {
+                break;
+            }
+            continue;
+        }
+        const Clock::time_point acquired = Clock::now();
+
+        // waits while every slot is in flight, the capture policy decides about the frames meanwhile
+        int index = 0;
+        if (!m_free.pop(index))
+        {
+            break;
+        }
+        Slot &slot = m_slots[index];
+        slot.timestamp_ms = frame->timestamp_ms;
+        slot.acquired = acquired;
+
+        // the matching waits for the uploads on the device, the readback for the matching,
+        // so the submit thread only blocks until the frame has left the capture slot
+        cl_int err;
+        cl_event uploads[2] = {nullptr, nullptr};
+        cl_uint num_uploads = 0;
+        cl_event done = nullptr;
+        // frames of a non continuous view are copied, the copies live until the upload completed
+        cv::Mat left, right;
+        if (m_options.raw)
+        {
+            err = clEnqueueWriteBuffer(m_upload_queue, slot.left, CL_FALSE, 0, 2 * image_size, frame->raw.data,
+                                       0, nullptr, &uploads[num_uploads]);
+            CHECK_OCL_ERROR(err, "Failed to upload the interleaved frame");
+            num_uploads += err == CL_SUCCESS ? 1 : 0;
+            clFlush(m_upload_queue);
+            done = m_sgm.execute_interleaved_async(slot.left, slot.disparity, num_uploads, uploads);
+        }
+        else
+        {
+            left = frame->frame_0.isContinuous() ? frame->frame_0 : frame->frame_0.clone();
+            right = frame->frame_1.isContinuous() ? frame->frame_1 : frame->frame_1.clone();
+            err = clEnqueueWriteBuffer(m_upload_queue, slot.left, CL_FALSE, 0, image_size, left.data,
+                                       0, nullptr, &uploads[num_uploads]);
+            CHECK_OCL_ERROR(err, "Failed to upload the left image");
+            num_uploads += err == CL_SUCCESS ? 1 : 0;
+            err = clEnqueueWriteBuffer(m_upload_queue, slot.right, CL_FALSE, 0, image_size, right.data,
+                                       0, nullptr, &uploads[num_uploads]);
+            CHECK_OCL_ERROR(err, "Failed to upload the right image");
+            num_uploads += err == CL_SUCCESS ? 1 : 0;
+            clFlush(m_upload_queue);
+            done = m_sgm.execute_async(slot.left, slot.right, slot.disparity, num_uploads, uploads);
+        }
+
+        err = clEnqueueReadBuffer(m_readback_queue, slot.disparity, CL_FALSE, 0, image_size * sizeof(uint16_t),
+                                  slot.host_disparity.data(), done ? 1 : 0, done ? &done : nullptr, &slot.readback);
+        CHECK_OCL_ERROR(err, "Failed to read back the disparity");
+        if (done)
+        {
+            clReleaseEvent(done);
+        }
+        clFlush(m_readback_queue);
+
+        // the capture slot is read by the uploads until they complete
+        if (num_uploads > 0)
+        {
+            err = clWaitForEvents(num_uploads, uploads);
+            CHECK_OCL_ERROR(err, "Failed to wait for the upload");
+        }
+        for (cl_uint i = 0; i < num_uploads; ++i)
+        {
+            clReleaseEvent(uploads[i]);
+        }
+        m_capture.release();
+
+        if (!m_in_flight.push(index))
+        {
+            break;
+        }
+    }
+    m_in_flight.close();
+}
+
+void HeadlessPipeline::readback_loop()
+{
+    int index = 0;
+    while (m_in_flight.pop(index))
+    {
+        Slot &slot = m_slots[index];
+        // a failed readback leaves no event, the frame is skipped
+        if (slot.readback)
+        {
+            clWaitForEvents(1, &slot.readback);
+            clReleaseEvent(slot.readback);
+            slot.readback = nullptr;
+
+            if (m_sink)
+            {
+                m_sink(slot.host_disparity.data(), slot.timestamp_ms);
+            }
+
+            const double latency = std::chrono::duration<double, std::milli>(Clock::now() - slot.acquired).count();
+            {
+                std::lock_guard<std::mutex> lock(m_stats_mutex);
+                m_latencies.push_back(latency);
+            }
+            ++m_processed;
+        }
+        m_free.push(index);
+    }
+    m_done = true;
+}
+
+void HeadlessPipeline::report(double seconds)
+{
+    std::vector<double> latencies;
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        latencies.swap(m_latencies);
+    }
+    if (latencies.empty() || seconds <= 0.0)
+    {
+        std::cout << "0 fps, " << m_capture.droppedFrames() << " frames dropped in total" << std::endl;
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const size_t n = latencies.size();
+    const double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+    std::cout << n / seconds << " fps, latency " << mean << " ms mean, "
+              << latencies[n / 2] << " ms median, "
+              << latencies[std::min(n - 1, n * 99 / 100)] << " ms p99, "
+              << latencies.back() << " ms max, "
+              << m_capture.droppedFrames() << " frames dropped in total" << std::endl;
+}
@@ -0,0 +1,169 @@
+#ifndef HEADLESS_PIPELINE_H_
+#define HEADLESS_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "stereo_capture.hpp"
+
+namespace sgmcl
+{
+    class StereoSGM;
+}
+
+/**
+    Fixed capacity queue between two pipeline stages. push blocks while it is full,
+    so a slow stage holds back the one before it instead of piling up frames.
+    */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity) {}
+
+    // false if the queue was closed meanwhile
+    bool push(const T &value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+        {
+            return false;
+        }
+        m_items.push_back(value);
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    // false once the queue is closed and empty
+    bool pop(T &value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+        {
+            return false;
+        }
+        value = m_items.front();
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    // wakes both sides, the items left can still be popped
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed = false;
+};
+
+struct HeadlessOptions
+{
+    // upload StereoCameraData::raw and use execute_interleaved_async
+    bool raw = false;
+    // frames between upload and readback, at most Parameters::pipeline_depth overlap on the device
+    int depth = 2;
+    // seconds between two summaries
+    double report_interval = 1.0;
+};
+
+/**
+    Runs the matching without windows in three stages on their own threads:
+    capture (the thread of StereoCapture), submit (upload and StereoSGM::execute_async)
+    and readback (wait for the disparity, hand it to the sink and account the latency).
+    The stages are connected by bounded queues of depth frame slots. Uploads and readbacks
+    go to command queues of their own and the matching waits on the upload events, so on
+    the device the upload of a frame overlaps the matching of the previous one.
+    */
+class HeadlessPipeline
+{
+public:
+    // disparity of a frame on the readback thread, width x height values, valid during the call
+    using Sink = std::function<void(const uint16_t *disparity, uint64_t timestamp_ms)>;
+
+    HeadlessPipeline(sgmcl::StereoSGM &sgm,
+                     StereoCapture &capture,
+                     cl_context ctx,
+                     cl_device_id device,
+                     int width,
+                     int height,
+                     const HeadlessOptions &options);
+    ~HeadlessPipeline();
+
+    void set_sink(const Sink &sink) { m_sink = sink; }
+
+    /**
+        * Processes frames until streaming turns false or the source has finished and every
+        * frame was read back. Prints the throughput and the latency from taking a frame off
+        * the capture ring to its disparity on the host every report interval.
+        */
+    void run(const bool &streaming);
+
+    uint64_t processed_frames() const { return m_processed; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Slot
+    {
+        cl_mem left = nullptr; // or the interleaved frame
+        cl_mem right = nullptr;
+        cl_mem disparity = nullptr;
+        cl_event readback = nullptr;
+        std::vector<uint16_t> host_disparity;
+        uint64_t timestamp_ms = 0;
+        Clock::time_point acquired;
+    };
+
+    HeadlessPipeline(const HeadlessPipeline &) = delete;
+    HeadlessPipeline &operator=(const HeadlessPipeline &) = delete;
+
+    void submit_loop();
+    void readback_loop();
+    void report(double seconds);
+
+    sgmcl::StereoSGM &m_sgm;
+    StereoCapture &m_capture;
+    cl_command_queue m_upload_queue = nullptr;
+    cl_command_queue m_readback_queue = nullptr;
+    int m_width;
+    int m_height;
+    HeadlessOptions m_options;
+    Sink m_sink;
+
+    std::vector<Slot> m_slots;
+    BoundedQueue<int> m_free;
+    BoundedQueue<int> m_in_flight;
+
+    std::thread m_submit_thread;
+    std::thread m_readback_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_done{false};
+
+    // latencies of the current report interval, in ms
+    std::mutex m_stats_mutex;
+    std::vector<double> m_latencies;
+    std::atomic<uint64_t> m_processed{0};
+};
+
+#endif // HEADLESS_PIPELINE_H_
@@ -35,6 +35,10 @@ limitations under the License.
 
 #include "src/libsgm_ocl.h"
 #include "stereo_camera.hpp"
+#include "stereo_capture.hpp"
+#include "sequence_reader.hpp"
+#include "stereo_recording.hpp"
+#include "headless_pipeline.h"
 
 static bool is_streaming = true;
 static void sig_handler(int sig)
@@ -50,7 +54,24 @@ static cv::CommandLineParser getConfig(int argc, char **argv)
                          "{ height         | 720                | (int) Image height }"
                          "{ max_disparity  | 256                | (int) Maximum disparity }"
                          "{ subpixel       | true               | Compute subpixel accuracy }"
-                         "{ num_path       | 8                  | (int) Num path to optimize, 4 or 8 }";
+                         "{ num_path       | 8                  | (int) Num path to optimize, 4 or 8 }"
+                         "{ profile        | false              | Print the kernel times of every stage }"
+                         "{ tuning_profile | sgm_tuning.txt     | Launch geometry of the kernels written by --autotune }"
+                         "{ autotune       | false              | Tune the kernels for this device into tuning_profile and exit }"
+                         "{ hierarchical   | false              | Coarse to fine matching, 64 disparities per pixel at full resolution }"
+                         "{ temporal       | false              | Search around the previous frame's disparity }"
+                         "{ raw            | false              | Upload the interleaved camera frame, split and convert it on the device }"
+                         "{ capture_policy |                    | Frames waiting for the matching: latest (camera default), drop_oldest or block (recording default) }"
+                         "{ capture_slots  | 3                  | (int) Frames in the capture ring }"
+                         "{ buffers        | 4                  | (int) V4L2 capture buffers, fewer for latency, more against jitter }"
+                         "{ late_ms        | 0                  | (int) Count frames older than this when dequeued as late, 0 off }"
+                         "{ headless       | false              | No windows, upload, matching and readback on their own threads, prints throughput and latency }"
+                         "{ pipeline_depth | 2                  | (int) Frames in flight on the device with --headless, 1 with --temporal }"
+                         "{ report_s       | 1.0                | (double) Seconds between the --headless summaries }"
+                         "{ record         |                    | Append the raw camera frames to this recording file }"
+                         "{ record_frames  | 1800               | (int) Frames preallocated for --record }"
+                         "{ @left          |                    | Raw recording, recorded left images (image_0/%06d.png), video or KITTI sequence directory instead of the camera }"
+                         "{ @right         |                    | Recorded right images or video, empty for a sequence directory or a side by side video }";
 
     cv::CommandLineParser config(argc, argv, params);
     if (config.get<bool>("help"))
@@ -79,44 +100,104 @@ int main(int argc, char *argv[])
     camConfig.fps = config.get<int>("fps");
     camConfig.width = config.get<int>("width");
     camConfig.height = config.get<int>("height");
+    camConfig.buffer_count = config.get<int>("buffers");
+    camConfig.late_threshold_us = config.get<int>("late_ms") * 1000;
+    // short waits, the capture thread checks for shutdown in between
+    camConfig.frame_timeout_us = 100000;
+
+    // live camera or a recording replayed through the same pipeline
+    const std::string left_source = config.get<std::string>("@left");
+    const std::string right_source = config.get<std::string>("@right");
+    StereoCamera::Ptr camera;
+    StereoRecordingReader::Ptr recording;
+    StereoSource::Ptr source;
+    if (left_source.empty())
+    {
+        camera = std::make_shared<StereoCamera>(camConfig);
+        if (!camera->checkCameraStarted())
+        {
+            std::cout << "Camera open fail..." << std::endl;
+            return 0;
+        }
+        source = camera;
+    }
+    else if (right_source.empty() && StereoRecordingReader::probe(left_source))
+    {
+        // raw frames of the camera, replayed without decoding
+        recording = std::make_shared<StereoRecordingReader>(left_source);
+        if (!recording->isOpened())
+        {
+            std::cout << "Recording open fail..." << std::endl;
+            return 0;
+        }
+        std::cout << "Replaying " << recording->frameCount() << " recorded frames" << std::endl;
+        source = recording;
+    }
+    else
+    {
+        source = std::make_shared<StereoSequenceReader>(left_source, right_source);
+        if (!source->isOpened())
+        {
+            std::cout << "Sequence open fail..." << std::endl;
+            return 0;
+        }
+    }
+    const int width = source->width();
+    const int height = source->height();
 
-    StereoCamera::Ptr camera = std::make_shared<StereoCamera>(camConfig);
-    if (!camera->checkCameraStarted())
+    StereoRecorder::Ptr recorder;
+    const std::string record_path = config.get<std::string>("record");
+    if (!record_path.empty())
     {
-        std::cout << "Camera open fail..." << std::endl;
-        return 0;
+        if (!camera)
+        {
+            std::cout << "--record needs the camera" << std::endl;
+            return 0;
+        }
+        try
+        {
+            recorder = std::make_shared<StereoRecorder>(record_path, width, height, config.get<int>("record_frames"));
+        }
+        catch (const Withrobot::WithRobotException &e)
+        {
+            std::cout << e.what() << std::endl;
+            return 0;
+        }
+        camera->setRecorder(recorder);
     }
 
     // Stereo Camera
-    cv::Mat frame_0, frame_1, frame_0_rect, frame_1_rect;
+    cv::Mat frame_0, frame_1;
     cv::Mat disp16, disp32;
-    StereoCameraData camDataCamera;
-
-    cv::FileStorage fs("data/ocams_calibration_720p.xml", cv::FileStorage::READ);
+    cv::Mat map11, map12, map21, map22;
 
-    cv::Mat D_L, K_L, D_R, K_R;
-    cv::Mat Rect_L, Proj_L, Rect_R, Proj_R, Q;
-    cv::Mat baseline;
-    cv::Mat Rotation, Translation;
+    // image recordings such as KITTI are rectified already, raw recordings are not
+    if (camera || recording)
+    {
+        cv::FileStorage fs("data/ocams_calibration_720p.xml", cv::FileStorage::READ);
 
-    fs["D_L"] >> D_L;
-    fs["K_L"] >> K_L;
-    fs["D_R"] >> D_R;
-    fs["K_R"] >> K_R;
-    fs["baseline"] >> baseline;
-    fs["Rotation"] >> Rotation;
-    fs["Translation"] >> Translation;
+        cv::Mat D_L, K_L, D_R, K_R;
+        cv::Mat Rect_L, Proj_L, Rect_R, Proj_R, Q;
+        cv::Mat baseline;
+        cv::Mat Rotation, Translation;
 
-    // Code to calculate Rotation matrix and Projection matrix for each camera
-    cv::Vec3d Translation_2((double *)Translation.data);
+        fs["D_L"] >> D_L;
+        fs["K_L"] >> K_L;
+        fs["D_R"] >> D_R;
+        fs["K_R"] >> K_R;
+        fs["baseline"] >> baseline;
+        fs["Rotation"] >> Rotation;
+        fs["Translation"] >> Translation;
 
-    cv::stereoRectify(K_L, D_L, K_R, D_R, cv::Size(camConfig.width, camConfig.height), Rotation, Translation_2,
-                      Rect_L, Rect_R, Proj_L, Proj_R, Q, cv::CALIB_ZERO_DISPARITY);
+        // Code to calculate Rotation matrix and Projection matrix for each camera
+        cv::Vec3d Translation_2((double *)Translation.data);
 
-    cv::Mat map11, map12, map21, map22;
+        cv::stereoRectify(K_L, D_L, K_R, D_R, cv::Size(width, height), Rotation, Translation_2,
+                          Rect_L, Rect_R, Proj_L, Proj_R, Q, cv::CALIB_ZERO_DISPARITY);
 
-    cv::initUndistortRectifyMap(K_L, D_L, Rect_L, Proj_L, cv::Size(camConfig.width, camConfig.height), CV_32FC1, map11, map12);
-    cv::initUndistortRectifyMap(K_R, D_R, Rect_R, Proj_R, cv::Size(camConfig.width, camConfig.height), CV_32FC1, map21, map22);
+        cv::initUndistortRectifyMap(K_L, D_L, Rect_L, Proj_L, cv::Size(width, height), CV_32FC1, map11, map12);
+        cv::initUndistortRectifyMap(K_R, D_R, Rect_R, Proj_R, cv::Size(width, height), CV_32FC1, map21, map22);
+    }
 
     cl_context cl_ctx;
     cl_device_id cl_device;
@@ -124,7 +205,6 @@ int main(int argc, char *argv[])
     int device_idx = 0;
     std::tie(cl_ctx, cl_device) = initCLCTX(platform_idx, device_idx);
     std::cout << "cl device : " << cl_device << std::endl;
-    cl_command_queue cl_queue = clCreateCommandQueue(cl_ctx, cl_device, 0, nullptr);
 
     sgmcl::Parameters params;
     int disp_size = 256;
@@ -133,76 +213,166 @@ int main(int argc, char *argv[])
 
     params.path_type = num_paths == 8 ? sgmcl::PathType::SCAN_8PATH : sgmcl::PathType::SCAN_4PATH;
     params.uniqueness = 0.95f;
+    params.enable_profiling = config.get<bool>("profile");
+    params.tuning_profile = config.get<std::string>("tuning_profile");
+    params.hierarchical = config.get<bool>("hierarchical");
+    params.temporal_prior = config.get<bool>("temporal");
+    const bool headless = config.get<bool>("headless");
+    // the windowed loop matches one frame at a time, so does the temporal prior which
+    // needs the previous disparity before the next frame starts
+    params.pipeline_depth = headless && !params.temporal_prior ? config.get<int>("pipeline_depth") : 1;
+
+    if (config.get<bool>("autotune"))
+    {
+        sgmcl::autotune(width, height, disp_size, cl_ctx, cl_device, params, params.tuning_profile);
+        std::cout << "Tuning profile written to " << params.tuning_profile << std::endl;
+        clReleaseDevice(cl_device);
+        clReleaseContext(cl_ctx);
+        return 0;
+    }
 
-    sgmcl::StereoSGM ssgm(camConfig.width,
-                          camConfig.height,
+    sgmcl::StereoSGM ssgm(width,
+                          height,
                           disp_size,
                           cl_ctx,
                           cl_device,
                           params);
-
     bool should_close = false;
+    const bool raw_input = config.get<bool>("raw");
+    if (raw_input && !camera && !recording)
+    {
+        std::cout << "--raw needs the camera or a raw recording" << std::endl;
+        return 0;
+    }
 
-    cv::Mat disp(camConfig.height, camConfig.width, CV_16UC1);
-    cv::Mat disp_color, disp_8u;
-    cl_mem d_left, d_right, d_disp;
-    d_left = clCreateBuffer(cl_ctx, CL_MEM_READ_WRITE, camConfig.width * camConfig.height, nullptr, nullptr);
-    d_right = clCreateBuffer(cl_ctx, CL_MEM_READ_WRITE, camConfig.width * camConfig.height, nullptr, nullptr);
-    d_disp = clCreateBuffer(cl_ctx, CL_MEM_READ_WRITE, camConfig.width * camConfig.height * 2, nullptr, nullptr);
+    // the raw frames are rectified on the device
+    if (camera || recording)
+    {
+        ssgm.set_rectification_maps(map11.ptr<float>(), map12.ptr<float>(), map21.ptr<float>(), map22.ptr<float>());
+    }
+    // build the kernels now instead of on the first camera frame, after the maps so the
+    // dummy frames build the remap kernel too, and the demosaic kernel with --raw
+    ssgm.prepare(raw_input);
+
+    // capture runs on its own thread, the loop below always gets a frame the policy allows
+    // a recording is replayed completely unless asked otherwise
+    const std::string policy_name = config.get<std::string>("capture_policy");
+    CapturePolicy policy = camera ? CapturePolicy::LATEST_ONLY : CapturePolicy::BLOCK;
+    if (policy_name == "latest")
+        policy = CapturePolicy::LATEST_ONLY;
+    else if (policy_name == "drop_oldest")
+        policy = CapturePolicy::DROP_OLDEST;
+    else if (policy_name == "block")
+        policy = CapturePolicy::BLOCK;
+    StereoCapture capture(source, config.get<int>("capture_slots"), policy, raw_input);
+    if (!capture.start())
+    {
+        std::cout << "Capture thread start fail..." << std::endl;
+        return 0;
+    }
 
-    while (is_streaming)
+    if (headless)
+    {
+        // no windows, the stages overlap on separate threads
+        HeadlessOptions options;
+        options.raw = raw_input;
+        options.depth = params.pipeline_depth;
+        options.report_interval = config.get<double>("report_s");
+        HeadlessPipeline pipeline(ssgm, capture, cl_ctx, cl_device, width, height, options);
+        pipeline.run(is_streaming);
+        std::cout << pipeline.processed_frames() << " frames matched" << std::endl;
+    }
+    else
     {
-        auto start = std::chrono::high_resolution_clock::now();
+        cv::Mat disp(height, width, CV_16UC1);
+        cv::Mat disp_color, disp_8u;
 
-        if (!is_streaming)
+        while (is_streaming)
         {
-            std::cout << "Exit by user signal" << std::endl;
-            break;
-        }
-        if (camera->getCamData(camDataCamera))
-        {
-            // read the next frames
-            frame_0 = camDataCamera.frame_0;
-            frame_1 = camDataCamera.frame_1;
-
-            cv::remap(frame_0, frame_0_rect, map11, map12, cv::INTER_LINEAR);
-            cv::remap(frame_1, frame_1_rect, map21, map22, cv::INTER_LINEAR);
-
-            clEnqueueWriteBuffer(cl_queue, d_left, true, 0, camConfig.width * camConfig.height, frame_0_rect.data, 0, nullptr, nullptr);
-            clEnqueueWriteBuffer(cl_queue, d_right, true, 0, camConfig.width * camConfig.height, frame_1_rect.data, 0, nullptr, nullptr);
-
-            auto t = std::chrono::steady_clock::now();
-            //ssgm.execute(left.data, right.data, reinterpret_cast<uint16_t*>(disp.data));
-            ssgm.execute(d_left, d_right, d_disp);
-            std::chrono::milliseconds dur = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t);
-            clEnqueueReadBuffer(cl_queue, d_disp, true, 0, camConfig.width * camConfig.height * 2, disp.data, 0, nullptr, nullptr);
-
-            cv::Mat disparity_8u, disparity_color;
-            disp.convertTo(disparity_8u, CV_8U, 255. / (disp_size * (params.subpixel ? 16 : 1)));
-            cv::applyColorMap(disparity_8u, disparity_color, cv::COLORMAP_JET);
-            const int invalid_disp = static_cast<uint16_t>(ssgm.get_invalid_disparity());
-
-            disparity_color.setTo(cv::Scalar(0, 0, 0), disp == invalid_disp);
-            const int64_t fps = 1000 / dur.count();
-            cv::putText(disparity_color, "sgm execution time: " + std::to_string(dur.count()) + "[msec] " + std::to_string(fps) + "[FPS]",
-                        cv::Point(50, 50), 2, 0.75, cv::Scalar(255, 255, 255));
-
-            cv::imshow("original", frame_0);
-            cv::waitKey(1);
-
-            cv::imshow("disp", disparity_color);
-            // Press  ESC on keyboard to exit
-            char c = (char)cv::waitKey(25);
-            if (c == 27)
+            auto start = std::chrono::high_resolution_clock::now();
+
+            if (!is_streaming)
+            {
+                std::cout << "Exit by user signal" << std::endl;
                 break;
+            }
+            const StereoCameraData *camData = capture.acquire(1000);
+            if (!camData && capture.finished())
+            {
+                std::cout << "End of the recording" << std::endl;
+                break;
+            }
+            if (camData)
+            {
+                // host pointers are mapped into the device, no extra staging copies
+                auto t = std::chrono::steady_clock::now();
+                if (raw_input)
+                {
+                    ssgm.execute_interleaved(camData->raw.data, reinterpret_cast<uint16_t *>(disp.data));
+                }
+                else
+                {
+                    // read the next frames, the matching reads them as width x height bytes
+                    frame_0 = camData->frame_0.isContinuous() ? camData->frame_0 : camData->frame_0.clone();
+                    frame_1 = camData->frame_1.isContinuous() ? camData->frame_1 : camData->frame_1.clone();
+                    ssgm.execute(frame_0.data, frame_1.data, reinterpret_cast<uint16_t *>(disp.data));
+                }
+                std::chrono::milliseconds dur = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t);
+
+                if (params.enable_profiling)
+                {
+                    const sgmcl::FrameStats stats = ssgm.get_frame_stats();
+                    std::cout << "deinterleave " << stats.deinterleave
+                              << " ms, rectify " << stats.rectify_left << " / " << stats.rectify_right
+                              << " ms, census " << stats.census_left << " / " << stats.census_right << " ms, paths";
+                    for (int i = 0; i < stats.num_paths; ++i)
+                        std::cout << " " << stats.paths[i];
+                    std::cout << " ms, wta " << stats.winner_takes_all
+                              << " ms, median " << stats.median_left << " / " << stats.median_right
+                              << " ms, lr check " << stats.check_consistency
+                              << " ms, range " << stats.correct_disparity_range
+                              << " ms, total " << stats.total << " ms" << std::endl;
+                }
+
+                cv::Mat disparity_8u, disparity_color;
+                disp.convertTo(disparity_8u, CV_8U, 255. / (disp_size * (params.subpixel ? 16 : 1)));
+                cv::applyColorMap(disparity_8u, disparity_color, cv::COLORMAP_JET);
+                const int invalid_disp = static_cast<uint16_t>(ssgm.get_invalid_disparity());
+
+                disparity_color.setTo(cv::Scalar(0, 0, 0), disp == invalid_disp);
+                const int64_t fps = 1000 / dur.count();
+                cv::putText(disparity_color, "sgm execution time: " + std::to_string(dur.count()) + "[msec] " + std::to_string(fps) + "[FPS]",
+                            cv::Point(50, 50), 2, 0.75, cv::Scalar(255, 255, 255));
+
+                // the gray frames only exist on the device with --raw
+                if (!raw_input)
+                {
+                    cv::imshow("original", frame_0);
+                    cv::waitKey(1);
+                }
+
+                cv::imshow("disp", disparity_color);
+                // Press  ESC on keyboard to exit
+                char c = (char)cv::waitKey(25);
+                if (c == 27)
+                    break;
+            }
         }
     }
 
-    clReleaseMemObject(d_left);
-    clReleaseMemObject(d_right);
-    clReleaseMemObject(d_disp);
+    capture.stop();
+    std::cout << capture.capturedFrames() << " frames captured, " << capture.droppedFrames() << " dropped" << std::endl;
+    if (camera)
+    {
+        const Withrobot::capture_stats cam_stats = camera->getCaptureStats();
+        std::cout << "V4L2: " << cam_stats.frames << " frames, " << cam_stats.dropped << " dropped by the driver, "
+                  << cam_stats.late << " late, " << cam_stats.queue_depth << " buffers" << std::endl;
+    }
+    if (recorder)
+    {
+        std::cout << recorder->frameCount() << " of " << recorder->capacity() << " frames recorded to " << record_path << std::endl;
+    }
 
-    clReleaseCommandQueue(cl_queue);
     clReleaseDevice(cl_device);
     clReleaseContext(cl_ctx);
 
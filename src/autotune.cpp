@@ -0,0 +1,242 @@
+#include "libsgm_ocl.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
+#include <utility>
+
+namespace sgmcl
+{
+    namespace
+    {
+        // One launch geometry of a kernel group, the tuning keys and their values.
+        using Candidate = std::vector<std::pair<std::string, int>>;
+
+        struct KnobGroup
+        {
+            std::string name;
+            std::vector<Candidate> candidates;
+            // kernel time of the group in a frame
+            std::function<double(const FrameStats &)> cost;
+            // work group size of a trial profile if it depends on the warp width, which the
+            // warp_size group may have changed meanwhile
+            std::function<size_t(const TuningProfile &)> work_group_size;
+        };
+
+        // Random texture and the same texture shifted by a disparity growing from
+        // top to bottom, so every disparity of the range is matched somewhere.
+        void synthetic_pair(int width, int height, int disparity_size,
+                            std::vector<uint8_t> &left, std::vector<uint8_t> &right)
+        {
+            const int texture_width = width + 2 * disparity_size;
+            std::vector<uint8_t> texture(static_cast<size_t>(texture_width) * height);
+            std::mt19937 rng(12345);
+            std::uniform_int_distribution<int> dist(0, 255);
+            for (auto &p : texture)
+            {
+                p = static_cast<uint8_t>(dist(rng));
+            }
+
+            left.resize(static_cast<size_t>(width) * height);
+            right.resize(static_cast<size_t>(width) * height);
+            for (int y = 0; y < height; ++y)
+            {
+                const int d = y * (disparity_size - 1) / std::max(height - 1, 1);
+                const uint8_t *src = texture.data() + static_cast<size_t>(y) * texture_width;
+                std::copy(src + disparity_size, src + disparity_size + width, left.begin() + static_cast<size_t>(y) * width);
+                std::copy(src + disparity_size + d, src + disparity_size + d + width, right.begin() + static_cast<size_t>(y) * width);
+            }
+        }
+
+        std::vector<KnobGroup> knob_groups(cl_context ctx, cl_device_id device, int disparity_size, size_t max_work_group_size)
+        {
+            const std::string d = ".d" + std::to_string(disparity_size) + ".";
+            std::vector<KnobGroup> groups;
+
+            // first, the default block sizes of the other groups are counted in warps
+            KnobGroup warp{"warp_size", {}, [](const FrameStats &s) { return s.total; }};
+            for (int warp_size : {8, 16, 32, 64})
+                if (static_cast<size_t>(warp_size) <= max_work_group_size)
+                    warp.candidates.push_back({{"device.warp_size", warp_size}});
+            groups.push_back(warp);
+
+            KnobGroup census{"census", {}, [](const FrameStats &s) { return s.census_left + s.census_right; }};
+            for (int block_size : {64, 128, 256, 512})
+                for (int lines : {4, 8, 16, 32})
+                    if (static_cast<size_t>(block_size) <= max_work_group_size)
+                        census.candidates.push_back({{"census.block_size", block_size}, {"census.lines_per_block", lines}});
+            groups.push_back(census);
+
+            // the invalid subgroup sizes among these are rejected by the constructors
+            KnobGroup vertical{"vertical", {}, [](const FrameStats &s) { return s.paths[0] + s.paths[1]; }};
+            KnobGroup oblique{"oblique", {}, [](const FrameStats &s) { return s.paths[4] + s.paths[5] + s.paths[6] + s.paths[7]; }};
+            for (int block_size : {64, 128, 256, 512})
+                for (int dp_block_size : {4, 8, 16, 32})
+                    if (static_cast<size_t>(block_size) <= max_work_group_size)
+                    {
+                        vertical.candidates.push_back({{"vertical" + d + "block_size", block_size}, {"vertical" + d + "dp_block_size", dp_block_size}});
+                        oblique.candidates.push_back({{"oblique" + d + "block_size", block_size}, {"oblique" + d + "dp_block_size", dp_block_size}});
+                    }
+            groups.push_back(vertical);
+
+            KnobGroup horizontal{"horizontal", {}, [](const FrameStats &s) { return s.paths[2] + s.paths[3]; }};
+            for (int warps : {1, 2, 4, 8, 16})
+                for (int dp_block_size : {4, 8, 16, 32})
+                    horizontal.candidates.push_back({{"horizontal" + d + "warps_per_block", warps}, {"horizontal" + d + "dp_block_size", dp_block_size}});
+            horizontal.work_group_size = [=](const TuningProfile &trial) {
+                const unsigned int dp_block_size = trial.get("horizontal" + d + "dp_block_size", 1);
+                return static_cast<size_t>(trial.get("horizontal" + d + "warps_per_block", 1)) *
+                       aggregation_warp_size(ctx, device, trial, disparity_size, dp_block_size);
+            };
+            groups.push_back(horizontal);
+            groups.push_back(oblique);
+
+            // hardware subgroup shuffles against the local memory emulation, the same without the extensions
+            KnobGroup subgroups{"subgroups", {}, [](const FrameStats &s) {
+                                    double sum = 0.0;
+                                    for (int i = 0; i < s.num_paths; ++i)
+                                        sum += s.paths[i];
+                                    return sum;
+                                }};
+            for (int native : {1, 0})
+                subgroups.candidates.push_back({{"aggregation.native_subgroups", native}});
+            groups.push_back(subgroups);
+
+            KnobGroup wta{"winner_takes_all", {}, [](const FrameStats &s) { return s.winner_takes_all; }};
+            for (int warps : {1, 2, 4, 8, 16})
+                wta.candidates.push_back({{"wta" + d + "warps_per_block", warps}});
+            wta.work_group_size = [=](const TuningProfile &trial) {
+                return static_cast<size_t>(trial.get("wta" + d + "warps_per_block", 1)) *
+                       wta_warp_size(ctx, device, trial, disparity_size);
+            };
+            groups.push_back(wta);
+
+            KnobGroup details{"details", {}, [](const FrameStats &s) {
+                                  return s.median_left + s.median_right + s.check_consistency + s.correct_disparity_range;
+                              }};
+            const std::pair<int, int> tiles[] = {{8, 8}, {16, 16}, {32, 8}, {32, 4}, {64, 4}, {128, 1}, {32, 32}};
+            for (const auto &tile : tiles)
+                if (static_cast<size_t>(tile.first) * tile.second <= max_work_group_size)
+                    details.candidates.push_back({{"details.tile_width", tile.first}, {"details.tile_height", tile.second}});
+            groups.push_back(details);
+
+            return groups;
+        }
+    } // namespace
+
+    TuningProfile autotune(int width,
+                           int height,
+                           int disparity_size,
+                           cl_context ctx,
+                           cl_device_id cl_device,
+                           Parameters param,
+                           const std::string &profile_path,
+                           int iterations)
+    {
+        if (ctx == nullptr || cl_device == nullptr)
+        {
+            throw std::logic_error("autotune needs an OpenCL context and device");
+        }
+        if (iterations < 1)
+        {
+            throw std::logic_error("autotune needs at least one iteration");
+        }
+        param.backend = ExecutionBackend::OPENCL;
+        param.path_type = PathType::SCAN_8PATH;
+        param.pipeline_depth = 1;
+        param.enable_profiling = true;
+        param.tuning_profile.clear();
+        // the tuning keys are measured on the full range kernels
+        param.hierarchical = false;
+        param.temporal_prior = false;
+
+        size_t max_work_group_size = 0;
+        clGetDeviceInfo(cl_device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group_size), &max_work_group_size, nullptr);
+
+        std::vector<uint8_t> left, right;
+        synthetic_pair(width, height, disparity_size, left, right);
+        std::vector<uint16_t> disparity(static_cast<size_t>(width) * height);
+
+        // median kernel time of a group over the timed frames, the disparity of the last one
+        auto measure = [&](const TuningProfile &tuning, const KnobGroup *group) {
+            StereoSGM sgm(width, height, disparity_size, ctx, cl_device, param, tuning);
+            sgm.prepare();
+            std::vector<double> times;
+            for (int i = 0; i < iterations; ++i)
+            {
+                std::fill(disparity.begin(), disparity.end(), 0);
+                sgm.execute(left.data(), right.data(), disparity.data());
+                const FrameStats stats = sgm.get_frame_stats();
+                times.push_back(group ? group->cost(stats) : stats.total);
+            }
+            std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+            return times[times.size() / 2];
+        };
+
+        // the built-in geometry gives the reference result
+        measure(TuningProfile(), nullptr);
+        const std::vector<uint16_t> reference = disparity;
+
+        // keep the entries of other disparity sizes
+        TuningProfile best;
+        best.load(profile_path, cl_device);
+
+        // one pass of coordinate descent, the groups hardly influence each other
+        for (const KnobGroup &group : knob_groups(ctx, cl_device, disparity_size, max_work_group_size))
+        {
+            double best_time = std::numeric_limits<double>::max();
+            const Candidate *best_candidate = nullptr;
+            for (const Candidate &candidate : group.candidates)
+            {
+                TuningProfile trial = best;
+                for (const auto &value : candidate)
+                {
+                    trial.set(value.first, value.second);
+                }
+                // with the warp width the kernels use on this device
+                if (group.work_group_size && group.work_group_size(trial) > max_work_group_size)
+                {
+                    continue;
+                }
+
+                double time = 0.0;
+                try
+                {
+                    time = measure(trial, &group);
+                }
+                catch (const std::exception &)
+                {
+                    // invalid geometry or failed build
+                    continue;
+                }
+                // a failed launch leaves no event (time 0) and a wrong result
+                if (time <= 0.0 || disparity != reference)
+                {
+                    continue;
+                }
+                if (time < best_time)
+                {
+                    best_time = time;
+                    best_candidate = &candidate;
+                }
+            }
+
+            if (best_candidate == nullptr)
+            {
+                std::cout << "autotune " << group.name << ": no valid candidate, keeping the defaults" << std::endl;
+                continue;
+            }
+            std::cout << "autotune " << group.name << ": " << best_time << " ms with";
+            for (const auto &value : *best_candidate)
+            {
+                best.set(value.first, value.second);
+                std::cout << " " << value.first << "=" << value.second;
+            }
+            std::cout << std::endl;
+        }
+
+        best.save(profile_path, cl_device);
+        return best;
+    }
+} // namespace sgmcl
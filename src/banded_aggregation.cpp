@@ -0,0 +1,259 @@
+#include "banded_aggregation.h"
+#include "sgm_details.h"
+
+namespace sgmcl
+{
+    namespace
+    {
+        // scanline directions in the order of BandedAggregation::m_path_kernels
+        const int DIRECTIONS[BandedAggregation::MAX_NUM_PATHS][2] = {
+            {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+
+        std::string read_sources(std::initializer_list<const char *> paths)
+        {
+            std::string src;
+            for (const char *path : paths)
+            {
+                std::ifstream fileInput(path);
+                src += std::string{std::istreambuf_iterator<char>(fileInput),
+                                   std::istreambuf_iterator<char>()};
+            }
+            return src;
+        }
+    } // namespace
+
+    BandedAggregation::BandedAggregation(cl_context ctx,
+                                         cl_device_id device,
+                                         unsigned int band_width,
+                                         const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device), m_band_width(band_width),
+          m_cost_buffer(ctx), m_fused_cost_buffer(ctx), m_right_best(ctx),
+          m_paths_per_block(tuning.get("banded.paths_per_block",
+                                       fit_warps_per_block(device, band_width, DEFAULT_PATHS_PER_BLOCK))),
+          m_tile_width(tuning.get("details.tile_width", SGMDetails::DEFAULT_TILE_WIDTH)),
+          m_tile_height(tuning.get("details.tile_height", SGMDetails::DEFAULT_TILE_HEIGHT))
+    {
+        // the minimum of a band is a tree reduction
+        if (band_width < 2 || (band_width & (band_width - 1)) != 0)
+        {
+            throw std::logic_error("disparity band width must be a power of two");
+        }
+    }
+
+    BandedAggregation::~BandedAggregation()
+    {
+        for (auto &kernel : m_path_kernels)
+        {
+            if (kernel)
+            {
+                clReleaseKernel(kernel);
+                kernel = nullptr;
+            }
+        }
+        if (m_wta_kernel)
+        {
+            clReleaseKernel(m_wta_kernel);
+            clReleaseKernel(m_finish_kernel);
+            m_wta_kernel = nullptr;
+            m_finish_kernel = nullptr;
+        }
+    }
+
+    void BandedAggregation::init_paths(bool fused)
+    {
+        const std::string common_src = read_sources({"data/ocl/inttypes.cl", "data/ocl/path_aggregation_banded.cl"});
+        for (size_t i = 0; i < MAX_NUM_PATHS; ++i)
+        {
+            if (m_path_kernels[i])
+            {
+                clReleaseKernel(m_path_kernels[i]);
+                m_path_kernels[i] = nullptr;
+            }
+
+            std::string kernel_src = common_src;
+            std::string kernel_BAND_WIDTH = "#define BAND_WIDTH " + std::to_string(m_band_width) + "\n";
+            std::string kernel_PATHS_PER_BLOCK = "#define PATHS_PER_BLOCK " + std::to_string(m_paths_per_block) + "\n";
+            std::string kernel_DX = "#define DX " + std::to_string(DIRECTIONS[i][0]) + "\n";
+            std::string kernel_DY = "#define DY " + std::to_string(DIRECTIONS[i][1]) + "\n";
+            std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(fused ? 1 : 0) + "\n";
+            kernel_src = std::regex_replace(kernel_src, std::regex("@BAND_WIDTH@"), kernel_BAND_WIDTH);
+            kernel_src = std::regex_replace(kernel_src, std::regex("@PATHS_PER_BLOCK@"), kernel_PATHS_PER_BLOCK);
+            kernel_src = std::regex_replace(kernel_src, std::regex("@DX@"), kernel_DX);
+            kernel_src = std::regex_replace(kernel_src, std::regex("@DY@"), kernel_DY);
+            kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+
+            m_path_programs[i].init(m_cl_context, m_cl_device_id, kernel_src);
+            m_path_kernels[i] = m_path_programs[i].getKernel("aggregate_banded_kernel");
+        }
+        m_paths_fused = fused;
+    }
+
+    void BandedAggregation::init_winner_takes_all(int num_paths, bool subpixel, bool fused)
+    {
+        if (m_wta_kernel)
+        {
+            clReleaseKernel(m_wta_kernel);
+            clReleaseKernel(m_finish_kernel);
+        }
+
+        std::string kernel_src = read_sources({"data/ocl/inttypes.cl", "data/ocl/winner_takes_all_banded.cl"});
+        std::string kernel_BAND_WIDTH = "#define BAND_WIDTH " + std::to_string(m_band_width) + "\n";
+        std::string kernel_NUM_PATHS = "#define NUM_PATHS " + std::to_string(num_paths) + "\n";
+        std::string kernel_COMPUTE_SUBPIXEL = "#define COMPUTE_SUBPIXEL " + std::to_string(subpixel ? 1 : 0) + "\n";
+        std::string kernel_SUBPIXEL_SHIFT = "#define SUBPIXEL_SHIFT " + std::to_string(SubpixelShift()) + "\n";
+        std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(fused ? 1 : 0) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@BAND_WIDTH@"), kernel_BAND_WIDTH);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@NUM_PATHS@"), kernel_NUM_PATHS);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@COMPUTE_SUBPIXEL@"), kernel_COMPUTE_SUBPIXEL);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SUBPIXEL_SHIFT@"), kernel_SUBPIXEL_SHIFT);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+
+        m_wta_program.init(m_cl_context, m_cl_device_id, kernel_src);
+        m_wta_kernel = m_wta_program.getKernel("winner_takes_all_banded_kernel");
+        m_finish_kernel = m_wta_program.getKernel("finish_right_disparity_kernel");
+        m_wta_num_paths = num_paths;
+        m_wta_subpixel = subpixel;
+        m_wta_fused = fused;
+    }
+
+    void BandedAggregation::enqueue(const DeviceBuffer<uint32_t> &left,
+                                    const DeviceBuffer<uint32_t> &right,
+                                    const DeviceBuffer<uint16_t> &band,
+                                    int width,
+                                    int height,
+                                    int batch_size,
+                                    PathType path_type,
+                                    unsigned int p1,
+                                    unsigned int p2,
+                                    int min_disp,
+                                    bool fused,
+                                    cl_command_queue stream,
+                                    cl_event *path_events)
+    {
+        if (m_path_kernels[0] == nullptr || m_paths_fused != fused)
+        {
+            init_paths(fused);
+        }
+
+        const size_t num_paths = path_type == PathType::SCAN_4PATH ? 4 : 8;
+        const size_t volume_size = static_cast<size_t>(width) * height * m_band_width * batch_size;
+        cl_mem dest;
+        if (fused)
+        {
+            m_fused_cost_buffer.allocate(volume_size);
+            dest = m_fused_cost_buffer.data();
+        }
+        else
+        {
+            m_cost_buffer.allocate(volume_size * num_paths);
+            dest = m_cost_buffer.data();
+        }
+
+        for (size_t i = 0; i < num_paths; ++i)
+        {
+            const int dx = DIRECTIONS[i][0];
+            const int dy = DIRECTIONS[i][1];
+            const size_t paths = dy == 0 ? height : (dx == 0 ? width : width + height - 1);
+            // the fused volume is written by the first path and accumulated by the others
+            const int path_index = fused ? 0 : static_cast<int>(i);
+            const int accumulate = fused && i > 0 ? 1 : 0;
+
+            cl_kernel kernel = m_path_kernels[i];
+            cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &dest);
+            err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &left.data());
+            err = clSetKernelArg(kernel, 2, sizeof(cl_mem), &right.data());
+            err = clSetKernelArg(kernel, 3, sizeof(cl_mem), &band.data());
+            err = clSetKernelArg(kernel, 4, sizeof(width), &width);
+            err = clSetKernelArg(kernel, 5, sizeof(height), &height);
+            err = clSetKernelArg(kernel, 6, sizeof(p1), &p1);
+            err = clSetKernelArg(kernel, 7, sizeof(p2), &p2);
+            err = clSetKernelArg(kernel, 8, sizeof(min_disp), &min_disp);
+            err = clSetKernelArg(kernel, 9, sizeof(path_index), &path_index);
+            err = clSetKernelArg(kernel, 10, sizeof(accumulate), &accumulate);
+
+            const size_t block_size = m_paths_per_block * m_band_width;
+            size_t global_size[2] = {
+                (paths + m_paths_per_block - 1) / m_paths_per_block * block_size,
+                (size_t)batch_size};
+            size_t local_size[2] = {block_size, 1};
+            err = clEnqueueNDRangeKernel(stream,
+                                         kernel,
+                                         2,
+                                         nullptr,
+                                         global_size,
+                                         local_size,
+                                         0, nullptr, path_events ? &path_events[i] : nullptr);
+            CHECK_OCL_ERROR(err, "Error enequeuing banded path aggregation kernel");
+        }
+    }
+
+    void BandedAggregation::winner_takes_all(DeviceBuffer<uint16_t> &left,
+                                             DeviceBuffer<uint16_t> &right,
+                                             const DeviceBuffer<uint16_t> &band,
+                                             int width,
+                                             int height,
+                                             int batch_size,
+                                             int pitch,
+                                             float uniqueness,
+                                             bool subpixel,
+                                             PathType path_type,
+                                             bool fused,
+                                             cl_command_queue stream,
+                                             cl_event *event)
+    {
+        const int num_paths = path_type == PathType::SCAN_4PATH ? 4 : 8;
+        if (m_wta_kernel == nullptr || m_wta_num_paths != num_paths || m_wta_subpixel != subpixel || m_wta_fused != fused)
+        {
+            init_winner_takes_all(num_paths, subpixel, fused);
+        }
+
+        const size_t right_size = static_cast<size_t>(pitch) * height * batch_size;
+        if (m_right_best.size() < right_size)
+        {
+            // afterwards finish_right_disparity_kernel leaves it reset
+            m_right_best.allocate(right_size);
+            const cl_uint pattern = 0xffffffffu;
+            cl_int err = clEnqueueFillBuffer(stream, m_right_best.data(), &pattern, sizeof(pattern), 0,
+                                             right_size * sizeof(cl_uint), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error filling the right disparity buffer");
+        }
+
+        const cl_mem &src = fused ? m_fused_cost_buffer.data() : m_cost_buffer.data();
+        cl_int err = clSetKernelArg(m_wta_kernel, 0, sizeof(cl_mem), &left.data());
+        err = clSetKernelArg(m_wta_kernel, 1, sizeof(cl_mem), &m_right_best.data());
+        err = clSetKernelArg(m_wta_kernel, 2, sizeof(cl_mem), &src);
+        err = clSetKernelArg(m_wta_kernel, 3, sizeof(cl_mem), &band.data());
+        err = clSetKernelArg(m_wta_kernel, 4, sizeof(width), &width);
+        err = clSetKernelArg(m_wta_kernel, 5, sizeof(height), &height);
+        err = clSetKernelArg(m_wta_kernel, 6, sizeof(pitch), &pitch);
+        err = clSetKernelArg(m_wta_kernel, 7, sizeof(uniqueness), &uniqueness);
+
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_wta_kernel,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing banded winner_takes_all kernel");
+
+        err = clSetKernelArg(m_finish_kernel, 0, sizeof(cl_mem), &right.data());
+        err = clSetKernelArg(m_finish_kernel, 1, sizeof(cl_mem), &m_right_best.data());
+        err = clSetKernelArg(m_finish_kernel, 2, sizeof(width), &width);
+        err = clSetKernelArg(m_finish_kernel, 3, sizeof(height), &height);
+        err = clSetKernelArg(m_finish_kernel, 4, sizeof(pitch), &pitch);
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_finish_kernel,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error enequeuing finish right disparity kernel");
+    }
+} // namespace sgmcl
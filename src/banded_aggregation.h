@@ -0,0 +1,90 @@
+#include "common.h"
+
+namespace sgmcl
+{
+
+    /**
+        Path aggregation and winner takes all over a band of band_width disparities
+        which starts at a different disparity on every pixel, the full resolution
+        level of HierarchicalSemiGlobalMatching and the prior frames of
+        TemporalSemiGlobalMatching.
+        */
+    class BandedAggregation
+    {
+    public:
+        static constexpr unsigned int DEFAULT_BAND_WIDTH = 64;
+        static constexpr size_t MAX_NUM_PATHS = 8;
+        // Default of the tuning key "banded.paths_per_block".
+        static constexpr unsigned int DEFAULT_PATHS_PER_BLOCK = 2;
+
+        // band_width must be a power of two.
+        BandedAggregation(cl_context ctx,
+                          cl_device_id device,
+                          unsigned int band_width = DEFAULT_BAND_WIDTH,
+                          const TuningProfile &tuning = TuningProfile());
+        ~BandedAggregation();
+
+        unsigned int band_width() const { return m_band_width; }
+
+        // band holds the first disparity of every pixel relative to min_disp,
+        // see Pyramid::disparity_band. The paths run one after another on stream.
+        void enqueue(const DeviceBuffer<uint32_t> &left,
+                     const DeviceBuffer<uint32_t> &right,
+                     const DeviceBuffer<uint16_t> &band,
+                     int width,
+                     int height,
+                     int batch_size,
+                     PathType path_type,
+                     unsigned int p1,
+                     unsigned int p2,
+                     int min_disp,
+                     bool fused,
+                     cl_command_queue stream,
+                     cl_event *path_events = nullptr);
+
+        // Disparities relative to min_disp, like WinnerTakesAll. The right disparity
+        // of a pixel is the best left winner falling on it, INVALID_DISP if none does.
+        void winner_takes_all(DeviceBuffer<uint16_t> &left,
+                              DeviceBuffer<uint16_t> &right,
+                              const DeviceBuffer<uint16_t> &band,
+                              int width,
+                              int height,
+                              int batch_size,
+                              int pitch,
+                              float uniqueness,
+                              bool subpixel,
+                              PathType path_type,
+                              bool fused,
+                              cl_command_queue stream,
+                              cl_event *event = nullptr);
+
+    private:
+        void init_paths(bool fused);
+        void init_winner_takes_all(int num_paths, bool subpixel, bool fused);
+
+        cl_context m_cl_context = nullptr;
+        cl_device_id m_cl_device_id = nullptr;
+        unsigned int m_band_width;
+
+        // up->down, down->up, left->right, right->left, upleft->downright,
+        // upright->downleft, downright->upleft, downleft->upright
+        DeviceProgram m_path_programs[MAX_NUM_PATHS];
+        cl_kernel m_path_kernels[MAX_NUM_PATHS] = {};
+        bool m_paths_fused = false;
+
+        DeviceProgram m_wta_program;
+        cl_kernel m_wta_kernel = nullptr;
+        cl_kernel m_finish_kernel = nullptr;
+        int m_wta_num_paths = 0;
+        bool m_wta_subpixel = false;
+        bool m_wta_fused = false;
+
+        DeviceBuffer<uint8_t> m_cost_buffer;
+        DeviceBuffer<uint16_t> m_fused_cost_buffer;
+        DeviceBuffer<uint32_t> m_right_best;
+
+        unsigned int m_paths_per_block;
+        size_t m_tile_width;
+        size_t m_tile_height;
+    };
+} // namespace sgmcl
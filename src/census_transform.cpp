@@ -3,9 +3,16 @@
 namespace sgmcl
 {
 
-    CensusTransform::CensusTransform(cl_context ctx, cl_device_id device)
-        : m_cl_ctx(ctx), m_cl_device(device)
+    CensusTransform::CensusTransform(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_ctx(ctx), m_cl_device(device),
+          m_block_size(tuning.get("census.block_size", DEFAULT_BLOCK_SIZE)),
+          m_lines_per_block(tuning.get("census.lines_per_block", DEFAULT_LINES_PER_BLOCK))
     {
+        // every block needs a full window plus at least one output column
+        if (m_block_size <= WINDOW_WIDTH)
+        {
+            throw std::logic_error("census block size must be larger than the census window");
+        }
     }
 
     CensusTransform::~CensusTransform()
@@ -21,8 +28,10 @@ namespace sgmcl
                                   DeviceBuffer<uint32_t> &feature_buffer,
                                   int width,
                                   int height,
+                                  int batch_size,
                                   int pitch,
-                                  cl_command_queue stream)
+                                  cl_command_queue stream,
+                                  cl_event *event)
     {
         if (m_census_kernel == nullptr)
         {
@@ -31,6 +40,11 @@ namespace sgmcl
             fileInput.open("data/ocl/census.cl");
             std::string kernel{std::istreambuf_iterator<char>(fileInput),
                                std::istreambuf_iterator<char>()};
+
+            std::string kernel_BLOCK_SIZE_CENSUS = "#define BLOCK_SIZE_CENSUS " + std::to_string(m_block_size) + "\n";
+            std::string kernel_LINES_PER_BLOCK = "#define LINES_PER_BLOCK " + std::to_string(m_lines_per_block) + "\n";
+            kernel = std::regex_replace(kernel, std::regex("@BLOCK_SIZE_CENSUS@"), kernel_BLOCK_SIZE_CENSUS);
+            kernel = std::regex_replace(kernel, std::regex("@LINES_PER_BLOCK@"), kernel_LINES_PER_BLOCK);
             m_program.init(m_cl_ctx, m_cl_device, kernel);
 
             m_census_kernel = m_program.getKernel("census_transform_kernel");
@@ -43,21 +57,22 @@ namespace sgmcl
         err = clSetKernelArg(m_census_kernel, 3, sizeof(height), &height);
         err = clSetKernelArg(m_census_kernel, 4, sizeof(pitch), &pitch);
 
-        const int width_per_block = BLOCK_SIZE - WINDOW_WIDTH + 1;
-        const int height_per_block = LINES_PER_BLOCK;
+        const int width_per_block = m_block_size - WINDOW_WIDTH + 1;
+        const int height_per_block = m_lines_per_block;
 
         //setup kernels
-        size_t global_size[2] = {
-            (size_t)((width + width_per_block - 1) / width_per_block * BLOCK_SIZE),
-            (size_t)((height + height_per_block - 1) / height_per_block)};
-        size_t local_size[2] = {BLOCK_SIZE, 1};
+        size_t global_size[3] = {
+            (size_t)((width + width_per_block - 1) / width_per_block * m_block_size),
+            (size_t)((height + height_per_block - 1) / height_per_block),
+            (size_t)batch_size};
+        size_t local_size[3] = {m_block_size, 1, 1};
         err = clEnqueueNDRangeKernel(stream,
                                      m_census_kernel,
-                                     2,
+                                     3,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     0, nullptr, event);
         CHECK_OCL_ERROR(err, "Error enequeuing census kernel");
     }
 } // namespace sgmcl
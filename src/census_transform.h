@@ -5,14 +5,17 @@ namespace sgmcl
 
     class CensusTransform
     {
-        static constexpr unsigned int BLOCK_SIZE = 128;
         static constexpr unsigned int WINDOW_WIDTH = 9;
         static constexpr unsigned int WINDOW_HEIGHT = 7;
-        static constexpr unsigned int LINES_PER_BLOCK = 16;
 
     public:
+        // Defaults of the tuning keys "census.block_size" and "census.lines_per_block".
+        static constexpr unsigned int DEFAULT_BLOCK_SIZE = 128;
+        static constexpr unsigned int DEFAULT_LINES_PER_BLOCK = 16;
+
         CensusTransform(cl_context ctx,
-                        cl_device_id device);
+                        cl_device_id device,
+                        const TuningProfile &tuning = TuningProfile());
         ~CensusTransform();
 
         void enqueue(
@@ -20,13 +23,17 @@ namespace sgmcl
             DeviceBuffer<uint32_t> &feature_buffer,
             int width,
             int height,
+            int batch_size,
             int pitch,
-            cl_command_queue stream);
+            cl_command_queue stream,
+            cl_event *event = nullptr);
 
     private:
         DeviceProgram m_program;
         cl_context m_cl_ctx = nullptr;
         cl_device_id m_cl_device = nullptr;
         cl_kernel m_census_kernel = nullptr;
+        unsigned int m_block_size;
+        unsigned int m_lines_per_block;
     };
 } // namespace sgmcl
@@ -4,9 +4,14 @@
 #include <string>
 #include <iostream>
 #include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
 
 #include <CL/cl.h>
 
+#include "program_cache.h"
+
 #define CHECK_OCL_ERROR(err, msg)                                                           \
     if (err != CL_SUCCESS)                                                                  \
     {                                                                                       \
@@ -15,32 +20,99 @@
 
 namespace sgmcl
 {
+    // Bytes currently held by all DeviceBuffer allocations of the process.
+    inline std::atomic<size_t> &allocated_device_memory()
+    {
+        static std::atomic<size_t> bytes{0};
+        return bytes;
+    }
+
+    // String valued clGetDeviceInfo (e.g. CL_DEVICE_NAME), empty on failure.
+    inline std::string device_info_string(cl_device_id device, cl_device_info param)
+    {
+        size_t size = 0;
+        if (clGetDeviceInfo(device, param, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        {
+            return std::string();
+        }
+        std::string str(size, '\0');
+        clGetDeviceInfo(device, param, size, &str[0], nullptr);
+        // drop the terminating zero(s)
+        str.resize(str.find('\0') == std::string::npos ? str.size() : str.find('\0'));
+        return str;
+    }
+
+    // Warps of warp_size lanes in a default work group, at most the device allows and at least one.
+    inline unsigned int fit_warps_per_block(cl_device_id device, unsigned int warp_size, unsigned int warps)
+    {
+        size_t max_size = 0;
+        if (clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_size), &max_size, nullptr) != CL_SUCCESS)
+        {
+            return warps;
+        }
+        const size_t max_warps = std::max<size_t>(max_size / warp_size, 1);
+        return static_cast<unsigned int>(std::min<size_t>(warps, max_warps));
+    }
+
+    // CL_DEVICE_OPENCL_C_VERSION as major * 10 + minor, e.g. 12 for OpenCL C 1.2.
+    inline int device_opencl_c_version(cl_device_id device)
+    {
+        int major = 1, minor = 0;
+        std::sscanf(device_info_string(device, CL_DEVICE_OPENCL_C_VERSION).c_str(), "OpenCL C %d.%d", &major, &minor);
+        return major * 10 + minor;
+    }
+
+    // Whether CL_DEVICE_EXTENSIONS lists the extension.
+    inline bool device_has_extension(cl_device_id device, const std::string &extension)
+    {
+        const std::string extensions = " " + device_info_string(device, CL_DEVICE_EXTENSIONS) + " ";
+        return extensions.find(" " + extension + " ") != std::string::npos;
+    }
+
     class DeviceProgram
     {
     public:
         DeviceProgram() = default;
         DeviceProgram(cl_context ctx,
                       cl_device_id device,
-                      const std::string &kernel_str)
+                      const std::string &kernel_str,
+                      const std::string &options = std::string())
         {
-            init(ctx, device, kernel_str);
+            init(ctx, device, kernel_str, options);
         }
 
+        // options are passed to clBuildProgram, e.g. -cl-std=CL2.0
         void init(cl_context ctx,
                   cl_device_id device,
-                  const std::string &kernel_str)
+                  const std::string &kernel_str,
+                  const std::string &options = std::string())
         {
             if (m_cl_program != nullptr)
             {
-                clReleaseProgram(m_cl_program);
+                ProgramCache::release(m_cl_program);
                 m_cl_program = nullptr;
             }
 
+            // the engine of another pipeline slot built it already
+            m_cl_program = ProgramCache::acquire(ctx, device, kernel_str, options);
+            if (m_cl_program != nullptr)
+            {
+                return;
+            }
+
+            // a cached binary of the same source skips the compilation
+            m_cl_program = ProgramCache::load(ctx, device, kernel_str, options);
+            if (m_cl_program != nullptr)
+            {
+                m_cl_program = ProgramCache::share(ctx, device, m_cl_program, kernel_str, options);
+                return;
+            }
+
             cl_int err;
             const char *kernel_src = kernel_str.c_str();
             size_t kenel_src_length = kernel_str.size();
             m_cl_program = clCreateProgramWithSource(ctx, 1, &kernel_src, &kenel_src_length, &err);
-            err = clBuildProgram(m_cl_program, 1, &device, nullptr, nullptr, nullptr);
+            err = clBuildProgram(m_cl_program, 1, &device, options.c_str(), nullptr, nullptr);
 
             size_t build_log_size = 0;
             clGetProgramBuildInfo(m_cl_program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &build_log_size);
@@ -56,6 +128,8 @@ namespace sgmcl
             {
                 throw std::runtime_error("Cannot build ocl program!");
             }
+            ProgramCache::store(device, m_cl_program, kernel_str, options);
+            m_cl_program = ProgramCache::share(ctx, device, m_cl_program, kernel_str, options);
         }
 
         cl_kernel getKernel(const std::string &name)
@@ -71,7 +145,10 @@ namespace sgmcl
 
         ~DeviceProgram()
         {
-            clReleaseProgram(m_cl_program);
+            if (m_cl_program != nullptr)
+            {
+                ProgramCache::release(m_cl_program);
+            }
         }
 
         bool isInitialized() const
@@ -114,10 +191,11 @@ namespace sgmcl
         DeviceBuffer(const DeviceBuffer &) = delete;
 
         DeviceBuffer(DeviceBuffer &&obj)
-            : m_data(obj.m_data), m_size(obj.m_size)
+            : m_cl_ctx(obj.m_cl_ctx), m_data(obj.m_data), m_size(obj.m_size), m_owns_data(obj.m_owns_data)
         {
             obj.m_data = nullptr;
             obj.m_size = 0;
+            obj.m_owns_data = false;
         }
 
         ~DeviceBuffer()
@@ -136,6 +214,10 @@ namespace sgmcl
             CHECK_OCL_ERROR(err, "Allocating device buffer");
             m_size = n;
             m_owns_data = true;
+            if (m_data)
+            {
+                allocated_device_memory() += sizeof(value_type) * n;
+            }
         }
 
         void destroy()
@@ -144,6 +226,7 @@ namespace sgmcl
             {
                 cl_int err = clReleaseMemObject(m_data);
                 CHECK_OCL_ERROR(err, "Destroying device buffer");
+                allocated_device_memory() -= sizeof(value_type) * m_size;
                 m_data = nullptr;
             }
 
@@ -169,10 +252,17 @@ namespace sgmcl
 
         DeviceBuffer &operator=(DeviceBuffer &&obj)
         {
-            m_data = obj.m_data;
-            m_size = obj.m_size;
-            obj.m_data = nullptr;
-            obj.m_size = 0;
+            if (this != &obj)
+            {
+                destroy();
+                m_cl_ctx = obj.m_cl_ctx;
+                m_data = obj.m_data;
+                m_size = obj.m_size;
+                m_owns_data = obj.m_owns_data;
+                obj.m_data = nullptr;
+                obj.m_size = 0;
+                obj.m_owns_data = false;
+            }
             return *this;
         }
 
@@ -19,10 +19,12 @@ limitations under the License.
 
 #include <cstdint>
 #include <regex>
+#include <string>
 #include <vector>
 #include <fstream>
 
 #include "cl_utilities.h"
+#include "tuning_profile.h"
 
 namespace sgmcl
 {
@@ -35,6 +37,28 @@ namespace sgmcl
         SCAN_8PATH  //>! Horizontal, vertical and oblique paths.
     };
 
+    /**
+         Indicates where the matching is computed.
+        */
+    enum class ExecutionBackend
+    {
+        OPENCL,       //>! OpenCL kernels on the given device.
+        CPU_REFERENCE, //>! Scalar C++ implementation giving the same results as the OpenCL kernels.
+        CPU            //>! Multithreaded (and AVX2 if enabled) C++ implementation, same results as CPU_REFERENCE.
+    };
+
+    /**
+         Colour filter layout of raw camera frames, named like cv::COLOR_Bayer*2GRAY
+         after the colours of the pixels (1, 1) and (2, 1).
+        */
+    enum class BayerPattern
+    {
+        BG,
+        GB,
+        RG,
+        GR
+    };
+
     struct Parameters
     {
         // Penalty on the disparity change by plus or minus 1 between nieghbor pixels.
@@ -51,6 +75,74 @@ namespace sgmcl
         int min_disp = 0;
         // Acceptable difference pixels which is used in LR check consistency. LR check consistency will be disabled if this value is set to negative.
         int LR_max_diff = 1;
+        // Sum every scanline into one uint16 cost volume instead of keeping a uint8 volume per path.
+        // Needs 2 / num_paths of the memory, but the paths are aggregated one after another.
+        bool fused_aggregation = false;
+        // Engine used by StereoSGM. The CPU backends also work without an OpenCL context.
+        ExecutionBackend backend = ExecutionBackend::OPENCL;
+        // Threads of ExecutionBackend::CPU including the calling one, 0 uses every hardware thread.
+        int num_threads = 0;
+        // Frames StereoSGM::execute_async may have in flight, each one gets its own queue and buffers.
+        int pipeline_depth = 1;
+        // Directory of the OpenCL program binary cache, empty disables it. Restarts with a
+        // warm cache load the kernels with clCreateProgramWithBinary instead of compiling them.
+        std::string program_cache_dir;
+        // Create the command queues with CL_QUEUE_PROFILING_ENABLE and time every kernel,
+        // see StereoSGM::get_frame_stats. Adds a little overhead per kernel.
+        bool enable_profiling = false;
+        // Tuning profile written by autotune() with the launch geometry of every kernel on this
+        // device. Empty, missing or measured on another device, the built-in defaults are used.
+        std::string tuning_profile;
+        // Coarse to fine matching with the OpenCL backend, disparity size 128 or 256: a 64 disparity
+        // pass on the pair downsampled by disparity_size / 64 picks a 64 disparity band per pixel
+        // for the full resolution pass. Close to the cost of 64 disparities, but thin structures
+        // lost in the coarse images and occlusion borders may get a wrong band.
+        bool hierarchical = false;
+        // Streaming mode of the OpenCL backend, needs a pipeline depth of 1: every pixel only searches
+        // temporal_band disparities (a power of two from 8 to 64) around its filtered disparity of the
+        // previous frame. The whole range is searched on the first frame, every temporal_refresh_interval
+        // frames (0 never) and after a frame whose share of invalid pixels exceeds the one of the last
+        // full search by more than temporal_max_invalid_growth. Batches always search the whole range.
+        bool temporal_prior = false;
+        int temporal_band = 32;
+        int temporal_refresh_interval = 30;
+        float temporal_max_invalid_growth = 0.05f;
+        // Device memory in bytes the matching engine of a pipeline slot may use, 0 for no limit. When the
+        // engine would need more for the whole image, or its cost volume would exceed
+        // CL_DEVICE_MAX_MEM_ALLOC_SIZE, the OpenCL backend matches horizontal stripes which overlap by
+        // stripe_overlap rows on either side, so the vertical and oblique paths converge before the rows
+        // that are kept. Post processing still runs on the whole image.
+        size_t memory_budget = 0;
+        int stripe_overlap = 64;
+        // Colour filter of the interleaved raw frames given to StereoSGM::execute_interleaved,
+        // GR for the oCamS-1CGN-U.
+        BayerPattern bayer_pattern = BayerPattern::GR;
+    };
+
+    /**
+         Kernel execution times of one frame in milliseconds (CL_PROFILING_COMMAND_START to END).
+         Stages which did not run are 0.
+        */
+    struct FrameStats
+    {
+        // only with StereoSGM::set_rectification_maps
+        double rectify_left = 0.0;
+        double rectify_right = 0.0;
+        // only with StereoSGM::execute_interleaved
+        double deinterleave = 0.0;
+        double census_left = 0.0;
+        double census_right = 0.0;
+        // up->down, down->up, left->right, right->left, then with SCAN_8PATH
+        // upleft->downright, upright->downleft, downright->upleft, downleft->upright
+        double paths[8] = {};
+        int num_paths = 0;
+        double winner_takes_all = 0.0;
+        double median_left = 0.0;
+        double median_right = 0.0;
+        double check_consistency = 0.0;
+        double correct_disparity_range = 0.0;
+        // From the start of the first kernel to the end of the last one, overlapping paths count once.
+        double total = 0.0;
     };
 
     inline constexpr int SubpixelShift()
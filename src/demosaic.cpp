@@ -0,0 +1,87 @@
+#include "demosaic.h"
+#include "sgm_details.h"
+
+namespace sgmcl
+{
+    Demosaic::Demosaic(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device),
+          m_tile_width(tuning.get("details.tile_width", SGMDetails::DEFAULT_TILE_WIDTH)),
+          m_tile_height(tuning.get("details.tile_height", SGMDetails::DEFAULT_TILE_HEIGHT))
+    {
+    }
+
+    Demosaic::~Demosaic()
+    {
+        if (m_kernel)
+        {
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
+        }
+    }
+
+    void Demosaic::enqueue(const DeviceBuffer<uint8_t> &src,
+                           DeviceBuffer<uint8_t> &left,
+                           DeviceBuffer<uint8_t> &right,
+                           int width,
+                           int height,
+                           int batch_size,
+                           BayerPattern pattern,
+                           cl_command_queue stream,
+                           cl_event *event)
+    {
+        if (m_kernel == nullptr)
+        {
+            std::ifstream fileInput1, fileInput2;
+            fileInput1.open("data/ocl/inttypes.cl");
+            fileInput2.open("data/ocl/demosaic.cl");
+            std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                             std::istreambuf_iterator<char>()};
+            std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                             std::istreambuf_iterator<char>()};
+            m_program.init(m_cl_context, m_cl_device_id, src1 + src2);
+            m_kernel = m_program.getKernel("deinterleave_bayer_kernel");
+        }
+
+        // position of the red pixels in the 2x2 cell, OpenCV names the colours of (1, 1) and (2, 1)
+        int red_x = 0;
+        int red_y = 0;
+        switch (pattern)
+        {
+        case BayerPattern::BG:
+            break;
+        case BayerPattern::GB:
+            red_x = 1;
+            break;
+        case BayerPattern::RG:
+            red_x = 1;
+            red_y = 1;
+            break;
+        case BayerPattern::GR:
+            red_y = 1;
+            break;
+        }
+
+        cl_int err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &left.data());
+        err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &right.data());
+        err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &src.data());
+        err = clSetKernelArg(m_kernel, 3, sizeof(width), &width);
+        err = clSetKernelArg(m_kernel, 4, sizeof(height), &height);
+        err = clSetKernelArg(m_kernel, 5, sizeof(red_x), &red_x);
+        err = clSetKernelArg(m_kernel, 6, sizeof(red_y), &red_y);
+
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_kernel,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing deinterleave kernel");
+    }
+} // namespace sgmcl
@@ -0,0 +1,38 @@
+#include "common.h"
+
+namespace sgmcl
+{
+
+    /**
+        Converts interleaved raw stereo frames (one byte of each camera per pixel, the Bayer
+        mosaic of the right camera first) to the two gray images the matching reads.
+        */
+    class Demosaic
+    {
+    public:
+        Demosaic(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
+        ~Demosaic();
+
+        // src holds batch_size frames of width x height byte pairs, left and right get
+        // batch_size images of width x height bytes.
+        void enqueue(const DeviceBuffer<uint8_t> &src,
+                     DeviceBuffer<uint8_t> &left,
+                     DeviceBuffer<uint8_t> &right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     BayerPattern pattern,
+                     cl_command_queue stream,
+                     cl_event *event = nullptr);
+
+    private:
+        cl_context m_cl_context = nullptr;
+        cl_device_id m_cl_device_id = nullptr;
+
+        DeviceProgram m_program;
+        cl_kernel m_kernel = nullptr;
+
+        size_t m_tile_width;
+        size_t m_tile_height;
+    };
+} // namespace sgmcl
@@ -0,0 +1,153 @@
+#include "libsgm_ocl.h"
+
+namespace sgmcl
+{
+    namespace
+    {
+        int floor_div(int a, int b)
+        {
+            return a >= 0 ? a / b : -((-a + b - 1) / b);
+        }
+    } // namespace
+
+    HierarchicalSemiGlobalMatching::HierarchicalSemiGlobalMatching(cl_context ctx,
+                                                                   cl_device_id device,
+                                                                   int disparity_size,
+                                                                   cl_command_queue_properties queue_properties,
+                                                                   const TuningProfile &tuning)
+        : m_disparity_size(disparity_size),
+          m_factor(disparity_size / 64),
+          m_coarse(ctx, device, queue_properties, tuning),
+          m_coarse_details(ctx, device, tuning),
+          m_pyramid(ctx, device, BandedAggregation::DEFAULT_BAND_WIDTH, tuning),
+          m_census(ctx, device, tuning),
+          m_aggregation(ctx, device, BandedAggregation::DEFAULT_BAND_WIDTH, tuning),
+          m_coarse_left(ctx), m_coarse_right(ctx),
+          m_coarse_feature_left(ctx), m_coarse_feature_right(ctx),
+          m_coarse_tmp_left(ctx), m_coarse_tmp_right(ctx),
+          m_coarse_disp_left(ctx), m_coarse_disp_right(ctx),
+          m_band(ctx)
+    {
+        if (disparity_size != 128 && disparity_size != 256)
+        {
+            throw std::logic_error("hierarchical matching needs a disparity size of 128 or 256");
+        }
+    }
+
+    void HierarchicalSemiGlobalMatching::execute(DeviceBuffer<uint16_t> &dest_left,
+                                                 DeviceBuffer<uint16_t> &dest_right,
+                                                 const DeviceBuffer<uint8_t> &src_left,
+                                                 const DeviceBuffer<uint8_t> &src_right,
+                                                 DeviceBuffer<uint32_t> &feature_buffer_left,
+                                                 DeviceBuffer<uint32_t> &feature_buffer_right,
+                                                 int width,
+                                                 int height,
+                                                 int batch_size,
+                                                 int src_pitch,
+                                                 int dst_pitch,
+                                                 const Parameters &param,
+                                                 cl_command_queue queue,
+                                                 StageEvents *events)
+    {
+        const int coarse_width = width / m_factor;
+        const int coarse_height = height / m_factor;
+        if (coarse_width < 1 || coarse_height < 1)
+        {
+            throw std::logic_error("image is too small for hierarchical matching");
+        }
+
+        const size_t coarse_pixels = static_cast<size_t>(coarse_width) * coarse_height * batch_size;
+        if (m_coarse_left.size() < coarse_pixels)
+        {
+            m_coarse_left.allocate(coarse_pixels);
+            m_coarse_right.allocate(coarse_pixels);
+            m_coarse_feature_left.allocate(coarse_pixels);
+            m_coarse_feature_right.allocate(coarse_pixels);
+            m_coarse_tmp_left.allocate(coarse_pixels);
+            m_coarse_tmp_right.allocate(coarse_pixels);
+            m_coarse_disp_left.allocate(coarse_pixels);
+            m_coarse_disp_right.allocate(coarse_pixels);
+
+            // census leaves the border untouched, keep it deterministic
+            m_coarse_feature_left.fillZero(queue);
+            m_coarse_feature_right.fillZero(queue);
+        }
+        m_band.allocate(static_cast<size_t>(width) * height * batch_size);
+
+        // coarse level, the disparity range of the full level in 64 steps of m_factor
+        m_pyramid.downsample(src_left, m_coarse_left, width, height, batch_size, src_pitch, m_factor, queue);
+        m_pyramid.downsample(src_right, m_coarse_right, width, height, batch_size, src_pitch, m_factor, queue);
+
+        Parameters coarse_param = param;
+        coarse_param.subpixel = false;
+        coarse_param.min_disp = floor_div(param.min_disp, m_factor);
+        m_coarse.execute(m_coarse_tmp_left,
+                         m_coarse_tmp_right,
+                         m_coarse_left,
+                         m_coarse_right,
+                         m_coarse_feature_left,
+                         m_coarse_feature_right,
+                         coarse_width,
+                         coarse_height,
+                         batch_size,
+                         coarse_width,
+                         coarse_width,
+                         coarse_param,
+                         queue,
+                         nullptr);
+        m_coarse_details.median_filter(m_coarse_tmp_left, m_coarse_disp_left, coarse_width, coarse_height, batch_size, coarse_width, queue);
+        m_coarse_details.median_filter(m_coarse_tmp_right, m_coarse_disp_right, coarse_width, coarse_height, batch_size, coarse_width, queue);
+        // inconsistent coarse pixels are filled from their neighbours instead of trusted
+        m_coarse_details.check_consistency(m_coarse_disp_left,
+                                           m_coarse_disp_right,
+                                           m_coarse_left,
+                                           coarse_width,
+                                           coarse_height,
+                                           batch_size,
+                                           coarse_width,
+                                           coarse_width,
+                                           false,
+                                           param.LR_max_diff,
+                                           queue);
+
+        const int coarse_base = coarse_param.min_disp * m_factor - param.min_disp;
+        m_pyramid.disparity_band(m_band,
+                                 m_coarse_disp_left,
+                                 width,
+                                 height,
+                                 batch_size,
+                                 m_factor,
+                                 0,
+                                 coarse_base,
+                                 m_disparity_size - static_cast<int>(m_aggregation.band_width()),
+                                 queue);
+
+        // full level
+        m_census.enqueue(src_left, feature_buffer_left, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_left : nullptr);
+        m_census.enqueue(src_right, feature_buffer_right, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_right : nullptr);
+        if (events)
+        {
+            events->num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        }
+        m_aggregation.enqueue(feature_buffer_left,
+                              feature_buffer_right,
+                              m_band,
+                              width, height, batch_size,
+                              param.path_type,
+                              param.P1,
+                              param.P2,
+                              param.min_disp,
+                              param.fused_aggregation,
+                              queue,
+                              events ? events->paths : nullptr);
+        m_aggregation.winner_takes_all(dest_left, dest_right,
+                                       m_band,
+                                       width, height, batch_size, dst_pitch,
+                                       param.uniqueness, param.subpixel, param.path_type,
+                                       param.fused_aggregation,
+                                       queue,
+                                       events ? &events->winner_takes_all : nullptr);
+    }
+} // namespace sgmcl
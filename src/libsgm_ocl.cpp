@@ -1,10 +1,42 @@
 #include "libsgm_ocl.h"
 
+#include <cstring>
+#include <limits>
+
 namespace sgmcl
 {
+    StageEvents::~StageEvents()
+    {
+        release();
+    }
+
+    void StageEvents::release()
+    {
+        cl_event *all[] = {&deinterleave, &rectify_left, &rectify_right,
+                           &census_left, &census_right,
+                           &paths[0], &paths[1], &paths[2], &paths[3],
+                           &paths[4], &paths[5], &paths[6], &paths[7],
+                           &winner_takes_all, &median_left, &median_right,
+                           &check_consistency, &correct_disparity_range};
+        for (cl_event *event : all)
+        {
+            if (*event)
+            {
+                clReleaseEvent(*event);
+                *event = nullptr;
+            }
+        }
+        num_paths = 0;
+    }
+
     template <size_t MAX_DISPARITY>
-    SemiGlobalMatching<MAX_DISPARITY>::SemiGlobalMatching(cl_context ctx, cl_device_id device)
-        : m_census(ctx, device), m_path_aggregation(ctx, device), m_winner_takes_all(ctx, device)
+    SemiGlobalMatching<MAX_DISPARITY>::SemiGlobalMatching(cl_context ctx,
+                                                          cl_device_id device,
+                                                          cl_command_queue_properties queue_properties,
+                                                          const TuningProfile &tuning)
+        : m_census(ctx, device, tuning),
+          m_path_aggregation(ctx, device, queue_properties, tuning),
+          m_winner_takes_all(ctx, device, tuning)
     {
     }
 
@@ -17,52 +49,338 @@ namespace sgmcl
                                                     DeviceBuffer<uint32_t> &feature_buffer_right,
                                                     int width,
                                                     int height,
+                                                    int batch_size,
                                                     int src_pitch,
                                                     int dst_pitch,
                                                     const Parameters &param,
-                                                    cl_command_queue queue)
+                                                    cl_command_queue queue,
+                                                    StageEvents *events)
     {
-        m_census.enqueue(src_left, feature_buffer_left, width, height, src_pitch, queue);
-        m_census.enqueue(src_right, feature_buffer_right, width, height, src_pitch, queue);
+        m_census.enqueue(src_left, feature_buffer_left, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_left : nullptr);
+        m_census.enqueue(src_right, feature_buffer_right, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_right : nullptr);
+        if (events)
+        {
+            events->num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        }
         m_path_aggregation.enqueue(feature_buffer_left,
                                    feature_buffer_right,
-                                   width, height,
+                                   width, height, batch_size,
                                    param.path_type,
                                    param.P1,
                                    param.P2,
                                    param.min_disp,
-                                   queue);
-        m_winner_takes_all.enqueue(dest_left, dest_right,
-                                   m_path_aggregation.get_output(),
-                                   width, height, dst_pitch,
-                                   param.uniqueness, param.subpixel, param.path_type,
-                                   queue);
+                                   param.fused_aggregation,
+                                   queue,
+                                   events ? events->paths : nullptr);
+        if (param.fused_aggregation)
+        {
+            m_winner_takes_all.enqueue(dest_left, dest_right,
+                                       m_path_aggregation.get_fused_output(),
+                                       width, height, batch_size, dst_pitch,
+                                       param.uniqueness, param.subpixel, param.path_type,
+                                       queue,
+                                       events ? &events->winner_takes_all : nullptr);
+        }
+        else
+        {
+            m_winner_takes_all.enqueue(dest_left, dest_right,
+                                       m_path_aggregation.get_output(),
+                                       width, height, batch_size, dst_pitch,
+                                       param.uniqueness, param.subpixel, param.path_type,
+                                       queue,
+                                       events ? &events->winner_takes_all : nullptr);
+        }
     }
 
     template class SemiGlobalMatching<64>;
     template class SemiGlobalMatching<128>;
     template class SemiGlobalMatching<256>;
 
+    void HostSemiGlobalMatchingBase::execute(DeviceBuffer<uint16_t> &dest_left,
+                                            DeviceBuffer<uint16_t> &dest_right,
+                                            const DeviceBuffer<uint8_t> &src_left,
+                                            const DeviceBuffer<uint8_t> &src_right,
+                                            DeviceBuffer<uint32_t> & /*feature_buffer_left*/,
+                                            DeviceBuffer<uint32_t> & /*feature_buffer_right*/,
+                                            int width,
+                                            int height,
+                                            int batch_size,
+                                            int src_pitch,
+                                            int dst_pitch,
+                                            const Parameters &param,
+                                            cl_command_queue queue,
+                                            StageEvents * /*events*/)
+    {
+        const size_t src_size = static_cast<size_t>(src_pitch) * height;
+        const size_t dst_size = static_cast<size_t>(dst_pitch) * height;
+        m_src_left.resize(src_size * batch_size);
+        m_src_right.resize(src_size * batch_size);
+        m_dest_left.resize(dst_size * batch_size);
+        m_dest_right.resize(dst_size * batch_size);
+
+        cl_int err = clEnqueueReadBuffer(queue, src_left.data(), true, 0, m_src_left.size(), m_src_left.data(), 0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error reading left image");
+        err = clEnqueueReadBuffer(queue, src_right.data(), true, 0, m_src_right.size(), m_src_right.data(), 0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error reading right image");
+
+        for (int i = 0; i < batch_size; ++i)
+        {
+            execute_host(m_dest_left.data() + i * dst_size, m_dest_right.data() + i * dst_size,
+                         m_src_left.data() + i * src_size, m_src_right.data() + i * src_size,
+                         width, height, src_pitch, dst_pitch, param);
+        }
+
+        err = clEnqueueWriteBuffer(queue, dest_left.data(), true, 0, m_dest_left.size() * sizeof(uint16_t), m_dest_left.data(), 0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error writing left disparity");
+        err = clEnqueueWriteBuffer(queue, dest_right.data(), true, 0, m_dest_right.size() * sizeof(uint16_t), m_dest_right.data(), 0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error writing right disparity");
+    }
+
+    template <size_t MAX_DISPARITY>
+    void ReferenceSemiGlobalMatching<MAX_DISPARITY>::execute_host(uint16_t *dest_left,
+                                                                  uint16_t *dest_right,
+                                                                  const uint8_t *src_left,
+                                                                  const uint8_t *src_right,
+                                                                  int width,
+                                                                  int height,
+                                                                  int src_pitch,
+                                                                  int dst_pitch,
+                                                                  const Parameters &param)
+    {
+        m_feature_left.resize(width * height);
+        m_feature_right.resize(width * height);
+        m_cost_sum.assign(static_cast<size_t>(width) * height * MAX_DISPARITY, 0);
+
+        reference::census_transform(src_left, m_feature_left.data(), width, height, src_pitch);
+        reference::census_transform(src_right, m_feature_right.data(), width, height, src_pitch);
+
+        // same (dx, dy) directions as the PathAggregation members
+        static const int directions[8][2] = {
+            {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+        const int num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        for (int i = 0; i < num_paths; ++i)
+        {
+            reference::aggregate_path<MAX_DISPARITY>(m_cost_sum.data(),
+                                                     m_feature_left.data(),
+                                                     m_feature_right.data(),
+                                                     width, height,
+                                                     directions[i][0], directions[i][1],
+                                                     param.P1, param.P2, param.min_disp);
+        }
+
+        reference::winner_takes_all<MAX_DISPARITY>(dest_left, dest_right,
+                                                   m_cost_sum.data(),
+                                                   width, height, dst_pitch,
+                                                   param.uniqueness, param.subpixel);
+    }
+
+    template class ReferenceSemiGlobalMatching<64>;
+    template class ReferenceSemiGlobalMatching<128>;
+    template class ReferenceSemiGlobalMatching<256>;
+
+    template <size_t MAX_DISPARITY>
+    CpuSemiGlobalMatching<MAX_DISPARITY>::CpuSemiGlobalMatching(unsigned int num_threads)
+        : m_pool(num_threads)
+    {
+    }
+
+    template <size_t MAX_DISPARITY>
+    void CpuSemiGlobalMatching<MAX_DISPARITY>::execute_host(uint16_t *dest_left,
+                                                            uint16_t *dest_right,
+                                                            const uint8_t *src_left,
+                                                            const uint8_t *src_right,
+                                                            int width,
+                                                            int height,
+                                                            int src_pitch,
+                                                            int dst_pitch,
+                                                            const Parameters &param)
+    {
+        const size_t num_pixels = static_cast<size_t>(width) * height;
+        m_feature_left.resize(num_pixels);
+        m_feature_right.resize(num_pixels);
+        m_cost_sum.resize(num_pixels * MAX_DISPARITY);
+
+        uint16_t *cost_sum = m_cost_sum.data();
+        m_pool.parallel_for(0, height, [&](int y) {
+            std::fill(cost_sum + static_cast<size_t>(y) * width * MAX_DISPARITY,
+                      cost_sum + static_cast<size_t>(y + 1) * width * MAX_DISPARITY, 0);
+        });
+
+        cpu::census_transform(m_pool, src_left, m_feature_left.data(), width, height, src_pitch);
+        cpu::census_transform(m_pool, src_right, m_feature_right.data(), width, height, src_pitch);
+
+        // directions run one after another, each one is parallel over its scanlines
+        static const int directions[8][2] = {
+            {0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+        const int num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        for (int i = 0; i < num_paths; ++i)
+        {
+            cpu::aggregate_path<MAX_DISPARITY>(m_pool,
+                                               cost_sum,
+                                               m_feature_left.data(),
+                                               m_feature_right.data(),
+                                               width, height,
+                                               directions[i][0], directions[i][1],
+                                               param.P1, param.P2, param.min_disp);
+        }
+
+        cpu::winner_takes_all<MAX_DISPARITY>(m_pool,
+                                             dest_left, dest_right,
+                                             cost_sum,
+                                             width, height, dst_pitch,
+                                             param.uniqueness, param.subpixel);
+    }
+
+    template class CpuSemiGlobalMatching<64>;
+    template class CpuSemiGlobalMatching<128>;
+    template class CpuSemiGlobalMatching<256>;
+
+    StereoSGM::FrameResources::FrameResources(cl_context ctx)
+        : feature_buffer_left(ctx), feature_buffer_right(ctx),
+          right_disp(ctx), tmp_left_disp(ctx), tmp_right_disp(ctx),
+          stripe_left(ctx), stripe_right(ctx), stripe_disp_left(ctx), stripe_disp_right(ctx),
+          gray_left(ctx), gray_right(ctx), rect_left(ctx), rect_right(ctx)
+    {
+    }
+
+    StereoSGM::FrameResources::~FrameResources()
+    {
+        // kernels of this frame may still use the buffers
+        if (queue)
+        {
+            clFinish(queue);
+        }
+        engine.reset();
+        if (queue)
+        {
+            clReleaseCommandQueue(queue);
+            queue = nullptr;
+        }
+    }
+
+    static std::unique_ptr<SemiGlobalMatchingBase> create_engine(int disparity_size,
+                                                                 const Parameters &param,
+                                                                 cl_context ctx,
+                                                                 cl_device_id cl_device,
+                                                                 const TuningProfile &tuning)
+    {
+        if (param.backend == ExecutionBackend::CPU)
+        {
+            const unsigned int num_threads = static_cast<unsigned int>(std::max(param.num_threads, 0));
+            if (disparity_size == 64)
+                return std::make_unique<CpuSemiGlobalMatching<64>>(num_threads);
+            else if (disparity_size == 128)
+                return std::make_unique<CpuSemiGlobalMatching<128>>(num_threads);
+            else
+                return std::make_unique<CpuSemiGlobalMatching<256>>(num_threads);
+        }
+        if (param.backend == ExecutionBackend::CPU_REFERENCE)
+        {
+            if (disparity_size == 64)
+                return std::make_unique<ReferenceSemiGlobalMatching<64>>();
+            else if (disparity_size == 128)
+                return std::make_unique<ReferenceSemiGlobalMatching<128>>();
+            else
+                return std::make_unique<ReferenceSemiGlobalMatching<256>>();
+        }
+
+        const cl_command_queue_properties queue_properties = param.enable_profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+        std::unique_ptr<SemiGlobalMatchingBase> engine;
+        if (param.hierarchical)
+            engine = std::make_unique<HierarchicalSemiGlobalMatching>(ctx, cl_device, disparity_size, queue_properties, tuning);
+        else if (disparity_size == 64)
+            engine = std::make_unique<SemiGlobalMatching<64>>(ctx, cl_device, queue_properties, tuning);
+        else if (disparity_size == 128)
+            engine = std::make_unique<SemiGlobalMatching<128>>(ctx, cl_device, queue_properties, tuning);
+        else
+            engine = std::make_unique<SemiGlobalMatching<256>>(ctx, cl_device, queue_properties, tuning);
+
+        // the full range engine still searches the first and the refresh frames
+        if (param.temporal_prior)
+            engine = std::make_unique<TemporalSemiGlobalMatching>(ctx, cl_device, disparity_size, param.temporal_band,
+                                                                  std::move(engine), tuning);
+        return engine;
+    }
+
+    // Device memory of the OpenCL engine per pixel: its cost volume, the largest single
+    // allocation, and in total with the images, census features and disparities.
+    static void engine_memory(int disparity_size, const Parameters &param, size_t &volume_bytes, size_t &engine_bytes)
+    {
+        const size_t num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        const size_t volumes = param.fused_aggregation ? 2 : num_paths;
+        if (param.hierarchical)
+        {
+            // plus the coarse level and the band start
+            const size_t factor = disparity_size / 64;
+            volume_bytes = BandedAggregation::DEFAULT_BAND_WIDTH * volumes;
+            engine_bytes = volume_bytes + (64 * volumes + 2 + 8 + 8) / (factor * factor) + 2 + 4;
+        }
+        else
+        {
+            volume_bytes = disparity_size * volumes;
+            engine_bytes = volume_bytes;
+        }
+        engine_bytes += 2 * sizeof(uint8_t) + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+    }
+
+    // rows [src_row, src_row + rows) of every image of a batch to the rows from dst_row on
+    static void copy_rows(cl_command_queue queue,
+                          cl_mem src,
+                          cl_mem dst,
+                          size_t row_bytes,
+                          int src_row,
+                          int dst_row,
+                          int rows,
+                          int src_height,
+                          int dst_height,
+                          int batch_size)
+    {
+        const size_t src_origin[3] = {0, static_cast<size_t>(src_row), 0};
+        const size_t dst_origin[3] = {0, static_cast<size_t>(dst_row), 0};
+        const size_t region[3] = {row_bytes, static_cast<size_t>(rows), static_cast<size_t>(batch_size)};
+        cl_int err = clEnqueueCopyBufferRect(queue, src, dst, src_origin, dst_origin, region,
+                                             row_bytes, row_bytes * src_height,
+                                             row_bytes, row_bytes * dst_height,
+                                             0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error copying stripe rows");
+    }
+
+    static TuningProfile load_tuning_profile(const Parameters &param, cl_device_id cl_device)
+    {
+        TuningProfile tuning;
+        if (param.backend == ExecutionBackend::OPENCL && !param.tuning_profile.empty())
+        {
+            // a missing or foreign profile keeps the built-in geometry
+            tuning.load(param.tuning_profile, cl_device);
+        }
+        return tuning;
+    }
+
     StereoSGM::StereoSGM(int width,
                          int height,
                          int disparity_size,
                          cl_context ctx,
                          cl_device_id cl_device,
                          Parameters param)
-        : m_width(width), m_height(height),
-          m_cl_ctx(ctx), m_cl_device(cl_device), m_params(param),
-          d_feature_buffer_left(ctx), d_feature_buffer_right(ctx),
-          d_src_left(ctx), d_src_right(ctx),
-          d_left_disp(ctx), d_right_disp(ctx),
-          d_tmp_left_disp(ctx), d_tmp_right_disp(ctx),
-          d_u8_out_disp(ctx), sgm_details(ctx, cl_device)
+        : StereoSGM(width, height, disparity_size, ctx, cl_device, param, load_tuning_profile(param, cl_device))
     {
-        //create command queue
-
-        cl_int err;
-        m_cl_cmd_queue = clCreateCommandQueue(m_cl_ctx, m_cl_device, 0, &err);
-        CHECK_OCL_ERROR(err, "Failed to create command queue");
+    }
 
+    StereoSGM::StereoSGM(int width,
+                         int height,
+                         int disparity_size,
+                         cl_context ctx,
+                         cl_device_id cl_device,
+                         Parameters param,
+                         const TuningProfile &tuning)
+        : m_width(width), m_height(height), m_stripe_height(height),
+          m_cl_ctx(ctx), m_cl_device(cl_device), m_params(param),
+          m_tuning(tuning), sgm_details(ctx, cl_device, m_tuning),
+          m_rectification(ctx, cl_device, m_tuning), m_demosaic(ctx, cl_device, m_tuning),
+          m_prior_disp(ctx), m_invalid_count(ctx)
+    {
         // check values
         if (disparity_size != 64 && disparity_size != 128 && disparity_size != 256)
         {
@@ -72,93 +390,817 @@ namespace sgmcl
         {
             throw std::logic_error("Path type must be PathType::SCAN_4PATH or PathType::SCAN_8PATH");
         }
+        if (param.pipeline_depth < 1)
+        {
+            throw std::logic_error("pipeline depth must be at least 1");
+        }
+        if (param.hierarchical && param.backend != ExecutionBackend::OPENCL)
+        {
+            throw std::logic_error("hierarchical matching needs the OpenCL backend");
+        }
+        if (param.hierarchical && disparity_size == 64)
+        {
+            throw std::logic_error("hierarchical matching needs a disparity size of 128 or 256");
+        }
+        if (param.temporal_prior)
+        {
+            if (param.backend != ExecutionBackend::OPENCL)
+            {
+                throw std::logic_error("temporal prior needs the OpenCL backend");
+            }
+            // every frame starts from the filtered disparity of the one before
+            if (param.pipeline_depth != 1)
+            {
+                throw std::logic_error("temporal prior needs a pipeline depth of 1");
+            }
+            const int band = param.temporal_band;
+            if (band < 8 || band > 64 || band > disparity_size || (band & (band - 1)) != 0)
+            {
+                throw std::logic_error("temporal band must be a power of two from 8 to 64, at most the disparity size");
+            }
+        }
+        if (param.stripe_overlap < 0)
+        {
+            throw std::logic_error("stripe overlap must not be negative");
+        }
+        if (!param.program_cache_dir.empty())
+        {
+            ProgramCache::setDirectory(param.program_cache_dir);
+        }
 
-        if (disparity_size == 64)
-            sgm_engine = std::make_unique<SemiGlobalMatching<64>>(ctx, cl_device);
-        else if (disparity_size == 128)
-            sgm_engine = std::make_unique<SemiGlobalMatching<128>>(ctx, cl_device);
-        else if (disparity_size == 256)
-            sgm_engine = std::make_unique<SemiGlobalMatching<256>>(ctx, cl_device);
-        else
-            throw std::logic_error("depth bits must be 8 or 16, and disparity size must be 64 or 128");
+        if (param.backend == ExecutionBackend::OPENCL)
+        {
+            cl_ulong max_alloc = 0;
+            cl_int err = clGetDeviceInfo(m_cl_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, nullptr);
+            CHECK_OCL_ERROR(err, "Error querying device allocation limit");
+            m_max_alloc = static_cast<size_t>(max_alloc);
+            engine_memory(disparity_size, param, m_volume_bytes_per_pixel, m_engine_bytes_per_pixel);
+            // throws here already if a stripe cannot fit
+            m_stripe_height = stripe_height(1);
+        }
+
+        // the CPU backends compute before returning, one frame is enough
+        const int pipeline_depth = param.backend == ExecutionBackend::OPENCL ? param.pipeline_depth : 1;
+        for (int i = 0; i < pipeline_depth; ++i)
+        {
+            auto frame = std::make_unique<FrameResources>(ctx);
+
+            //create command queue, the CPU backend only needs one for cl_mem inputs
+            if (param.backend == ExecutionBackend::OPENCL || m_cl_ctx != nullptr)
+            {
+                cl_int err;
+                const cl_command_queue_properties properties = param.enable_profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+                frame->queue = clCreateCommandQueue(m_cl_ctx, m_cl_device, properties, &err);
+                CHECK_OCL_ERROR(err, "Failed to create command queue");
+            }
 
-        d_feature_buffer_left.allocate(static_cast<size_t>(m_width * m_height));
-        d_feature_buffer_right.allocate(static_cast<size_t>(m_width * m_height));
+            frame->engine = create_engine(disparity_size, param, ctx, cl_device, m_tuning);
+            frame->temporal = dynamic_cast<TemporalSemiGlobalMatching *>(frame->engine.get());
 
-        d_left_disp.allocate(m_width * m_height);
-        d_right_disp.allocate(m_width * m_height);
-        d_tmp_left_disp.allocate(m_width * m_height);
-        d_tmp_right_disp.allocate(m_width * m_height);
+            if (param.backend == ExecutionBackend::OPENCL)
+            {
+                // the engine works on one stripe at a time
+                const size_t stripe_pixels = static_cast<size_t>(m_width) * m_stripe_height;
+                frame->feature_buffer_left.allocate(stripe_pixels);
+                frame->feature_buffer_right.allocate(stripe_pixels);
+                if (m_stripe_height < m_height)
+                {
+                    frame->stripe_left.allocate(stripe_pixels);
+                    frame->stripe_right.allocate(stripe_pixels);
+                    frame->stripe_disp_left.allocate(stripe_pixels);
+                    frame->stripe_disp_right.allocate(stripe_pixels);
+                }
+                frame->right_disp.allocate(m_width * m_height);
+                frame->tmp_left_disp.allocate(m_width * m_height);
+                frame->tmp_right_disp.allocate(m_width * m_height);
 
-        d_left_disp.fillZero(m_cl_cmd_queue);
-        d_right_disp.fillZero(m_cl_cmd_queue);
-        d_tmp_left_disp.fillZero(m_cl_cmd_queue);
-        d_tmp_right_disp.fillZero(m_cl_cmd_queue);
+                // census leaves the border untouched, keep it deterministic
+                frame->feature_buffer_left.fillZero(frame->queue);
+                frame->feature_buffer_right.fillZero(frame->queue);
+                frame->right_disp.fillZero(frame->queue);
+                frame->tmp_left_disp.fillZero(frame->queue);
+                frame->tmp_right_disp.fillZero(frame->queue);
+            }
+            m_frames.push_back(std::move(frame));
+        }
+
+        if (param.backend == ExecutionBackend::OPENCL)
+        {
+            // USE_HOST_PTR only avoids copies for pointers with this alignment
+            cl_uint align_bits = 0;
+            cl_int err = clGetDeviceInfo(m_cl_device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, nullptr);
+            CHECK_OCL_ERROR(err, "Error querying device alignment");
+            m_host_ptr_alignment = std::max<size_t>(align_bits / 8, 1);
+        }
+        else
+        {
+            h_left.resize(m_width * m_height);
+            h_right.resize(m_width * m_height);
+            h_disp.resize(m_width * m_height);
+            h_right_disp.resize(m_width * m_height);
+            h_tmp_left_disp.resize(m_width * m_height);
+            h_tmp_right_disp.resize(m_width * m_height);
+        }
     }
 
     StereoSGM::~StereoSGM()
     {
-        sgm_engine.reset();
+        reset_temporal_prior();
+        m_frames.clear();
+    }
+
+    void StereoSGM::reset_temporal_prior()
+    {
+        if (m_invalid_count_read)
+        {
+            // the read writes m_invalid_count_host
+            clWaitForEvents(1, &m_invalid_count_read);
+            clReleaseEvent(m_invalid_count_read);
+            m_invalid_count_read = nullptr;
+        }
+        // the next full search measures the new scene
+        m_prior_valid = false;
+        m_frames_since_full_search = 0;
+        m_full_search_invalid_ratio = 0.0;
+    }
+
+    bool StereoSGM::search_temporal_band()
+    {
+        // the invalid count of an earlier frame, used once it has arrived
+        if (m_invalid_count_read)
+        {
+            cl_int status = CL_QUEUED;
+            clGetEventInfo(m_invalid_count_read, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+            if (status == CL_COMPLETE)
+            {
+                const double ratio = static_cast<double>(m_invalid_count_host) / (static_cast<double>(m_width) * m_height);
+                if (m_invalid_count_full_search)
+                {
+                    m_full_search_invalid_ratio = ratio;
+                }
+                else if (ratio > m_full_search_invalid_ratio + m_params.temporal_max_invalid_growth)
+                {
+                    // the prior lost track, e.g. after a cut or fast motion
+                    m_prior_valid = false;
+                }
+            }
+            // negative status is a failed read, which is simply dropped
+            if (status <= CL_COMPLETE)
+            {
+                clReleaseEvent(m_invalid_count_read);
+                m_invalid_count_read = nullptr;
+            }
+        }
+
+        ++m_frames_since_full_search;
+        if (!m_prior_valid ||
+            (m_params.temporal_refresh_interval > 0 && m_frames_since_full_search >= m_params.temporal_refresh_interval))
+        {
+            m_frames_since_full_search = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void StereoSGM::update_temporal_prior(FrameResources &frame, const DeviceBuffer<uint16_t> &disp, bool searched_band)
+    {
+        const size_t image_size = static_cast<size_t>(m_width) * m_height;
+        m_prior_disp.allocate(image_size);
+        cl_int err = clEnqueueCopyBuffer(frame.queue, disp.data(), m_prior_disp.data(), 0, 0,
+                                         image_size * sizeof(uint16_t), 0, nullptr, nullptr);
+        CHECK_OCL_ERROR(err, "Error storing the temporal prior");
+        m_prior_valid = true;
+
+        // one count in flight, frames finishing meanwhile are not counted
+        if (m_invalid_count_read == nullptr)
+        {
+            m_invalid_count.allocate(1);
+            sgm_details.count_invalid(disp, m_invalid_count, m_width, m_height, 1, m_width, frame.queue);
+            err = clEnqueueReadBuffer(frame.queue, m_invalid_count.data(), CL_FALSE, 0, sizeof(cl_uint),
+                                      &m_invalid_count_host, 0, nullptr, &m_invalid_count_read);
+            CHECK_OCL_ERROR(err, "Error reading the invalid pixel count");
+            m_invalid_count_full_search = !searched_band;
+        }
+    }
+
+    StereoSGM::HostImage::~HostImage()
+    {
+        release();
+    }
+
+    void StereoSGM::HostImage::release()
+    {
+        if (mem)
+        {
+            clReleaseMemObject(mem);
+            mem = nullptr;
+        }
+        ptr = nullptr;
+        size = 0;
+        staging = false;
+    }
+
+    void StereoSGM::HostImage::bind(cl_context ctx, const void *host_ptr, size_t n, cl_mem_flags flags, size_t alignment)
+    {
+        const bool wrap = reinterpret_cast<uintptr_t>(host_ptr) % alignment == 0;
+        if (mem && size == n && (wrap ? !staging && ptr == host_ptr : staging))
+        {
+            return;
+        }
+
+        release();
+        cl_int err;
+        if (wrap)
+        {
+            // the buffer only reads host_ptr when flags say so, the const_cast is safe
+            mem = clCreateBuffer(ctx, flags | CL_MEM_USE_HOST_PTR, n, const_cast<void *>(host_ptr), &err);
+        }
+        else
+        {
+            mem = clCreateBuffer(ctx, flags | CL_MEM_ALLOC_HOST_PTR, n, nullptr, &err);
+        }
+        CHECK_OCL_ERROR(err, "Error creating host image buffer");
+        ptr = wrap ? host_ptr : nullptr;
+        size = n;
+        staging = !wrap;
+    }
+
+    cl_mem StereoSGM::upload_host_image(HostImage &image, const void *src, size_t n, cl_command_queue queue, cl_event *event)
+    {
+        image.bind(m_cl_ctx, src, n, CL_MEM_READ_ONLY, m_host_ptr_alignment);
+
+        // mapping a USE_HOST_PTR buffer returns src itself, the unmap makes the device see it
+        cl_int err;
+        void *mapped = clEnqueueMapBuffer(queue, image.mem, true, CL_MAP_WRITE_INVALIDATE_REGION, 0, n, 0, nullptr, nullptr, &err);
+        CHECK_OCL_ERROR(err, "Error mapping input image");
+        if (image.staging)
+        {
+            std::memcpy(mapped, src, n);
+        }
+        err = clEnqueueUnmapMemObject(queue, image.mem, mapped, 0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error unmapping input image");
+        return image.mem;
+    }
+
+    void StereoSGM::download_host_image(HostImage &image, void *dst, size_t n, cl_command_queue queue, cl_event ready)
+    {
+        cl_int err;
+        void *mapped = clEnqueueMapBuffer(queue, image.mem, true, CL_MAP_READ, 0, n, 1, &ready, nullptr, &err);
+        CHECK_OCL_ERROR(err, "Error mapping disparity");
+        if (image.staging)
+        {
+            std::memcpy(dst, mapped, n);
+        }
+        cl_event unmapped = nullptr;
+        err = clEnqueueUnmapMemObject(queue, image.mem, mapped, 0, nullptr, &unmapped);
+        CHECK_OCL_ERROR(err, "Error unmapping disparity");
+        // the next frame may write the buffer from another queue
+        err = clWaitForEvents(1, &unmapped);
+        clReleaseEvent(unmapped);
+        CHECK_OCL_ERROR(err, "Error waiting for disparity unmap");
+    }
+
+    void StereoSGM::prepare(bool interleaved)
+    {
+        const size_t image_size = m_width * m_height;
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            if (interleaved)
+            {
+                throw std::logic_error("interleaved input needs the OpenCL backend");
+            }
+            // sizes the engine's buffers and wakes the thread pool up
+            std::vector<uint8_t> image(image_size, 0);
+            std::vector<uint16_t> disp(image_size);
+            execute_host(image.data(), image.data(), disp.data());
+            return;
+        }
+
+        // an interleaved frame holds both images
+        DeviceBuffer<uint8_t> image(m_cl_ctx, interleaved ? 2 * image_size : image_size);
+        DeviceBuffer<uint16_t> disp(m_cl_ctx, image_size);
+        cl_command_queue queue = m_frames.front()->queue;
+        image.fillZero(queue);
+        cl_int err = clFinish(queue);
+        CHECK_OCL_ERROR(err, "Error preparing dummy frame");
+
+        auto dummy_frame = [&]() {
+            if (!interleaved)
+            {
+                execute(image.data(), image.data(), disp.data());
+                return;
+            }
+            cl_event done = execute_interleaved_async(image.data(), disp.data(), 0, nullptr);
+            err = clWaitForEvents(1, &done);
+            clReleaseEvent(done);
+            CHECK_OCL_ERROR(err, "Error waiting for stereo matching");
+        };
+
+        // every slot owns an engine with its own kernels and buffers, one frame each sizes
+        // them all and runs the rectification if its maps are set; after pipeline_depth
+        // frames m_next_frame is back at the first slot
+        for (size_t i = 0; i < m_frames.size(); ++i)
+        {
+            dummy_frame();
+        }
+
+        if (m_params.temporal_prior)
+        {
+            // the second frame searches the band and builds its kernels
+            dummy_frame();
+            reset_temporal_prior();
+        }
     }
 
     void StereoSGM::execute(cl_mem left_pixels, cl_mem right_pixels, cl_mem dst)
     {
+        cl_event done = execute_async(left_pixels, right_pixels, dst, 0, nullptr);
+        cl_int err = clWaitForEvents(1, &done);
+        clReleaseEvent(done);
+        CHECK_OCL_ERROR(err, "Error waiting for stereo matching");
+    }
+
+    void StereoSGM::execute_batch(cl_mem left_pixels, cl_mem right_pixels, cl_mem dst, int batch_size)
+    {
+        cl_event done = submit(left_pixels, right_pixels, dst, batch_size, 0, nullptr);
+        cl_int err = clWaitForEvents(1, &done);
+        clReleaseEvent(done);
+        CHECK_OCL_ERROR(err, "Error waiting for stereo matching");
+    }
+
+    cl_event StereoSGM::execute_async(cl_mem left_pixels,
+                                      cl_mem right_pixels,
+                                      cl_mem dst,
+                                      cl_uint num_wait_events,
+                                      const cl_event *wait_events)
+    {
+        return submit(left_pixels, right_pixels, dst, 1, num_wait_events, wait_events);
+    }
+
+    cl_event StereoSGM::submit(cl_mem left_pixels,
+                               cl_mem right_pixels,
+                               cl_mem dst,
+                               int batch_size,
+                               cl_uint num_wait_events,
+                               const cl_event *wait_events,
+                               bool interleaved)
+    {
+        if (batch_size < 1)
+        {
+            throw std::logic_error("batch size must be at least 1");
+        }
+
+        FrameResources &frame = *m_frames[m_next_frame];
+        if (frame.queue == nullptr)
+        {
+            throw std::logic_error("cl_mem inputs need an OpenCL context");
+        }
+        m_next_frame = (m_next_frame + 1) % m_frames.size();
+        m_last_frame = &frame;
+
+        cl_int err;
+        if (num_wait_events > 0)
+        {
+            // everything below is ordered behind this barrier on the in-order queue
+            err = clEnqueueBarrierWithWaitList(frame.queue, num_wait_events, wait_events, nullptr);
+            CHECK_OCL_ERROR(err, "Error enqueuing wait list");
+        }
+
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            // the CPU backends compute in place, the returned event is already complete
+            const size_t image_size = m_width * m_height;
+            const size_t batch_pixels = image_size * batch_size;
+            h_left.resize(batch_pixels);
+            h_right.resize(batch_pixels);
+            h_disp.resize(batch_pixels);
+            err = clEnqueueReadBuffer(frame.queue, left_pixels, true, 0, batch_pixels, h_left.data(), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error reading left image");
+            err = clEnqueueReadBuffer(frame.queue, right_pixels, true, 0, batch_pixels, h_right.data(), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error reading right image");
+
+            for (int i = 0; i < batch_size; ++i)
+            {
+                execute_host(h_left.data() + i * image_size, h_right.data() + i * image_size, h_disp.data() + i * image_size);
+            }
+
+            err = clEnqueueWriteBuffer(frame.queue, dst, true, 0, batch_pixels * sizeof(uint16_t), h_disp.data(), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error writing disparity");
+        }
+        else
+        {
+            enqueue(frame, left_pixels, right_pixels, dst, batch_size, interleaved);
+        }
+
+        cl_event done = nullptr;
+        err = clEnqueueMarkerWithWaitList(frame.queue, 0, nullptr, &done);
+        CHECK_OCL_ERROR(err, "Error enqueuing completion marker");
+        err = clFlush(frame.queue);
+        CHECK_OCL_ERROR(err, "Error flushing queue");
+        return done;
+    }
+
+    void StereoSGM::enqueue(FrameResources &frame, cl_mem left_pixels, cl_mem right_pixels, cl_mem dst, int batch_size, bool interleaved)
+    {
+        const size_t batch_pixels = static_cast<size_t>(m_width) * m_height * batch_size;
+        const int stripe = stripe_height(batch_size);
+        const size_t engine_pixels = static_cast<size_t>(m_width) * stripe * batch_size;
+        if (frame.feature_buffer_left.size() < engine_pixels)
+        {
+            // grown for a larger batch, kept for the following calls
+            frame.feature_buffer_left.allocate(engine_pixels);
+            frame.feature_buffer_right.allocate(engine_pixels);
+            frame.feature_buffer_left.fillZero(frame.queue);
+            frame.feature_buffer_right.fillZero(frame.queue);
+        }
+        if (stripe < m_height && frame.stripe_left.size() < engine_pixels)
+        {
+            frame.stripe_left.allocate(engine_pixels);
+            frame.stripe_right.allocate(engine_pixels);
+            frame.stripe_disp_left.allocate(engine_pixels);
+            frame.stripe_disp_right.allocate(engine_pixels);
+        }
+        if (frame.right_disp.size() < batch_pixels)
+        {
+            frame.right_disp.allocate(batch_pixels);
+            frame.tmp_left_disp.allocate(batch_pixels);
+            frame.tmp_right_disp.allocate(batch_pixels);
+
+            frame.right_disp.fillZero(frame.queue);
+            frame.tmp_left_disp.fillZero(frame.queue);
+            frame.tmp_right_disp.fillZero(frame.queue);
+        }
+
+        // the slot's previous frame has completed, it is ordered before this one
+        frame.events.release();
+        StageEvents *events = m_params.enable_profiling ? &frame.events : nullptr;
+
         DeviceBuffer<uint8_t> left_img(m_cl_ctx,
-                                       m_width * m_height * sizeof(uint8_t),
+                                       batch_pixels * sizeof(uint8_t),
                                        left_pixels);
         DeviceBuffer<uint8_t> right_img(m_cl_ctx,
-                                        m_width * m_height * sizeof(uint8_t),
+                                        batch_pixels * sizeof(uint8_t),
                                         right_pixels);
         DeviceBuffer<uint16_t> out_disp(m_cl_ctx,
-                                        m_width * m_height * sizeof(uint16_t),
+                                        batch_pixels * sizeof(uint16_t),
                                         dst);
 
-        sgm_engine->execute(d_tmp_left_disp,
-                            d_tmp_right_disp,
-                            left_img,
-                            right_img,
-                            d_feature_buffer_left,
-                            d_feature_buffer_right,
-                            m_width,
-                            m_height,
-                            m_width,
-                            m_width,
-                            m_params,
-                            m_cl_cmd_queue);
-
-        sgm_details.median_filter(d_tmp_left_disp,
+        if (interleaved)
+        {
+            if (frame.gray_left.size() < batch_pixels)
+            {
+                frame.gray_left.allocate(batch_pixels);
+                frame.gray_right.allocate(batch_pixels);
+            }
+            const DeviceBuffer<uint8_t> raw(m_cl_ctx, 2 * batch_pixels, left_pixels);
+            m_demosaic.enqueue(raw, frame.gray_left, frame.gray_right, m_width, m_height, batch_size,
+                               m_params.bayer_pattern, frame.queue, events ? &events->deinterleave : nullptr);
+            left_img.setBufferData(m_cl_ctx, batch_pixels, frame.gray_left.data());
+            right_img.setBufferData(m_cl_ctx, batch_pixels, frame.gray_right.data());
+        }
+
+        if (!m_rectification.empty())
+        {
+            if (frame.rect_left.size() < batch_pixels)
+            {
+                frame.rect_left.allocate(batch_pixels);
+                frame.rect_right.allocate(batch_pixels);
+            }
+            m_rectification.enqueue(left_img, frame.rect_left, 0, m_width, m_height, batch_size, m_width,
+                                    frame.queue, events ? &events->rectify_left : nullptr);
+            m_rectification.enqueue(right_img, frame.rect_right, 1, m_width, m_height, batch_size, m_width,
+                                    frame.queue, events ? &events->rectify_right : nullptr);
+            left_img.setBufferData(m_cl_ctx, batch_pixels, frame.rect_left.data());
+            right_img.setBufferData(m_cl_ctx, batch_pixels, frame.rect_right.data());
+        }
+
+        // the prior only describes the single whole frame before this one
+        const bool whole_frame = batch_size == 1 && stripe == m_height;
+        bool searched_band = false;
+        if (frame.temporal)
+        {
+            searched_band = whole_frame && search_temporal_band();
+            frame.temporal->set_prior(searched_band ? &m_prior_disp : nullptr);
+        }
+
+        if (stripe < m_height)
+        {
+            execute_stripes(frame, left_img, right_img, batch_size, stripe, events);
+        }
+        else
+        {
+            frame.engine->execute(frame.tmp_left_disp,
+                                  frame.tmp_right_disp,
+                                  left_img,
+                                  right_img,
+                                  frame.feature_buffer_left,
+                                  frame.feature_buffer_right,
+                                  m_width,
+                                  m_height,
+                                  batch_size,
+                                  m_width,
+                                  m_width,
+                                  m_params,
+                                  frame.queue,
+                                  events);
+        }
+
+        sgm_details.median_filter(frame.tmp_left_disp,
                                   out_disp,
                                   m_width,
                                   m_height,
+                                  batch_size,
                                   m_width,
-                                  m_cl_cmd_queue);
+                                  frame.queue,
+                                  events ? &events->median_left : nullptr);
 
-        sgm_details.median_filter(d_tmp_right_disp,
-                                  d_right_disp,
+        sgm_details.median_filter(frame.tmp_right_disp,
+                                  frame.right_disp,
                                   m_width,
                                   m_height,
+                                  batch_size,
                                   m_width,
-                                  m_cl_cmd_queue);
+                                  frame.queue,
+                                  events ? &events->median_right : nullptr);
 
         sgm_details.check_consistency(out_disp,
-                                      d_right_disp,
+                                      frame.right_disp,
                                       left_img,
                                       m_width,
                                       m_height,
+                                      batch_size,
                                       m_width,
                                       m_width,
                                       m_params.subpixel,
                                       m_params.LR_max_diff,
-                                      m_cl_cmd_queue);
+                                      frame.queue,
+                                      events ? &events->check_consistency : nullptr);
+
+        if (frame.temporal)
+        {
+            if (whole_frame)
+            {
+                update_temporal_prior(frame, out_disp, searched_band);
+            }
+            else
+            {
+                m_prior_valid = false;
+            }
+        }
 
         sgm_details.correct_disparity_range(out_disp,
                                             m_width,
                                             m_height,
+                                            batch_size,
                                             m_width,
                                             m_params.subpixel,
                                             m_params.min_disp,
-                                            m_cl_cmd_queue);
-        clFinish(m_cl_cmd_queue);
+                                            frame.queue,
+                                            events ? &events->correct_disparity_range : nullptr);
+    }
+
+    int StereoSGM::stripe_height(int batch_size) const
+    {
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            return m_height;
+        }
+        const size_t row_pixels = static_cast<size_t>(m_width) * batch_size;
+        size_t rows = m_max_alloc / (row_pixels * m_volume_bytes_per_pixel);
+        if (m_params.memory_budget > 0)
+        {
+            rows = std::min(rows, m_params.memory_budget / (row_pixels * m_engine_bytes_per_pixel));
+        }
+        if (rows >= static_cast<size_t>(m_height))
+        {
+            return m_height;
+        }
+        if (rows <= static_cast<size_t>(2 * m_params.stripe_overlap))
+        {
+            throw std::runtime_error("memory budget is too small, a stripe of " + std::to_string(rows) +
+                                     " rows does not exceed twice the stripe overlap");
+        }
+        return static_cast<int>(rows);
+    }
+
+    int StereoSGM::get_stripe_height() const
+    {
+        return m_stripe_height;
+    }
+
+    void StereoSGM::set_rectification_maps(const float *map11, const float *map12, const float *map21, const float *map22)
+    {
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            throw std::logic_error("device rectification needs the OpenCL backend");
+        }
+        // the maps go to new buffers, frames in flight keep remapping with the old ones
+        m_rectification.set_maps(map11, map12, map21, map22, m_width, m_height, m_frames.front()->queue);
+    }
+
+    void StereoSGM::execute_stripes(FrameResources &frame,
+                                    const DeviceBuffer<uint8_t> &left_img,
+                                    const DeviceBuffer<uint8_t> &right_img,
+                                    int batch_size,
+                                    int stripe_height,
+                                    StageEvents *events)
+    {
+        const int overlap = m_params.stripe_overlap;
+        const int core = stripe_height - 2 * overlap;
+        for (int y0 = 0; y0 < m_height; y0 += core)
+        {
+            // every stripe has the same height, so the engine keeps its buffers;
+            // the first and the last one are shifted inside the image
+            const int top = std::max(std::min(y0 - overlap, m_height - stripe_height), 0);
+            const int rows = std::min(core, m_height - y0);
+            const bool last = y0 + core >= m_height;
+
+            copy_rows(frame.queue, left_img.data(), frame.stripe_left.data(), m_width * sizeof(uint8_t),
+                      top, 0, stripe_height, m_height, stripe_height, batch_size);
+            copy_rows(frame.queue, right_img.data(), frame.stripe_right.data(), m_width * sizeof(uint8_t),
+                      top, 0, stripe_height, m_height, stripe_height, batch_size);
+
+            // a stripe's events would replace the ones of the stripe before, only the last is timed
+            frame.engine->execute(frame.stripe_disp_left,
+                                  frame.stripe_disp_right,
+                                  frame.stripe_left,
+                                  frame.stripe_right,
+                                  frame.feature_buffer_left,
+                                  frame.feature_buffer_right,
+                                  m_width,
+                                  stripe_height,
+                                  batch_size,
+                                  m_width,
+                                  m_width,
+                                  m_params,
+                                  frame.queue,
+                                  last ? events : nullptr);
+
+            // only the rows away from the stripe border are kept
+            copy_rows(frame.queue, frame.stripe_disp_left.data(), frame.tmp_left_disp.data(), m_width * sizeof(uint16_t),
+                      y0 - top, y0, rows, stripe_height, m_height, batch_size);
+            copy_rows(frame.queue, frame.stripe_disp_right.data(), frame.tmp_right_disp.data(), m_width * sizeof(uint16_t),
+                      y0 - top, y0, rows, stripe_height, m_height, batch_size);
+        }
+    }
+
+    void StereoSGM::execute(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst)
+    {
+        execute_batch(left_pixels, right_pixels, dst, 1);
+    }
+
+    void StereoSGM::execute_batch(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst, int batch_size)
+    {
+        if (batch_size < 1)
+        {
+            throw std::logic_error("batch size must be at least 1");
+        }
+
+        const size_t image_size = m_width * m_height;
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            for (int i = 0; i < batch_size; ++i)
+            {
+                execute_host(left_pixels + i * image_size, right_pixels + i * image_size, dst + i * image_size);
+            }
+            return;
+        }
+
+        const size_t batch_pixels = image_size * batch_size;
+        cl_command_queue queue = m_frames.front()->queue;
+
+        cl_event uploads[2] = {};
+        cl_mem left = upload_host_image(m_host_left, left_pixels, batch_pixels, queue, &uploads[0]);
+        cl_mem right = upload_host_image(m_host_right, right_pixels, batch_pixels, queue, &uploads[1]);
+        m_host_disp.bind(m_cl_ctx, dst, batch_pixels * sizeof(uint16_t), CL_MEM_READ_WRITE, m_host_ptr_alignment);
+
+        cl_event done = submit(left, right, m_host_disp.mem, batch_size, 2, uploads);
+        clReleaseEvent(uploads[0]);
+        clReleaseEvent(uploads[1]);
+
+        download_host_image(m_host_disp, dst, batch_pixels * sizeof(uint16_t), queue, done);
+        clReleaseEvent(done);
+    }
+
+    cl_event StereoSGM::execute_interleaved_async(cl_mem raw_pixels,
+                                                  cl_mem dst,
+                                                  cl_uint num_wait_events,
+                                                  const cl_event *wait_events)
+    {
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            throw std::logic_error("interleaved input needs the OpenCL backend");
+        }
+        return submit(raw_pixels, nullptr, dst, 1, num_wait_events, wait_events, true);
+    }
+
+    void StereoSGM::execute_interleaved(const uint8_t *raw_pixels, uint16_t *dst)
+    {
+        if (m_params.backend != ExecutionBackend::OPENCL)
+        {
+            throw std::logic_error("interleaved input needs the OpenCL backend");
+        }
+
+        const size_t image_size = m_width * m_height;
+        cl_command_queue queue = m_frames.front()->queue;
+
+        // a single upload for both cameras
+        cl_event upload = nullptr;
+        cl_mem raw = upload_host_image(m_host_raw, raw_pixels, 2 * image_size, queue, &upload);
+        m_host_disp.bind(m_cl_ctx, dst, image_size * sizeof(uint16_t), CL_MEM_READ_WRITE, m_host_ptr_alignment);
+
+        cl_event done = submit(raw, nullptr, m_host_disp.mem, 1, 1, &upload);
+        clReleaseEvent(upload);
+
+        download_host_image(m_host_disp, dst, image_size * sizeof(uint16_t), queue, done);
+        clReleaseEvent(done);
+    }
+
+    void StereoSGM::execute_host(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst)
+    {
+        m_frames.front()->engine->execute_host(h_tmp_left_disp.data(),
+                                               h_tmp_right_disp.data(),
+                                               left_pixels,
+                                               right_pixels,
+                                               m_width,
+                                               m_height,
+                                               m_width,
+                                               m_width,
+                                               m_params);
+
+        reference::median_filter(h_tmp_left_disp.data(), dst, m_width, m_height, m_width);
+        reference::median_filter(h_tmp_right_disp.data(), h_right_disp.data(), m_width, m_height, m_width);
+        reference::check_consistency(dst,
+                                     h_right_disp.data(),
+                                     left_pixels,
+                                     m_width,
+                                     m_height,
+                                     m_width,
+                                     m_width,
+                                     m_params.subpixel,
+                                     m_params.LR_max_diff);
+        reference::correct_disparity_range(dst,
+                                           m_width,
+                                           m_height,
+                                           m_width,
+                                           m_params.subpixel,
+                                           m_params.min_disp);
+    }
+
+    // Milliseconds between start and end of a profiled kernel, widens [first, last] to cover it.
+    static double kernel_time(cl_event event, cl_ulong &first, cl_ulong &last)
+    {
+        if (event == nullptr)
+        {
+            return 0.0;
+        }
+        cl_int err = clWaitForEvents(1, &event);
+        CHECK_OCL_ERROR(err, "Error waiting for profiled kernel");
+        cl_ulong start = 0, end = 0;
+        err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+        CHECK_OCL_ERROR(err, "Error reading kernel profiling info");
+        first = std::min(first, start);
+        last = std::max(last, end);
+        return (end - start) * 1e-6;
+    }
+
+    FrameStats StereoSGM::get_frame_stats()
+    {
+        if (!m_params.enable_profiling)
+        {
+            throw std::logic_error("Frame stats need Parameters::enable_profiling");
+        }
+
+        FrameStats stats;
+        if (m_last_frame == nullptr)
+        {
+            return stats;
+        }
+
+        const StageEvents &events = m_last_frame->events;
+        cl_ulong first = std::numeric_limits<cl_ulong>::max();
+        cl_ulong last = 0;
+        stats.deinterleave = kernel_time(events.deinterleave, first, last);
+        stats.rectify_left = kernel_time(events.rectify_left, first, last);
+        stats.rectify_right = kernel_time(events.rectify_right, first, last);
+        stats.census_left = kernel_time(events.census_left, first, last);
+        stats.census_right = kernel_time(events.census_right, first, last);
+        stats.num_paths = events.num_paths;
+        for (int i = 0; i < events.num_paths; ++i)
+        {
+            stats.paths[i] = kernel_time(events.paths[i], first, last);
+        }
+        stats.winner_takes_all = kernel_time(events.winner_takes_all, first, last);
+        stats.median_left = kernel_time(events.median_left, first, last);
+        stats.median_right = kernel_time(events.median_right, first, last);
+        stats.check_consistency = kernel_time(events.check_consistency, first, last);
+        stats.correct_disparity_range = kernel_time(events.correct_disparity_range, first, last);
+        if (last > first)
+        {
+            stats.total = (last - first) * 1e-6;
+        }
+        return stats;
     }
 
     int StereoSGM::get_invalid_disparity() const
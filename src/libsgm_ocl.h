@@ -13,12 +13,42 @@
 #include "path_aggregation.h"
 #include "winner_takes_all.h"
 #include "sgm_details.h"
+#include "pyramid.h"
+#include "banded_aggregation.h"
+#include "rectification.h"
+#include "demosaic.h"
+#include "sgm_reference.h"
+#include "sgm_cpu.h"
 
 namespace sgmcl
 {
+    // Kernel events of one frame, recorded with Parameters::enable_profiling.
+    struct StageEvents
+    {
+        StageEvents() = default;
+        StageEvents(const StageEvents &) = delete;
+        StageEvents &operator=(const StageEvents &) = delete;
+        ~StageEvents();
+        void release();
+
+        cl_event deinterleave = nullptr;
+        cl_event rectify_left = nullptr;
+        cl_event rectify_right = nullptr;
+        cl_event census_left = nullptr;
+        cl_event census_right = nullptr;
+        cl_event paths[8] = {};
+        int num_paths = 0;
+        cl_event winner_takes_all = nullptr;
+        cl_event median_left = nullptr;
+        cl_event median_right = nullptr;
+        cl_event check_consistency = nullptr;
+        cl_event correct_disparity_range = nullptr;
+    };
+
     class SemiGlobalMatchingBase
     {
     public:
+        // The images of a batch follow each other in every buffer, batch_size x height rows of pitch elements.
         virtual void execute(DeviceBuffer<uint16_t> &dest_left,
                              DeviceBuffer<uint16_t> &dest_right,
                              const DeviceBuffer<uint8_t> &src_left,
@@ -27,10 +57,26 @@ namespace sgmcl
                              DeviceBuffer<uint32_t> &feature_buffer_right,
                              int width,
                              int height,
+                             int batch_size,
                              int src_pitch,
                              int dst_pitch,
                              const Parameters &param,
-                             cl_command_queue queue) = 0;
+                             cl_command_queue queue,
+                             StageEvents *events) = 0;
+
+        // Same as execute on host memory, only engines computing on the CPU implement it.
+        virtual void execute_host(uint16_t * /*dest_left*/,
+                                  uint16_t * /*dest_right*/,
+                                  const uint8_t * /*src_left*/,
+                                  const uint8_t * /*src_right*/,
+                                  int /*width*/,
+                                  int /*height*/,
+                                  int /*src_pitch*/,
+                                  int /*dst_pitch*/,
+                                  const Parameters & /*param*/)
+        {
+            throw std::logic_error("This engine does not compute on host memory");
+        }
 
         virtual ~SemiGlobalMatchingBase() {}
     };
@@ -39,7 +85,10 @@ namespace sgmcl
     class SemiGlobalMatching : public SemiGlobalMatchingBase
     {
     public:
-        SemiGlobalMatching(cl_context ctx, cl_device_id device);
+        SemiGlobalMatching(cl_context ctx,
+                           cl_device_id device,
+                           cl_command_queue_properties queue_properties = 0,
+                           const TuningProfile &tuning = TuningProfile());
         virtual ~SemiGlobalMatching() {}
 
         void execute(DeviceBuffer<uint16_t> &dest_left,
@@ -50,10 +99,12 @@ namespace sgmcl
                      DeviceBuffer<uint32_t> &feature_buffer_right,
                      int width,
                      int height,
+                     int batch_size,
                      int src_pitch,
                      int dst_pitch,
                      const Parameters &param,
-                     cl_command_queue queue) override;
+                     cl_command_queue queue,
+                     StageEvents *events) override;
 
     private:
         CensusTransform m_census;
@@ -61,6 +112,182 @@ namespace sgmcl
         WinnerTakesAll<MAX_DISPARITY> m_winner_takes_all;
     };
 
+    /**
+        Coarse to fine engine of Parameters::hierarchical. SemiGlobalMatching<64> matches
+        the pair downsampled by disparity_size / 64, which covers the whole disparity range,
+        and every full resolution pixel then only aggregates the BandedAggregation::DEFAULT_BAND_WIDTH
+        disparities around its upscaled coarse disparity.
+        */
+    class HierarchicalSemiGlobalMatching : public SemiGlobalMatchingBase
+    {
+    public:
+        HierarchicalSemiGlobalMatching(cl_context ctx,
+                                       cl_device_id device,
+                                       int disparity_size,
+                                       cl_command_queue_properties queue_properties = 0,
+                                       const TuningProfile &tuning = TuningProfile());
+        virtual ~HierarchicalSemiGlobalMatching() {}
+
+        void execute(DeviceBuffer<uint16_t> &dest_left,
+                     DeviceBuffer<uint16_t> &dest_right,
+                     const DeviceBuffer<uint8_t> &src_left,
+                     const DeviceBuffer<uint8_t> &src_right,
+                     DeviceBuffer<uint32_t> &feature_buffer_left,
+                     DeviceBuffer<uint32_t> &feature_buffer_right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     int src_pitch,
+                     int dst_pitch,
+                     const Parameters &param,
+                     cl_command_queue queue,
+                     StageEvents *events) override;
+
+    private:
+        int m_disparity_size;
+        int m_factor;
+
+        SemiGlobalMatching<64> m_coarse;
+        SGMDetails m_coarse_details;
+        Pyramid m_pyramid;
+        CensusTransform m_census;
+        BandedAggregation m_aggregation;
+
+        DeviceBuffer<uint8_t> m_coarse_left;
+        DeviceBuffer<uint8_t> m_coarse_right;
+        DeviceBuffer<uint32_t> m_coarse_feature_left;
+        DeviceBuffer<uint32_t> m_coarse_feature_right;
+        DeviceBuffer<uint16_t> m_coarse_tmp_left;
+        DeviceBuffer<uint16_t> m_coarse_tmp_right;
+        DeviceBuffer<uint16_t> m_coarse_disp_left;
+        DeviceBuffer<uint16_t> m_coarse_disp_right;
+        DeviceBuffer<uint16_t> m_band;
+    };
+
+    /**
+        Engine of Parameters::temporal_prior. With a prior set, every pixel only searches a
+        band of band_width disparities centered on its disparity in the prior, otherwise,
+        and for batches, the wrapped full_search engine searches the whole range.
+        */
+    class TemporalSemiGlobalMatching : public SemiGlobalMatchingBase
+    {
+    public:
+        TemporalSemiGlobalMatching(cl_context ctx,
+                                   cl_device_id device,
+                                   int disparity_size,
+                                   int band_width,
+                                   std::unique_ptr<SemiGlobalMatchingBase> full_search,
+                                   const TuningProfile &tuning = TuningProfile());
+        virtual ~TemporalSemiGlobalMatching() {}
+
+        // Filtered disparity of the previous frame, before the disparity range correction.
+        // nullptr searches the whole range. The buffer must stay valid until execute.
+        void set_prior(const DeviceBuffer<uint16_t> *prior) { m_prior = prior; }
+
+        void execute(DeviceBuffer<uint16_t> &dest_left,
+                     DeviceBuffer<uint16_t> &dest_right,
+                     const DeviceBuffer<uint8_t> &src_left,
+                     const DeviceBuffer<uint8_t> &src_right,
+                     DeviceBuffer<uint32_t> &feature_buffer_left,
+                     DeviceBuffer<uint32_t> &feature_buffer_right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     int src_pitch,
+                     int dst_pitch,
+                     const Parameters &param,
+                     cl_command_queue queue,
+                     StageEvents *events) override;
+
+    private:
+        int m_disparity_size;
+        std::unique_ptr<SemiGlobalMatchingBase> m_full_search;
+        const DeviceBuffer<uint16_t> *m_prior = nullptr;
+
+        Pyramid m_pyramid;
+        CensusTransform m_census;
+        BandedAggregation m_aggregation;
+        DeviceBuffer<uint16_t> m_band;
+    };
+
+    /**
+        Base of the engines computing on the CPU, the device buffer interface
+        reads the images back and uploads the disparities around execute_host.
+        */
+    class HostSemiGlobalMatchingBase : public SemiGlobalMatchingBase
+    {
+    public:
+        void execute(DeviceBuffer<uint16_t> &dest_left,
+                     DeviceBuffer<uint16_t> &dest_right,
+                     const DeviceBuffer<uint8_t> &src_left,
+                     const DeviceBuffer<uint8_t> &src_right,
+                     DeviceBuffer<uint32_t> &feature_buffer_left,
+                     DeviceBuffer<uint32_t> &feature_buffer_right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     int src_pitch,
+                     int dst_pitch,
+                     const Parameters &param,
+                     cl_command_queue queue,
+                     StageEvents *events) override;
+
+    private:
+        std::vector<uint8_t> m_src_left;
+        std::vector<uint8_t> m_src_right;
+        std::vector<uint16_t> m_dest_left;
+        std::vector<uint16_t> m_dest_right;
+    };
+
+    template <size_t MAX_DISPARITY>
+    class ReferenceSemiGlobalMatching : public HostSemiGlobalMatchingBase
+    {
+    public:
+        ReferenceSemiGlobalMatching() = default;
+        virtual ~ReferenceSemiGlobalMatching() {}
+
+        void execute_host(uint16_t *dest_left,
+                          uint16_t *dest_right,
+                          const uint8_t *src_left,
+                          const uint8_t *src_right,
+                          int width,
+                          int height,
+                          int src_pitch,
+                          int dst_pitch,
+                          const Parameters &param) override;
+
+    private:
+        std::vector<uint32_t> m_feature_left;
+        std::vector<uint32_t> m_feature_right;
+        std::vector<uint16_t> m_cost_sum;
+    };
+
+    template <size_t MAX_DISPARITY>
+    class CpuSemiGlobalMatching : public HostSemiGlobalMatchingBase
+    {
+    public:
+        // num_threads counts the calling thread, 0 uses every hardware thread.
+        explicit CpuSemiGlobalMatching(unsigned int num_threads = 0);
+        virtual ~CpuSemiGlobalMatching() {}
+
+        void execute_host(uint16_t *dest_left,
+                          uint16_t *dest_right,
+                          const uint8_t *src_left,
+                          const uint8_t *src_right,
+                          int width,
+                          int height,
+                          int src_pitch,
+                          int dst_pitch,
+                          const Parameters &param) override;
+
+    private:
+        ThreadPool m_pool;
+
+        std::vector<uint32_t> m_feature_left;
+        std::vector<uint32_t> m_feature_right;
+        std::vector<uint16_t> m_cost_sum;
+    };
+
     class StereoSGM
     {
     public:
@@ -79,8 +306,40 @@ namespace sgmcl
                   cl_device_id cl_device,
                   Parameters param);
 
+        /**
+            * Same as above with the launch geometry of the kernels given directly
+            * instead of loaded from Parameters::tuning_profile.
+            */
+        StereoSGM(int width,
+                  int height,
+                  int disparity_size,
+                  cl_context ctx,
+                  cl_device_id cl_device,
+                  Parameters param,
+                  const TuningProfile &tuning);
+
         ~StereoSGM();
 
+        /**
+            * Compile every kernel needed by the configured Parameters and run one dummy frame
+            * on every pipeline slot, so the first real frame runs at steady state latency.
+            * @param interleaved Run the dummy frames through execute_interleaved_async, which also
+            *                    builds the demosaic kernel and the gray image buffers. Set it when
+            *                    the frames will be interleaved raw frames, needs the OpenCL backend.
+            * @attention
+            * Optional, without it the kernels are built lazily during the first frames.
+            * Call it after set_rectification_maps, the dummy frames then build the remap kernel
+            * and the rectified image buffers as well.
+            * execute_batch with a larger batch still grows the buffers on its first call.
+            */
+        void prepare(bool interleaved = false);
+
+        /**
+            * Forget the previous frame of Parameters::temporal_prior, e.g. after a scene cut,
+            * so the next frame searches the whole disparity range.
+            */
+        void reset_temporal_prior();
+
         /**
             * Execute stereo semi global matching.
             * @param left_pixels  A pointer stored input left image in device memory.
@@ -94,6 +353,95 @@ namespace sgmcl
             */
         void execute(cl_mem left_pixels, cl_mem right_pixels, cl_mem dst);
 
+        /**
+            * Enqueue stereo semi global matching without blocking the calling thread.
+            * @param left_pixels     A pointer stored input left image in device memory.
+            * @param right_pixels    A pointer stored input right image in device memory.
+            * @param dst             Output pointer in device memory.
+            * @param num_wait_events Number of events in wait_events.
+            * @param wait_events     Events (e.g. the uploads of the images) that must complete before matching starts.
+            * @return Event completing when dst is written. The caller must release it with clReleaseEvent.
+            * @attention
+            * The buffers must stay valid until the returned event has completed.
+            * Up to Parameters::pipeline_depth consecutive calls use separate queues and buffers
+            * and may overlap on the device; a call reusing a frame slot is ordered behind the
+            * frame which used it before.
+            * The CPU backends compute before returning.
+            */
+        cl_event execute_async(cl_mem left_pixels,
+                               cl_mem right_pixels,
+                               cl_mem dst,
+                               cl_uint num_wait_events,
+                               const cl_event *wait_events);
+
+        /**
+            * Execute stereo semi global matching on host memory.
+            * @param left_pixels  Left image, width x height bytes.
+            * @param right_pixels Right image, width x height bytes.
+            * @param dst          Output disparity, width x height uint16_t values.
+            * @attention
+            * With ExecutionBackend::OPENCL pointers aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN are wrapped
+            * with CL_MEM_USE_HOST_PTR and only mapped, which avoids any copy on integrated GPUs and CPU
+            * runtimes. Other pointers are copied through pinned CL_MEM_ALLOC_HOST_PTR buffers.
+            * The call blocks until dst is written.
+            */
+        void execute(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst);
+
+        /**
+            * Execute stereo semi global matching on a batch of image pairs.
+            * @param left_pixels  batch_size left images stored one after another in device memory.
+            * @param right_pixels batch_size right images stored one after another in device memory.
+            * @param dst          Output for batch_size disparity images, one after another.
+            * @param batch_size   Number of image pairs.
+            * @attention
+            * With ExecutionBackend::OPENCL every kernel processes the whole batch in one launch,
+            * which keeps the device busy on small images and pays the launch overhead and the
+            * host synchronization once per batch. The call blocks until dst is written.
+            * Device memory of the cost volumes and intermediate buffers grows with batch_size.
+            */
+        void execute_batch(cl_mem left_pixels, cl_mem right_pixels, cl_mem dst, int batch_size);
+
+        /**
+            * Same as execute_batch on host memory, see the host pointer execute.
+            * @param left_pixels  batch_size left images, width x height bytes each.
+            * @param right_pixels batch_size right images, width x height bytes each.
+            * @param dst          Output for batch_size disparities, width x height uint16_t values each.
+            * @param batch_size   Number of image pairs.
+            */
+        void execute_batch(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst, int batch_size);
+
+        /**
+            * Execute stereo semi global matching on an interleaved raw frame of a stereo camera.
+            * @param raw_pixels Frame in device memory, width x height byte pairs: the Bayer mosaic of
+            *                   the right camera in the first and of the left camera in the second byte
+            *                   of every pair, like the YUYV stream of the oCamS.
+            * @param dst        Output pointer in device memory, see execute.
+            * @attention
+            * Needs the OpenCL backend. One kernel splits the frame and converts both mosaics
+            * (Parameters::bayer_pattern) to gray on the device, then the images are rectified if
+            * maps are set and matched like the ones given to execute_async.
+            */
+        cl_event execute_interleaved_async(cl_mem raw_pixels,
+                                           cl_mem dst,
+                                           cl_uint num_wait_events,
+                                           const cl_event *wait_events);
+
+        /**
+            * Same as execute_interleaved_async on host memory, blocks until dst is written.
+            * @param raw_pixels Interleaved frame, width x height x 2 bytes.
+            * @param dst        Output disparity, width x height uint16_t values.
+            */
+        void execute_interleaved(const uint8_t *raw_pixels, uint16_t *dst);
+
+        /**
+            * Kernel times of the most recently submitted frame (or batch).
+            * @attention
+            * Needs Parameters::enable_profiling and the OpenCL backend. Blocks until that frame
+            * has completed. Call it before the frame's pipeline slot is reused, i.e. within
+            * Parameters::pipeline_depth calls of execute_async.
+            */
+        FrameStats get_frame_stats();
+
         /**
             * Generate invalid disparity value from Parameter::min_disp and Parameter::subpixel
             * @attention
@@ -102,30 +450,173 @@ namespace sgmcl
             */
         int get_invalid_disparity() const;
 
+        /**
+            * Rows of the stripes a single frame is matched in, see Parameters::memory_budget.
+            * The image height if it is matched at once.
+            */
+        int get_stripe_height() const;
+
+        /**
+            * Rectify the input images on the device before matching, so raw camera frames can be
+            * passed to execute directly instead of running cv::remap on the host.
+            * @param map11 Left x map, map12 left y map, map21 right x map, map22 right y map:
+            *              width x height floats each, as returned by cv::initUndistortRectifyMap with CV_32FC1.
+            * @attention
+            * Needs the OpenCL backend. The maps are converted to fixed point and uploaded once,
+            * the result matches cv::remap with INTER_LINEAR and BORDER_CONSTANT up to rounding.
+            * Passing nullptr for all four maps turns the rectification off again.
+            */
+        void set_rectification_maps(const float *map11, const float *map12, const float *map21, const float *map22);
+
     private:
         StereoSGM(const StereoSGM &) = delete;
         StereoSGM &operator=(const StereoSGM &) = delete;
 
+        // Queue, engine and intermediate buffers of one in-flight frame. execute_async
+        // cycles through Parameters::pipeline_depth of them, so consecutive frames
+        // run on different queues and never share a buffer. The engines of the slots
+        // share their built programs through ProgramCache, only the kernels are per slot.
+        struct FrameResources
+        {
+            explicit FrameResources(cl_context ctx);
+            ~FrameResources();
+
+            cl_command_queue queue = nullptr;
+            std::unique_ptr<SemiGlobalMatchingBase> engine;
+            // engine itself with Parameters::temporal_prior
+            TemporalSemiGlobalMatching *temporal = nullptr;
+
+            DeviceBuffer<uint32_t> feature_buffer_left;
+            DeviceBuffer<uint32_t> feature_buffer_right;
+            DeviceBuffer<uint16_t> right_disp;
+            DeviceBuffer<uint16_t> tmp_left_disp;
+            DeviceBuffer<uint16_t> tmp_right_disp;
+
+            // engine input and output of one stripe, see Parameters::memory_budget
+            DeviceBuffer<uint8_t> stripe_left;
+            DeviceBuffer<uint8_t> stripe_right;
+            DeviceBuffer<uint16_t> stripe_disp_left;
+            DeviceBuffer<uint16_t> stripe_disp_right;
+
+            // gray images of execute_interleaved
+            DeviceBuffer<uint8_t> gray_left;
+            DeviceBuffer<uint8_t> gray_right;
+
+            // rectified input, see set_rectification_maps
+            DeviceBuffer<uint8_t> rect_left;
+            DeviceBuffer<uint8_t> rect_right;
+
+            // kernels of the last frame run in this slot, with Parameters::enable_profiling
+            StageEvents events;
+        };
+
+        // Device buffer of a host image given to the host pointer execute, either a
+        // CL_MEM_USE_HOST_PTR wrapper of the pointer or a CL_MEM_ALLOC_HOST_PTR staging buffer.
+        struct HostImage
+        {
+            ~HostImage();
+            void bind(cl_context ctx, const void *host_ptr, size_t n, cl_mem_flags flags, size_t alignment);
+            void release();
+
+            const void *ptr = nullptr;
+            size_t size = 0;
+            cl_mem mem = nullptr;
+            bool staging = false;
+        };
+
+        cl_mem upload_host_image(HostImage &image, const void *src, size_t n, cl_command_queue queue, cl_event *event);
+        void download_host_image(HostImage &image, void *dst, size_t n, cl_command_queue queue, cl_event ready);
+
+        cl_event submit(cl_mem left_pixels,
+                        cl_mem right_pixels,
+                        cl_mem dst,
+                        int batch_size,
+                        cl_uint num_wait_events,
+                        const cl_event *wait_events,
+                        bool interleaved = false);
+        // interleaved: left_pixels is a raw frame of execute_interleaved, right_pixels is unused
+        void enqueue(FrameResources &frame, cl_mem left_pixels, cl_mem right_pixels, cl_mem dst, int batch_size, bool interleaved);
+        int stripe_height(int batch_size) const;
+        void execute_stripes(FrameResources &frame,
+                             const DeviceBuffer<uint8_t> &left_img,
+                             const DeviceBuffer<uint8_t> &right_img,
+                             int batch_size,
+                             int stripe_height,
+                             StageEvents *events);
+        void execute_host(const uint8_t *left_pixels, const uint8_t *right_pixels, uint16_t *dst);
+        bool search_temporal_band();
+        void update_temporal_prior(FrameResources &frame, const DeviceBuffer<uint16_t> &disp, bool searched_band);
+
         int m_width;
         int m_height;
+        int m_stripe_height;
+
+        // engine memory estimate for the stripes, per pixel of a stripe
+        size_t m_max_alloc = 0;
+        size_t m_volume_bytes_per_pixel = 0;
+        size_t m_engine_bytes_per_pixel = 0;
 
         Parameters m_params;
 
         cl_context m_cl_ctx;
         cl_device_id m_cl_device;
-        cl_command_queue m_cl_cmd_queue;
 
-        std::unique_ptr<SemiGlobalMatchingBase> sgm_engine;
+        std::vector<std::unique_ptr<FrameResources>> m_frames;
+        size_t m_next_frame = 0;
+        FrameResources *m_last_frame = nullptr;
+        TuningProfile m_tuning;
         SGMDetails sgm_details;
+        Rectification m_rectification;
+        Demosaic m_demosaic;
+
+        // previous frame of Parameters::temporal_prior, its invalid pixels are counted
+        // on the device and read back without blocking
+        DeviceBuffer<uint16_t> m_prior_disp;
+        DeviceBuffer<uint32_t> m_invalid_count;
+        cl_event m_invalid_count_read = nullptr;
+        cl_uint m_invalid_count_host = 0;
+        bool m_invalid_count_full_search = false;
+        bool m_prior_valid = false;
+        int m_frames_since_full_search = 0;
+        double m_full_search_invalid_ratio = 0.0;
 
-        DeviceBuffer<uint32_t> d_feature_buffer_left;
-        DeviceBuffer<uint32_t> d_feature_buffer_right;
-        DeviceBuffer<uint8_t> d_src_left;
-        DeviceBuffer<uint8_t> d_src_right;
-        DeviceBuffer<uint16_t> d_left_disp;
-        DeviceBuffer<uint16_t> d_right_disp;
-        DeviceBuffer<uint16_t> d_tmp_left_disp;
-        DeviceBuffer<uint16_t> d_tmp_right_disp;
-        DeviceBuffer<uint8_t> d_u8_out_disp;
+        // host pointer execute of the OpenCL backend
+        size_t m_host_ptr_alignment = 1;
+        HostImage m_host_left;
+        HostImage m_host_right;
+        HostImage m_host_raw;
+        HostImage m_host_disp;
+
+        // host side buffers of the CPU backends
+        std::vector<uint8_t> h_left;
+        std::vector<uint8_t> h_right;
+        std::vector<uint16_t> h_disp;
+        std::vector<uint16_t> h_right_disp;
+        std::vector<uint16_t> h_tmp_left_disp;
+        std::vector<uint16_t> h_tmp_right_disp;
     };
+
+    /**
+        * Benchmark candidate launch geometries of every OpenCL kernel on device and save the
+        * fastest ones to a tuning profile, which later runs load through Parameters::tuning_profile.
+        * @param width          Image width the geometry is tuned for.
+        * @param height         Image height the geometry is tuned for.
+        * @param disparity_size 64, 128 or 256, the aggregation and winner takes all keys are per disparity size.
+        * @param param          Matching parameters of the later runs, the backend is forced to OPENCL and all 8 paths are tuned.
+        * @param profile_path   Profile file, entries of other disparity sizes measured on the same device are kept.
+        * @param iterations     Frames timed per candidate, the median kernel time decides.
+        * @return The saved profile.
+        * @attention
+        * Every candidate builds its kernels, so tuning takes a while; set Parameters::program_cache_dir
+        * to keep the winning binaries. Candidates that fail to build or launch, or whose disparities
+        * differ from the default geometry, are skipped.
+        */
+    TuningProfile autotune(int width,
+                           int height,
+                           int disparity_size,
+                           cl_context ctx,
+                           cl_device_id cl_device,
+                           Parameters param,
+                           const std::string &profile_path,
+                           int iterations = 10);
 } // namespace sgmcl
@@ -2,14 +2,111 @@
 
 namespace sgmcl
 {
+    namespace
+    {
+        // A subgroup handles one path with MAX_DISPARITY / dp_block_size lanes and must
+        // fit into a warp of warp_size lanes, the blocks consist of whole warps.
+        void check_geometry(unsigned int max_disparity, unsigned int warp_size,
+                            unsigned int block_size, unsigned int dp_block_size)
+        {
+            if (dp_block_size == 0 || max_disparity % dp_block_size != 0)
+            {
+                throw std::logic_error("DP block size must divide the disparity size");
+            }
+            const unsigned int subgroup_size = max_disparity / dp_block_size;
+            if (subgroup_size > warp_size || (subgroup_size & (subgroup_size - 1)) != 0)
+            {
+                throw std::logic_error("DP block size gives an invalid subgroup size");
+            }
+            if (block_size == 0 || block_size % warp_size != 0)
+            {
+                throw std::logic_error("aggregation block size must be a multiple of the warp size");
+            }
+        }
+
+        std::string tuning_key(const char *direction, unsigned int max_disparity, const char *name)
+        {
+            return std::string(direction) + ".d" + std::to_string(max_disparity) + "." + name;
+        }
+
+        // SUBGROUP_SHUFFLE of path_aggregation_common.cl: 0 emulates the shuffles in local
+        // memory, 1 uses cl_intel_subgroups, 2 the khr subgroup shuffle extensions.
+        int subgroup_shuffle_mode(cl_device_id device, const TuningProfile &tuning)
+        {
+            if (!tuning.get("aggregation.native_subgroups", 1))
+            {
+                return 0;
+            }
+            if (device_has_extension(device, "cl_intel_subgroups"))
+            {
+                return 1;
+            }
+            // the sub_group_* built-ins of cl_khr_subgroups need OpenCL C 2.0
+            if (device_opencl_c_version(device) >= 20 &&
+                device_has_extension(device, "cl_khr_subgroups") &&
+                device_has_extension(device, "cl_khr_subgroup_shuffle") &&
+                device_has_extension(device, "cl_khr_subgroup_shuffle_relative"))
+            {
+                return 2;
+            }
+            return 0;
+        }
+
+        // Builds an aggregation kernel source with @SUBGROUP_SHUFFLE@ still in it. A device
+        // compiler rejecting the native shuffles gets the local memory emulation, so
+        // subgroup_shuffle is 0 afterwards.
+        void build_aggregation_program(DeviceProgram &program, cl_context ctx, cl_device_id device,
+                                       const std::string &kernel_src, int &subgroup_shuffle)
+        {
+            while (true)
+            {
+                std::string options;
+                if (subgroup_shuffle == 2)
+                {
+                    options = device_opencl_c_version(device) >= 30 ? "-cl-std=CL3.0" : "-cl-std=CL2.0";
+                }
+                const std::string kernel_SUBGROUP_SHUFFLE = "#define SUBGROUP_SHUFFLE " + std::to_string(subgroup_shuffle) + "\n";
+                const std::string src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SHUFFLE@"), kernel_SUBGROUP_SHUFFLE);
+                try
+                {
+                    program.init(ctx, device, src, options);
+                    return;
+                }
+                catch (const std::runtime_error &)
+                {
+                    if (subgroup_shuffle == 0)
+                    {
+                        throw;
+                    }
+                    std::cout << "Native subgroup shuffles failed to build, emulating them in local memory" << std::endl;
+                    subgroup_shuffle = 0;
+                }
+            }
+        }
+    } // namespace
+
+    unsigned int aggregation_warp_size(cl_context ctx, cl_device_id device, const TuningProfile &tuning,
+                                       unsigned int max_disparity, unsigned int dp_block_size)
+    {
+        const unsigned int subgroup_size = dp_block_size ? max_disparity / dp_block_size : 1;
+        return tuning.warp_size(ctx, device, std::max(subgroup_size, 1u), 64);
+    }
+
     template <size_t MAX_DISPARITY>
-    PathAggregation<MAX_DISPARITY>::PathAggregation(cl_context ctx, cl_device_id device)
-        : m_cost_buffer(ctx), m_down2up(ctx, device), m_up2down(ctx, device), m_right2left(ctx, device), m_left2right(ctx, device), m_upleft2downright(ctx, device), m_upright2downleft(ctx, device), m_downright2upleft(ctx, device), m_downleft2upright(ctx, device)
+    PathAggregation<MAX_DISPARITY>::PathAggregation(cl_context ctx,
+                                                    cl_device_id device,
+                                                    cl_command_queue_properties queue_properties,
+                                                    const TuningProfile &tuning)
+        : m_cost_buffer(ctx), m_fused_cost_buffer(ctx),
+          m_down2up(ctx, device, tuning), m_up2down(ctx, device, tuning),
+          m_right2left(ctx, device, tuning), m_left2right(ctx, device, tuning),
+          m_upleft2downright(ctx, device, tuning), m_upright2downleft(ctx, device, tuning),
+          m_downright2upleft(ctx, device, tuning), m_downleft2upright(ctx, device, tuning)
     {
         for (size_t i = 0; i < MAX_NUM_PATHS; ++i)
         {
             cl_int err;
-            m_streams[i] = clCreateCommandQueue(ctx, device, 0, &err);
+            m_streams[i] = clCreateCommandQueue(ctx, device, queue_properties, &err);
             CHECK_OCL_ERROR(err, "Failed to create command queue");
         }
     }
@@ -17,6 +114,7 @@ namespace sgmcl
     template <size_t MAX_DISPARITY>
     PathAggregation<MAX_DISPARITY>::~PathAggregation()
     {
+        release_sub_buffers();
         for (int i = 0; i < MAX_NUM_PATHS; ++i)
         {
             if (m_streams[i])
@@ -27,30 +125,84 @@ namespace sgmcl
         }
     }
 
+    template <size_t MAX_DISPARITY>
+    void PathAggregation<MAX_DISPARITY>::release_sub_buffers()
+    {
+        // sub buffers keep their parent alive, so they must go before m_cost_buffer
+        for (auto &sub_buffer : m_sub_buffers)
+        {
+            if (sub_buffer.data())
+            {
+                clReleaseMemObject(sub_buffer.data());
+            }
+        }
+        m_sub_buffers.clear();
+    }
+
     template <size_t MAX_DISPARITY>
     const DeviceBuffer<uint8_t> &PathAggregation<MAX_DISPARITY>::get_output() const
     {
         return m_cost_buffer;
     }
 
+    template <size_t MAX_DISPARITY>
+    const DeviceBuffer<uint16_t> &PathAggregation<MAX_DISPARITY>::get_fused_output() const
+    {
+        return m_fused_cost_buffer;
+    }
+
     template <size_t MAX_DISPARITY>
     void PathAggregation<MAX_DISPARITY>::enqueue(const DeviceBuffer<uint32_t> &left,
                                                  const DeviceBuffer<uint32_t> &right,
                                                  int width,
                                                  int height,
+                                                 int batch_size,
                                                  PathType path_type,
                                                  unsigned int p1,
                                                  unsigned int p2,
                                                  int min_disp,
-                                                 cl_command_queue stream)
+                                                 bool fused,
+                                                 cl_command_queue stream,
+                                                 cl_event *path_events)
     {
+        if (fused)
+        {
+            // every path accumulates into one uint16 volume, so the paths
+            // are serialized on the caller's in-order stream instead of
+            // running on the per path streams
+            const size_t fused_buffer_size = width * height * MAX_DISPARITY * batch_size;
+            if (m_fused_cost_buffer.size() != fused_buffer_size)
+            {
+                release_sub_buffers();
+                m_cost_buffer.destroy();
+                m_fused_cost_buffer.destroy();
+                m_fused_cost_buffer.allocate(fused_buffer_size);
+            }
+
+            m_up2down.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, false, stream, path_events ? &path_events[0] : nullptr);
+            m_down2up.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[1] : nullptr);
+            m_left2right.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[2] : nullptr);
+            m_right2left.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[3] : nullptr);
+            if (path_type == PathType::SCAN_8PATH)
+            {
+                m_upleft2downright.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[4] : nullptr);
+                m_upright2downleft.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[5] : nullptr);
+                m_downright2upleft.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[6] : nullptr);
+                m_downleft2upright.enqueue(m_fused_cost_buffer, left, right, width, height, batch_size, p1, p2, min_disp, true, stream, path_events ? &path_events[7] : nullptr);
+            }
+            return;
+        }
 
         //allocating memory
         const unsigned int num_paths = path_type == PathType::SCAN_4PATH ? 4 : 8;
-        const size_t buffer_size = width * height * MAX_DISPARITY * num_paths;
-        const size_t buffer_step = width * height * MAX_DISPARITY;
+        // each path volume holds the whole batch, image after image
+        const size_t buffer_step = width * height * MAX_DISPARITY * batch_size;
+        const size_t buffer_size = buffer_step * num_paths;
         if (m_cost_buffer.size() != buffer_size)
         {
+            m_fused_cost_buffer.destroy();
+            release_sub_buffers();
+            m_cost_buffer.destroy();
             m_cost_buffer.allocate(buffer_size);
             m_sub_buffers.resize(num_paths);
             for (unsigned i = 0; i < num_paths; ++i)
@@ -62,48 +214,63 @@ namespace sgmcl
             }
         }
 
-        cl_int err = clFinish(stream);
-        CHECK_OCL_ERROR(err, "Error finishing queue");
+        // the paths run on their own streams, they start once everything
+        // enqueued on the caller's stream (census, the previous frame's
+        // winner takes all reading m_cost_buffer) is done
+        cl_event ready = nullptr;
+        cl_int err = clEnqueueMarkerWithWaitList(stream, 0, nullptr, &ready);
+        CHECK_OCL_ERROR(err, "Error enqueuing path aggregation marker");
+        // other queues wait on it, so it must reach the device
+        clFlush(stream);
+        cl_event events[MAX_NUM_PATHS] = {};
         m_up2down.enqueue(
             m_sub_buffers[0],
             left,
             right,
             width,
             height,
+            batch_size,
             p1,
             p2,
             min_disp,
-            m_streams[0]);
+            m_streams[0],
+            1, &ready, &events[0]);
         m_down2up.enqueue(
             m_sub_buffers[1],
             left,
             right,
             width,
             height,
+            batch_size,
             p1,
             p2,
             min_disp,
-            m_streams[1]);
+            m_streams[1],
+            1, &ready, &events[1]);
         m_left2right.enqueue(
             m_sub_buffers[2],
             left,
             right,
             width,
             height,
+            batch_size,
             p1,
             p2,
             min_disp,
-            m_streams[2]);
+            m_streams[2],
+            1, &ready, &events[2]);
         m_right2left.enqueue(
             m_sub_buffers[3],
             left,
             right,
             width,
             height,
+            batch_size,
             p1,
             p2,
             min_disp,
-            m_streams[3]);
+            m_streams[3],
+            1, &ready, &events[3]);
 
         if (path_type == PathType::SCAN_8PATH)
         {
@@ -123,10 +290,12 @@ namespace sgmcl
                 right,
                 width,
                 height,
+                batch_size,
                 p1,
                 p2,
                 min_disp,
-                m_streams[4]);
+                m_streams[4],
+                1, &ready, &events[4]);
             //{
             //    int path_id = 4;
             //    clFinish(m_streams[path_id]);
@@ -163,20 +332,24 @@ namespace sgmcl
                 right,
                 width,
                 height,
+                batch_size,
                 p1,
                 p2,
                 min_disp,
-                m_streams[5]);
+                m_streams[5],
+                1, &ready, &events[5]);
             m_downright2upleft.enqueue(
                 m_sub_buffers[6],
                 left,
                 right,
                 width,
                 height,
+                batch_size,
                 p1,
                 p2,
                 min_disp,
-                m_streams[6]);
+                m_streams[6],
+                1, &ready, &events[6]);
 
             m_downleft2upright.enqueue(
                 m_sub_buffers[7],
@@ -184,17 +357,31 @@ namespace sgmcl
                 right,
                 width,
                 height,
+                batch_size,
                 p1,
                 p2,
                 min_disp,
-                m_streams[7]);
+                m_streams[7],
+                1, &ready, &events[7]);
         }
 
+        // later work on the caller's stream waits for every path
+        err = clEnqueueBarrierWithWaitList(stream, num_paths, events, nullptr);
+        CHECK_OCL_ERROR(err, "Error enqueuing path aggregation barrier");
         for (unsigned i = 0; i < num_paths; ++i)
         {
-            cl_int err = clFinish(m_streams[i]);
-            CHECK_OCL_ERROR(err, "Error finishing path aggregation!");
+            clFlush(m_streams[i]);
+            if (path_events)
+            {
+                // handed over to the caller
+                path_events[i] = events[i];
+            }
+            else
+            {
+                clReleaseEvent(events[i]);
+            }
         }
+        clReleaseEvent(ready);
     }
 
     template class PathAggregation<64>;
@@ -202,10 +389,15 @@ namespace sgmcl
     template class PathAggregation<256>;
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
-    VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::VerticalPathAggregation(cl_context ctx, cl_device_id device)
-        : m_cl_ctx(ctx), m_cl_device(device)
+    VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::VerticalPathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_ctx(ctx), m_cl_device(device),
+          m_dp_block_size(tuning.get(tuning_key("vertical", MAX_DISPARITY, "dp_block_size"), DEFAULT_DP_BLOCK_SIZE)),
+          m_warp_size(aggregation_warp_size(ctx, device, tuning, MAX_DISPARITY, m_dp_block_size)),
+          m_block_size(tuning.get(tuning_key("vertical", MAX_DISPARITY, "block_size"), m_warp_size * fit_warps_per_block(device, m_warp_size, DEFAULT_WARPS_PER_BLOCK))),
+          m_subgroup_shuffle(subgroup_shuffle_mode(device, tuning))
     {
         m_kernel = nullptr;
+        check_geometry(MAX_DISPARITY, m_warp_size, m_block_size, m_dp_block_size);
     }
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
@@ -224,16 +416,57 @@ namespace sgmcl
                                                                     const DeviceBuffer<uint32_t> &right,
                                                                     int width,
                                                                     int height,
+                                                                    int batch_size,
                                                                     unsigned int p1,
                                                                     unsigned int p2,
                                                                     int min_disp,
-                                                                    cl_command_queue stream)
+                                                                    cl_command_queue stream,
+                                                                    cl_uint num_wait_events,
+                                                                    const cl_event *wait_events,
+                                                                    cl_event *event)
     {
-        if (!m_kernel)
-            init();
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, false, false, stream, num_wait_events, wait_events, event);
+    }
+
+    template <int DIRECTION, unsigned int MAX_DISPARITY>
+    void VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::enqueue(DeviceBuffer<uint16_t> &dest,
+                                                                    const DeviceBuffer<uint32_t> &left,
+                                                                    const DeviceBuffer<uint32_t> &right,
+                                                                    int width,
+                                                                    int height,
+                                                                    int batch_size,
+                                                                    unsigned int p1,
+                                                                    unsigned int p2,
+                                                                    int min_disp,
+                                                                    bool accumulate,
+                                                                    cl_command_queue stream,
+                                                                    cl_event *event)
+    {
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, true, accumulate, stream, 0, nullptr, event);
+    }
+
+    template <int DIRECTION, unsigned int MAX_DISPARITY>
+    void VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::launch(const cl_mem &dest,
+                                                                   const DeviceBuffer<uint32_t> &left,
+                                                                   const DeviceBuffer<uint32_t> &right,
+                                                                   int width,
+                                                                   int height,
+                                                                   int batch_size,
+                                                                   unsigned int p1,
+                                                                   unsigned int p2,
+                                                                   int min_disp,
+                                                                   bool fused,
+                                                                   bool accumulate,
+                                                                   cl_command_queue stream,
+                                                                   cl_uint num_wait_events,
+                                                                   const cl_event *wait_events,
+                                                                   cl_event *event)
+    {
+        if (!m_kernel || m_fused != fused)
+            init(fused);
 
         cl_int err;
-        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest.data());
+        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest);
         err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &left.data());
         err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &right.data());
         err = clSetKernelArg(m_kernel, 3, sizeof(width), &width);
@@ -241,23 +474,25 @@ namespace sgmcl
         err = clSetKernelArg(m_kernel, 5, sizeof(p1), &p1);
         err = clSetKernelArg(m_kernel, 6, sizeof(p2), &p2);
         err = clSetKernelArg(m_kernel, 7, sizeof(min_disp), &min_disp);
+        int accumulate_int = accumulate ? 1 : 0;
+        err = clSetKernelArg(m_kernel, 8, sizeof(accumulate_int), &accumulate_int);
 
-        static const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-        static const unsigned int PATHS_PER_BLOCK = BLOCK_SIZE / SUBGROUP_SIZE;
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        const unsigned int PATHS_PER_BLOCK = m_block_size / SUBGROUP_SIZE;
 
         //setup kernels
         const size_t gdim = (width + PATHS_PER_BLOCK - 1) / PATHS_PER_BLOCK;
-        const size_t bdim = BLOCK_SIZE;
+        const size_t bdim = m_block_size;
         //
-        size_t global_size[1] = {gdim * bdim};
-        size_t local_size[1] = {bdim};
+        size_t global_size[2] = {gdim * bdim, (size_t)batch_size};
+        size_t local_size[2] = {bdim, 1};
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel,
-                                     1,
+                                     2,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     num_wait_events, wait_events, event);
         CHECK_OCL_ERROR(err, "Error finishing queue");
         //        clFinish(stream);
         //        cv::Mat debug(height, width, CV_8UC4);
@@ -267,54 +502,62 @@ namespace sgmcl
     }
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
-    void VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::init()
+    void VerticalPathAggregation<DIRECTION, MAX_DISPARITY>::init(bool fused)
     {
-        if (m_kernel == nullptr)
+        if (m_kernel)
         {
-            std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
-            fileInput1.open("data/ocl/inttypes.cl");
-            fileInput2.open("data/ocl/utility.cl");
-            fileInput3.open("data/ocl/path_aggregation_common.cl");
-            fileInput4.open("data/ocl/path_aggregation_vertical.cl");
-
-            std::string src1{std::istreambuf_iterator<char>(fileInput1),
-                             std::istreambuf_iterator<char>()};
-            std::string src2{std::istreambuf_iterator<char>(fileInput2),
-                             std::istreambuf_iterator<char>()};
-            std::string src3{std::istreambuf_iterator<char>(fileInput3),
-                             std::istreambuf_iterator<char>()};
-            std::string src4{std::istreambuf_iterator<char>(fileInput4),
-                             std::istreambuf_iterator<char>()};
-            std::string kernel_src = src1 + src2 + src3 + src4;
-
-            //Vertical path aggregation templates
-            std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
-            std::string kernel_direction = "#define DIRECTION " + std::to_string(DIRECTION) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DIRECTION@"), kernel_direction);
-
-            static const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-            //@DP_BLOCK_SIZE@
-            //@SUBGROUP_SIZE@
-            //@SIZE@
-            //@BLOCK_SIZE@
-            //Vertical path aggregation templates
-            std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(DP_BLOCK_SIZE) + "\n";
-            std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(BLOCK_SIZE) + "\n";
-            std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
-
-            //std::cout << "vertical_path_aggregation combined: " << std::endl;
-            //std::cout << kernel_src << std::endl;
-
-            m_program.init(m_cl_ctx, m_cl_device, kernel_src);
-            //DEBUG
-            m_kernel = m_program.getKernel("aggregate_vertical_path_kernel");
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
         }
+        m_fused = fused;
+
+        std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
+        fileInput1.open("data/ocl/inttypes.cl");
+        fileInput2.open("data/ocl/utility.cl");
+        fileInput3.open("data/ocl/path_aggregation_common.cl");
+        fileInput4.open("data/ocl/path_aggregation_vertical.cl");
+
+        std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                         std::istreambuf_iterator<char>()};
+        std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                         std::istreambuf_iterator<char>()};
+        std::string src3{std::istreambuf_iterator<char>(fileInput3),
+                         std::istreambuf_iterator<char>()};
+        std::string src4{std::istreambuf_iterator<char>(fileInput4),
+                         std::istreambuf_iterator<char>()};
+        std::string kernel_src = src1 + src2 + src3 + src4;
+
+        //Vertical path aggregation templates
+        std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
+        std::string kernel_direction = "#define DIRECTION " + std::to_string(DIRECTION) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DIRECTION@"), kernel_direction);
+
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        //@DP_BLOCK_SIZE@
+        //@SUBGROUP_SIZE@
+        //@SIZE@
+        //@BLOCK_SIZE@
+        //Vertical path aggregation templates
+        std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(m_dp_block_size) + "\n";
+        std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(m_block_size) + "\n";
+        std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(m_fused ? 1 : 0) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+        std::string kernel_WARP_SIZE = "#define WARP_SIZE " + std::to_string(m_warp_size) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@WARP_SIZE@"), kernel_WARP_SIZE);
+
+        //std::cout << "vertical_path_aggregation combined: " << std::endl;
+        //std::cout << kernel_src << std::endl;
+
+        build_aggregation_program(m_program, m_cl_ctx, m_cl_device, kernel_src, m_subgroup_shuffle);
+        //DEBUG
+        m_kernel = m_program.getKernel("aggregate_vertical_path_kernel");
     }
     //down2up
     template class VerticalPathAggregation<-1, 64>;
@@ -326,9 +569,16 @@ namespace sgmcl
     template class VerticalPathAggregation<1, 256>;
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
-    HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::HorizontalPathAggregation(cl_context ctx, cl_device_id device)
-        : m_cl_ctx(ctx), m_cl_device(device)
+    HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::HorizontalPathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_ctx(ctx), m_cl_device(device),
+          m_dp_block_size(tuning.get(tuning_key("horizontal", MAX_DISPARITY, "dp_block_size"), DEFAULT_DP_BLOCK_SIZE)),
+          m_warp_size(aggregation_warp_size(ctx, device, tuning, MAX_DISPARITY, m_dp_block_size)),
+          m_warps_per_block(tuning.get(tuning_key("horizontal", MAX_DISPARITY, "warps_per_block"),
+                                       fit_warps_per_block(device, m_warp_size, DEFAULT_WARPS_PER_BLOCK))),
+          m_block_size(m_warp_size * m_warps_per_block),
+          m_subgroup_shuffle(subgroup_shuffle_mode(device, tuning))
     {
+        check_geometry(MAX_DISPARITY, m_warp_size, m_block_size, m_dp_block_size);
     }
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
@@ -347,16 +597,57 @@ namespace sgmcl
                                                                       const DeviceBuffer<uint32_t> &right,
                                                                       int width,
                                                                       int height,
+                                                                      int batch_size,
+                                                                      unsigned int p1,
+                                                                      unsigned int p2,
+                                                                      int min_disp,
+                                                                      cl_command_queue stream,
+                                                                      cl_uint num_wait_events,
+                                                                      const cl_event *wait_events,
+                                                                      cl_event *event)
+    {
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, false, false, stream, num_wait_events, wait_events, event);
+    }
+
+    template <int DIRECTION, unsigned int MAX_DISPARITY>
+    void HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::enqueue(DeviceBuffer<uint16_t> &dest,
+                                                                      const DeviceBuffer<uint32_t> &left,
+                                                                      const DeviceBuffer<uint32_t> &right,
+                                                                      int width,
+                                                                      int height,
+                                                                      int batch_size,
                                                                       unsigned int p1,
                                                                       unsigned int p2,
                                                                       int min_disp,
-                                                                      cl_command_queue stream)
+                                                                      bool accumulate,
+                                                                      cl_command_queue stream,
+                                                                      cl_event *event)
     {
-        if (!m_kernel)
-            init();
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, true, accumulate, stream, 0, nullptr, event);
+    }
+
+    template <int DIRECTION, unsigned int MAX_DISPARITY>
+    void HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::launch(const cl_mem &dest,
+                                                                     const DeviceBuffer<uint32_t> &left,
+                                                                     const DeviceBuffer<uint32_t> &right,
+                                                                     int width,
+                                                                     int height,
+                                                                     int batch_size,
+                                                                     unsigned int p1,
+                                                                     unsigned int p2,
+                                                                     int min_disp,
+                                                                     bool fused,
+                                                                     bool accumulate,
+                                                                     cl_command_queue stream,
+                                                                     cl_uint num_wait_events,
+                                                                     const cl_event *wait_events,
+                                                                     cl_event *event)
+    {
+        if (!m_kernel || m_fused != fused)
+            init(fused);
 
         cl_int err;
-        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest.data());
+        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest);
         err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &left.data());
         err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &right.data());
         err = clSetKernelArg(m_kernel, 3, sizeof(width), &width);
@@ -364,24 +655,27 @@ namespace sgmcl
         err = clSetKernelArg(m_kernel, 5, sizeof(p1), &p1);
         err = clSetKernelArg(m_kernel, 6, sizeof(p2), &p2);
         err = clSetKernelArg(m_kernel, 7, sizeof(min_disp), &min_disp);
+        int accumulate_int = accumulate ? 1 : 0;
+        err = clSetKernelArg(m_kernel, 8, sizeof(accumulate_int), &accumulate_int);
 
-        static const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-        static const unsigned int PATHS_PER_BLOCK =
-            BLOCK_SIZE * DP_BLOCKS_PER_THREAD / SUBGROUP_SIZE;
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        const unsigned int PATHS_PER_BLOCK =
+            m_block_size * DP_BLOCKS_PER_THREAD / SUBGROUP_SIZE;
 
         //setup kernels
         const size_t gdim = (height + PATHS_PER_BLOCK - 1) / PATHS_PER_BLOCK;
-        const size_t bdim = BLOCK_SIZE;
+        const size_t bdim = m_block_size;
         //
-        size_t global_size[1] = {gdim * bdim};
-        size_t local_size[1] = {bdim};
+        size_t global_size[2] = {gdim * bdim, (size_t)batch_size};
+        size_t local_size[2] = {bdim, 1};
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel,
-                                     1,
+                                     2,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     num_wait_events, wait_events, event);
+        CHECK_OCL_ERROR(err, "Error enqueuing path aggregation");
         //cl_int errr = clFinish(stream);
         //CHECK_OCL_ERROR(err, "Error finishing queue");
         //cv::Mat debug(height, width, CV_8UC4);
@@ -391,57 +685,65 @@ namespace sgmcl
     }
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
-    void HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::init()
+    void HorizontalPathAggregation<DIRECTION, MAX_DISPARITY>::init(bool fused)
     {
-        if (m_kernel == nullptr)
+        if (m_kernel)
         {
-            //reading cl files
-            std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
-            fileInput1.open("data/ocl/inttypes.cl");
-            fileInput2.open("data/ocl/utility.cl");
-            fileInput3.open("data/ocl/path_aggregation_common.cl");
-            fileInput4.open("data/ocl/path_aggregation_horizontal.cl");
-
-            std::string src1{std::istreambuf_iterator<char>(fileInput1),
-                             std::istreambuf_iterator<char>()};
-            std::string src2{std::istreambuf_iterator<char>(fileInput2),
-                             std::istreambuf_iterator<char>()};
-            std::string src3{std::istreambuf_iterator<char>(fileInput3),
-                             std::istreambuf_iterator<char>()};
-            std::string src4{std::istreambuf_iterator<char>(fileInput4),
-                             std::istreambuf_iterator<char>()};
-            std::string kernel_src = src1 + src2 + src3 + src4;
-
-            //Vertical path aggregation templates
-            std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
-            std::string kernel_direction = "#define DIRECTION " + std::to_string(DIRECTION) + "\n";
-            std::string kernel_DP_BLOCKS_PER_THREAD = "#define DP_BLOCKS_PER_THREAD " + std::to_string(DP_BLOCKS_PER_THREAD) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DIRECTION@"), kernel_direction);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCKS_PER_THREAD@"), kernel_DP_BLOCKS_PER_THREAD);
-
-            static const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-            //@DP_BLOCK_SIZE@
-            //@SUBGROUP_SIZE@
-            //@SIZE@
-            //@BLOCK_SIZE@
-            //path aggregation common templates
-            std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(DP_BLOCK_SIZE) + "\n";
-            std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(BLOCK_SIZE) + "\n";
-            std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
-
-            //std::cout << "horizontal_path_aggregation combined: " << std::endl;
-            //std::cout << kernel_src << std::endl;
-
-            m_program.init(m_cl_ctx, m_cl_device, kernel_src);
-            //DEBUG
-            m_kernel = m_program.getKernel("aggregate_horizontal_path_kernel");
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
         }
+        m_fused = fused;
+
+        //reading cl files
+        std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
+        fileInput1.open("data/ocl/inttypes.cl");
+        fileInput2.open("data/ocl/utility.cl");
+        fileInput3.open("data/ocl/path_aggregation_common.cl");
+        fileInput4.open("data/ocl/path_aggregation_horizontal.cl");
+
+        std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                         std::istreambuf_iterator<char>()};
+        std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                         std::istreambuf_iterator<char>()};
+        std::string src3{std::istreambuf_iterator<char>(fileInput3),
+                         std::istreambuf_iterator<char>()};
+        std::string src4{std::istreambuf_iterator<char>(fileInput4),
+                         std::istreambuf_iterator<char>()};
+        std::string kernel_src = src1 + src2 + src3 + src4;
+
+        //Vertical path aggregation templates
+        std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
+        std::string kernel_direction = "#define DIRECTION " + std::to_string(DIRECTION) + "\n";
+        std::string kernel_DP_BLOCKS_PER_THREAD = "#define DP_BLOCKS_PER_THREAD " + std::to_string(DP_BLOCKS_PER_THREAD) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DIRECTION@"), kernel_direction);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCKS_PER_THREAD@"), kernel_DP_BLOCKS_PER_THREAD);
+
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        //@DP_BLOCK_SIZE@
+        //@SUBGROUP_SIZE@
+        //@SIZE@
+        //@BLOCK_SIZE@
+        //path aggregation common templates
+        std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(m_dp_block_size) + "\n";
+        std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(m_block_size) + "\n";
+        std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(m_fused ? 1 : 0) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+        std::string kernel_WARP_SIZE = "#define WARP_SIZE " + std::to_string(m_warp_size) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@WARP_SIZE@"), kernel_WARP_SIZE);
+
+        //std::cout << "horizontal_path_aggregation combined: " << std::endl;
+        //std::cout << kernel_src << std::endl;
+
+        build_aggregation_program(m_program, m_cl_ctx, m_cl_device, kernel_src, m_subgroup_shuffle);
+        //DEBUG
+        m_kernel = m_program.getKernel("aggregate_horizontal_path_kernel");
     }
     //down2up
     template class HorizontalPathAggregation<-1, 64>;
@@ -453,9 +755,14 @@ namespace sgmcl
     template class HorizontalPathAggregation<1, 256>;
 
     template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
-    ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::ObliquePathAggregation(cl_context ctx, cl_device_id device)
-        : m_cl_ctx(ctx), m_cl_device(device)
+    ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::ObliquePathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_ctx(ctx), m_cl_device(device),
+          m_dp_block_size(tuning.get(tuning_key("oblique", MAX_DISPARITY, "dp_block_size"), DEFAULT_DP_BLOCK_SIZE)),
+          m_warp_size(aggregation_warp_size(ctx, device, tuning, MAX_DISPARITY, m_dp_block_size)),
+          m_block_size(tuning.get(tuning_key("oblique", MAX_DISPARITY, "block_size"), m_warp_size * fit_warps_per_block(device, m_warp_size, DEFAULT_WARPS_PER_BLOCK))),
+          m_subgroup_shuffle(subgroup_shuffle_mode(device, tuning))
     {
+        check_geometry(MAX_DISPARITY, m_warp_size, m_block_size, m_dp_block_size);
     }
 
     template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
@@ -474,16 +781,57 @@ namespace sgmcl
                                                                                   const DeviceBuffer<uint32_t> &right,
                                                                                   int width,
                                                                                   int height,
+                                                                                  int batch_size,
                                                                                   unsigned int p1,
                                                                                   unsigned int p2,
                                                                                   int min_disp,
-                                                                                  cl_command_queue stream)
+                                                                                  cl_command_queue stream,
+                                                                                  cl_uint num_wait_events,
+                                                                                  const cl_event *wait_events,
+                                                                                  cl_event *event)
     {
-        if (!m_kernel)
-            init();
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, false, false, stream, num_wait_events, wait_events, event);
+    }
+
+    template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
+    void ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::enqueue(DeviceBuffer<uint16_t> &dest,
+                                                                                  const DeviceBuffer<uint32_t> &left,
+                                                                                  const DeviceBuffer<uint32_t> &right,
+                                                                                  int width,
+                                                                                  int height,
+                                                                                  int batch_size,
+                                                                                  unsigned int p1,
+                                                                                  unsigned int p2,
+                                                                                  int min_disp,
+                                                                                  bool accumulate,
+                                                                                  cl_command_queue stream,
+                                                                                  cl_event *event)
+    {
+        launch(dest.data(), left, right, width, height, batch_size, p1, p2, min_disp, true, accumulate, stream, 0, nullptr, event);
+    }
+
+    template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
+    void ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::launch(const cl_mem &dest,
+                                                                                 const DeviceBuffer<uint32_t> &left,
+                                                                                 const DeviceBuffer<uint32_t> &right,
+                                                                                 int width,
+                                                                                 int height,
+                                                                                 int batch_size,
+                                                                                 unsigned int p1,
+                                                                                 unsigned int p2,
+                                                                                 int min_disp,
+                                                                                 bool fused,
+                                                                                 bool accumulate,
+                                                                                 cl_command_queue stream,
+                                                                                 cl_uint num_wait_events,
+                                                                                 const cl_event *wait_events,
+                                                                                 cl_event *event)
+    {
+        if (!m_kernel || m_fused != fused)
+            init(fused);
 
         cl_int err;
-        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest.data());
+        err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest);
         err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &left.data());
         err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &right.data());
         err = clSetKernelArg(m_kernel, 3, sizeof(width), &width);
@@ -491,22 +839,25 @@ namespace sgmcl
         err = clSetKernelArg(m_kernel, 5, sizeof(p1), &p1);
         err = clSetKernelArg(m_kernel, 6, sizeof(p2), &p2);
         err = clSetKernelArg(m_kernel, 7, sizeof(min_disp), &min_disp);
+        int accumulate_int = accumulate ? 1 : 0;
+        err = clSetKernelArg(m_kernel, 8, sizeof(accumulate_int), &accumulate_int);
 
-        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-        const unsigned int PATHS_PER_BLOCK = BLOCK_SIZE / SUBGROUP_SIZE;
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        const unsigned int PATHS_PER_BLOCK = m_block_size / SUBGROUP_SIZE;
 
         const unsigned gdim = (width + height + PATHS_PER_BLOCK - 2) / PATHS_PER_BLOCK;
-        const unsigned bdim = BLOCK_SIZE;
+        const unsigned bdim = m_block_size;
         //
-        size_t global_size[1] = {gdim * bdim};
-        size_t local_size[1] = {bdim};
+        size_t global_size[2] = {gdim * bdim, (size_t)batch_size};
+        size_t local_size[2] = {bdim, 1};
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel,
-                                     1,
+                                     2,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     num_wait_events, wait_events, event);
+        CHECK_OCL_ERROR(err, "Error enqueuing path aggregation");
         //cl_int errr = clFinish(stream);
         //CHECK_OCL_ERROR(err, "Error finishing queue");
         //cv::Mat debug(height, width, CV_8UC4);
@@ -516,56 +867,64 @@ namespace sgmcl
     }
 
     template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
-    void ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::init()
+    void ObliquePathAggregation<X_DIRECTION, Y_DIRECTION, MAX_DISPARITY>::init(bool fused)
     {
-        if (m_kernel == nullptr)
+        if (m_kernel)
         {
-            std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
-            fileInput1.open("data/ocl/inttypes.cl");
-            fileInput2.open("data/ocl/utility.cl");
-            fileInput3.open("data/ocl/path_aggregation_common.cl");
-            fileInput4.open("data/ocl/path_aggregation_oblique.cl");
-
-            std::string src1{std::istreambuf_iterator<char>(fileInput1),
-                             std::istreambuf_iterator<char>()};
-            std::string src2{std::istreambuf_iterator<char>(fileInput2),
-                             std::istreambuf_iterator<char>()};
-            std::string src3{std::istreambuf_iterator<char>(fileInput3),
-                             std::istreambuf_iterator<char>()};
-            std::string src4{std::istreambuf_iterator<char>(fileInput4),
-                             std::istreambuf_iterator<char>()};
-            std::string kernel_src = src1 + src2 + src3 + src4;
-
-            //Vertical path aggregation templates
-            std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
-            std::string kernel_x_direction = "#define X_DIRECTION " + std::to_string(X_DIRECTION) + "\n";
-            std::string kernel_y_direction = "#define Y_DIRECTION " + std::to_string(Y_DIRECTION) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@X_DIRECTION@"), kernel_x_direction);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@Y_DIRECTION@"), kernel_y_direction);
-
-            static const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / DP_BLOCK_SIZE;
-            //@DP_BLOCK_SIZE@
-            //@SUBGROUP_SIZE@
-            //@SIZE@
-            //@BLOCK_SIZE@
-            //path aggregation common templates
-            std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(DP_BLOCK_SIZE) + "\n";
-            std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(BLOCK_SIZE) + "\n";
-            std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
-            kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
-            kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
-
-            //std::cout << "horizontal_path_aggregation combined: " << std::endl;
-            //std::cout << kernel_src << std::endl;
-
-            m_program.init(m_cl_ctx, m_cl_device, kernel_src);
-            //DEBUG
-            m_kernel = m_program.getKernel("aggregate_oblique_path_kernel");
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
         }
+        m_fused = fused;
+
+        std::ifstream fileInput1, fileInput2, fileInput3, fileInput4;
+        fileInput1.open("data/ocl/inttypes.cl");
+        fileInput2.open("data/ocl/utility.cl");
+        fileInput3.open("data/ocl/path_aggregation_common.cl");
+        fileInput4.open("data/ocl/path_aggregation_oblique.cl");
+
+        std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                         std::istreambuf_iterator<char>()};
+        std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                         std::istreambuf_iterator<char>()};
+        std::string src3{std::istreambuf_iterator<char>(fileInput3),
+                         std::istreambuf_iterator<char>()};
+        std::string src4{std::istreambuf_iterator<char>(fileInput4),
+                         std::istreambuf_iterator<char>()};
+        std::string kernel_src = src1 + src2 + src3 + src4;
+
+        //Vertical path aggregation templates
+        std::string kernel_max_disparoty = "#define MAX_DISPARITY " + std::to_string(MAX_DISPARITY) + "\n";
+        std::string kernel_x_direction = "#define X_DIRECTION " + std::to_string(X_DIRECTION) + "\n";
+        std::string kernel_y_direction = "#define Y_DIRECTION " + std::to_string(Y_DIRECTION) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@X_DIRECTION@"), kernel_x_direction);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@Y_DIRECTION@"), kernel_y_direction);
+
+        const unsigned int SUBGROUP_SIZE = MAX_DISPARITY / m_dp_block_size;
+        //@DP_BLOCK_SIZE@
+        //@SUBGROUP_SIZE@
+        //@SIZE@
+        //@BLOCK_SIZE@
+        //path aggregation common templates
+        std::string kernel_DP_BLOCK_SIZE = "#define DP_BLOCK_SIZE " + std::to_string(m_dp_block_size) + "\n";
+        std::string kernel_SUBGROUP_SIZE = "#define SUBGROUP_SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(m_block_size) + "\n";
+        std::string kernel_SIZE = "#define SIZE " + std::to_string(SUBGROUP_SIZE) + "\n";
+        std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(m_fused ? 1 : 0) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@DP_BLOCK_SIZE@"), kernel_DP_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SUBGROUP_SIZE@"), kernel_SUBGROUP_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@SIZE@"), kernel_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
+        kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+        std::string kernel_WARP_SIZE = "#define WARP_SIZE " + std::to_string(m_warp_size) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@WARP_SIZE@"), kernel_WARP_SIZE);
+
+        //std::cout << "horizontal_path_aggregation combined: " << std::endl;
+        //std::cout << kernel_src << std::endl;
+
+        build_aggregation_program(m_program, m_cl_ctx, m_cl_device, kernel_src, m_subgroup_shuffle);
+        //DEBUG
+        m_kernel = m_program.getKernel("aggregate_oblique_path_kernel");
     }
 
     //upleft2downright
@@ -18,12 +18,20 @@ limitations under the License.
 
 namespace sgmcl
 {
+    // Lanes of a warp in the aggregation kernels: the device SIMD width, but at least one
+    // path of max_disparity / dp_block_size lanes per warp.
+    unsigned int aggregation_warp_size(cl_context ctx, cl_device_id device, const TuningProfile &tuning,
+                                       unsigned int max_disparity, unsigned int dp_block_size);
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
     class VerticalPathAggregation
     {
     public:
-        VerticalPathAggregation(cl_context ctx, cl_device_id device);
+        // Defaults of the tuning keys "vertical.d<MAX_DISPARITY>.block_size" (in warps) and ".dp_block_size".
+        static constexpr unsigned int DEFAULT_WARPS_PER_BLOCK = 8u;
+        static constexpr unsigned int DEFAULT_DP_BLOCK_SIZE = 16u;
+
+        VerticalPathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
         ~VerticalPathAggregation();
 
         void enqueue(DeviceBuffer<uint8_t> &dest,
@@ -31,28 +39,69 @@ namespace sgmcl
                      const DeviceBuffer<uint32_t> &right,
                      int width,
                      int height,
+                     int batch_size,
                      unsigned int p1,
                      unsigned int p2,
                      int min_disp,
-                     cl_command_queue stream);
+                     cl_command_queue stream,
+                     cl_uint num_wait_events = 0,
+                     const cl_event *wait_events = nullptr,
+                     cl_event *event = nullptr);
 
-    private:
-        void init();
-        static constexpr unsigned int WARP_SIZE = 32;
-        static constexpr unsigned int BLOCK_SIZE = WARP_SIZE * 8u;
-        static constexpr unsigned int DP_BLOCK_SIZE = 16u;
+        // Adds the path costs to a shared uint16 cost volume (stores them if accumulate is false).
+        void enqueue(DeviceBuffer<uint16_t> &dest,
+                     const DeviceBuffer<uint32_t> &left,
+                     const DeviceBuffer<uint32_t> &right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     unsigned int p1,
+                     unsigned int p2,
+                     int min_disp,
+                     bool accumulate,
+                     cl_command_queue stream,
+                     cl_event *event = nullptr);
 
+    private:
+        void init(bool fused);
+        void launch(const cl_mem &dest,
+                    const DeviceBuffer<uint32_t> &left,
+                    const DeviceBuffer<uint32_t> &right,
+                    int width,
+                    int height,
+                    int batch_size,
+                    unsigned int p1,
+                    unsigned int p2,
+                    int min_disp,
+                    bool fused,
+                    bool accumulate,
+                    cl_command_queue stream,
+                    cl_uint num_wait_events,
+                    const cl_event *wait_events,
+                    cl_event *event);
         DeviceProgram m_program;
         cl_context m_cl_ctx;
         cl_device_id m_cl_device;
         cl_kernel m_kernel = nullptr;
+        bool m_fused = false;
+
+        unsigned int m_dp_block_size;
+        // device SIMD width, see TuningProfile::warp_size
+        unsigned int m_warp_size;
+        unsigned int m_block_size;
+        // native subgroup shuffles, see path_aggregation_common.cl
+        int m_subgroup_shuffle;
     };
 
     template <int DIRECTION, unsigned int MAX_DISPARITY>
     class HorizontalPathAggregation
     {
     public:
-        HorizontalPathAggregation(cl_context ctx, cl_device_id device);
+        // Defaults of the tuning keys "horizontal.d<MAX_DISPARITY>.warps_per_block" and ".dp_block_size".
+        static constexpr unsigned int DEFAULT_WARPS_PER_BLOCK = 4u;
+        static constexpr unsigned int DEFAULT_DP_BLOCK_SIZE = 8u;
+
+        HorizontalPathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
         ~HorizontalPathAggregation();
 
         void enqueue(DeviceBuffer<uint8_t> &dest,
@@ -60,31 +109,73 @@ namespace sgmcl
                      const DeviceBuffer<uint32_t> &right,
                      int width,
                      int height,
+                     int batch_size,
                      unsigned int p1,
                      unsigned int p2,
                      int min_disp,
-                     cl_command_queue stream);
+                     cl_command_queue stream,
+                     cl_uint num_wait_events = 0,
+                     const cl_event *wait_events = nullptr,
+                     cl_event *event = nullptr);
+
+        // Adds the path costs to a shared uint16 cost volume (stores them if accumulate is false).
+        void enqueue(DeviceBuffer<uint16_t> &dest,
+                     const DeviceBuffer<uint32_t> &left,
+                     const DeviceBuffer<uint32_t> &right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     unsigned int p1,
+                     unsigned int p2,
+                     int min_disp,
+                     bool accumulate,
+                     cl_command_queue stream,
+                     cl_event *event = nullptr);
 
     private:
-        void init();
+        void init(bool fused);
+        void launch(const cl_mem &dest,
+                    const DeviceBuffer<uint32_t> &left,
+                    const DeviceBuffer<uint32_t> &right,
+                    int width,
+                    int height,
+                    int batch_size,
+                    unsigned int p1,
+                    unsigned int p2,
+                    int min_disp,
+                    bool fused,
+                    bool accumulate,
+                    cl_command_queue stream,
+                    cl_uint num_wait_events,
+                    const cl_event *wait_events,
+                    cl_event *event);
 
         DeviceProgram m_program;
         cl_context m_cl_ctx = nullptr;
         cl_device_id m_cl_device = nullptr;
         cl_kernel m_kernel = nullptr;
+        bool m_fused = false;
 
-        static constexpr unsigned int WARP_SIZE = 32;
-        static constexpr unsigned int DP_BLOCK_SIZE = 8u;
         static constexpr unsigned int DP_BLOCKS_PER_THREAD = 1u;
-        static constexpr unsigned int WARPS_PER_BLOCK = 4u;
-        static constexpr unsigned int BLOCK_SIZE = WARP_SIZE * WARPS_PER_BLOCK;
+
+        unsigned int m_dp_block_size;
+        // device SIMD width, see TuningProfile::warp_size
+        unsigned int m_warp_size;
+        unsigned int m_warps_per_block;
+        unsigned int m_block_size;
+        // native subgroup shuffles, see path_aggregation_common.cl
+        int m_subgroup_shuffle;
     };
 
     template <int X_DIRECTION, int Y_DIRECTION, unsigned int MAX_DISPARITY>
     struct ObliquePathAggregation
     {
     public:
-        ObliquePathAggregation(cl_context ctx, cl_device_id device);
+        // Defaults of the tuning keys "oblique.d<MAX_DISPARITY>.block_size" (in warps) and ".dp_block_size".
+        static constexpr unsigned int DEFAULT_WARPS_PER_BLOCK = 8u;
+        static constexpr unsigned int DEFAULT_DP_BLOCK_SIZE = 16u;
+
+        ObliquePathAggregation(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
         ~ObliquePathAggregation();
 
         void enqueue(DeviceBuffer<uint8_t> &dest,
@@ -92,48 +183,101 @@ namespace sgmcl
                      const DeviceBuffer<uint32_t> &right,
                      int width,
                      int height,
+                     int batch_size,
                      unsigned int p1,
                      unsigned int p2,
                      int min_disp,
-                     cl_command_queue stream);
+                     cl_command_queue stream,
+                     cl_uint num_wait_events = 0,
+                     const cl_event *wait_events = nullptr,
+                     cl_event *event = nullptr);
+
+        // Adds the path costs to a shared uint16 cost volume (stores them if accumulate is false).
+        void enqueue(DeviceBuffer<uint16_t> &dest,
+                     const DeviceBuffer<uint32_t> &left,
+                     const DeviceBuffer<uint32_t> &right,
+                     int width,
+                     int height,
+                     int batch_size,
+                     unsigned int p1,
+                     unsigned int p2,
+                     int min_disp,
+                     bool accumulate,
+                     cl_command_queue stream,
+                     cl_event *event = nullptr);
 
     private:
         DeviceProgram m_program;
         cl_context m_cl_ctx = nullptr;
         cl_device_id m_cl_device = nullptr;
         cl_kernel m_kernel = nullptr;
+        bool m_fused = false;
 
-        static constexpr unsigned int WARP_SIZE = 32;
-        static constexpr unsigned int DP_BLOCK_SIZE = 16u;
-        static constexpr unsigned int BLOCK_SIZE = WARP_SIZE * 8u;
+        unsigned int m_dp_block_size;
+        // device SIMD width, see TuningProfile::warp_size
+        unsigned int m_warp_size;
+        unsigned int m_block_size;
+        // native subgroup shuffles, see path_aggregation_common.cl
+        int m_subgroup_shuffle;
 
-        void init();
+        void init(bool fused);
+        void launch(const cl_mem &dest,
+                    const DeviceBuffer<uint32_t> &left,
+                    const DeviceBuffer<uint32_t> &right,
+                    int width,
+                    int height,
+                    int batch_size,
+                    unsigned int p1,
+                    unsigned int p2,
+                    int min_disp,
+                    bool fused,
+                    bool accumulate,
+                    cl_command_queue stream,
+                    cl_uint num_wait_events,
+                    const cl_event *wait_events,
+                    cl_event *event);
     };
 
     template <size_t MAX_DISPARITY>
     class PathAggregation
     {
     public:
-        PathAggregation(cl_context ctx, cl_device_id device);
+        // The per path queues are created with queue_properties (e.g. CL_QUEUE_PROFILING_ENABLE),
+        // the directions take their launch geometry from tuning.
+        PathAggregation(cl_context ctx,
+                        cl_device_id device,
+                        cl_command_queue_properties queue_properties = 0,
+                        const TuningProfile &tuning = TuningProfile());
         ~PathAggregation();
 
+        // Per path uint8 cost volumes, valid after a non fused enqueue.
         const DeviceBuffer<uint8_t> &get_output() const;
+        // Sum of all path costs as one uint16 cost volume, valid after a fused enqueue.
+        const DeviceBuffer<uint16_t> &get_fused_output() const;
 
+        // path_events, if given, receives one kernel event per path (num_paths of them,
+        // in the order of the members below) which the caller has to release.
         void enqueue(
             const DeviceBuffer<uint32_t> &left,
             const DeviceBuffer<uint32_t> &right,
             int width,
             int height,
+            int batch_size,
             PathType path_type,
             unsigned int p1,
             unsigned int p2,
             int min_disp,
-            cl_command_queue stream);
+            bool fused,
+            cl_command_queue stream,
+            cl_event *path_events = nullptr);
 
     private:
+        void release_sub_buffers();
+
         static const unsigned int MAX_NUM_PATHS = 8;
 
         DeviceBuffer<uint8_t> m_cost_buffer;
+        DeviceBuffer<uint16_t> m_fused_cost_buffer;
         std::vector<DeviceBuffer<uint8_t>> m_sub_buffers;
         cl_command_queue m_streams[MAX_NUM_PATHS];
 
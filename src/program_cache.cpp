@@ -0,0 +1,290 @@
+#include "program_cache.h"
+#include "cl_utilities.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace sgmcl
+{
+    namespace
+    {
+        // bump when the file layout changes
+        const char CACHE_MAGIC[] = "SGMCL_PROGRAM_CACHE 1";
+
+        std::mutex &cache_mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        struct SharedProgram
+        {
+            cl_program program;
+            size_t users;
+        };
+        using SharedKey = std::tuple<cl_context, cl_device_id, std::string>;
+
+        std::mutex &shared_mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        std::map<SharedKey, SharedProgram> &shared_programs()
+        {
+            static std::map<SharedKey, SharedProgram> programs;
+            return programs;
+        }
+
+        std::string &cache_directory()
+        {
+            static std::string dir;
+            return dir;
+        }
+
+        uint64_t fnv1a(const std::string &str, uint64_t hash = 14695981039346656037ull)
+        {
+            for (unsigned char c : str)
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        std::string to_hex(uint64_t value)
+        {
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+            return buf;
+        }
+
+        // The build options belong to the program, entries without options keep their keys.
+        std::string program_identity(const std::string &source, const std::string &options)
+        {
+            return options.empty() ? source : options + "\n" + source;
+        }
+
+        // Header identifying an entry, the binary follows it.
+        std::string entry_header(cl_device_id device, const std::string &source, size_t binary_size)
+        {
+            std::ostringstream header;
+            header << CACHE_MAGIC << "\n"
+                   << device_info_string(device, CL_DEVICE_NAME) << "\n"
+                   << device_info_string(device, CL_DRIVER_VERSION) << "\n"
+                   << to_hex(fnv1a(source)) << "\n"
+                   << binary_size << "\n";
+            return header.str();
+        }
+
+        std::string entry_path(const std::string &dir, cl_device_id device, const std::string &source)
+        {
+            const uint64_t key = fnv1a(source,
+                                       fnv1a(device_info_string(device, CL_DEVICE_NAME) + "\n" +
+                                             device_info_string(device, CL_DRIVER_VERSION) + "\n"));
+            return (std::filesystem::path(dir) / (to_hex(key) + ".clbin")).string();
+        }
+    } // namespace
+
+    void ProgramCache::setDirectory(const std::string &dir)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex());
+        cache_directory() = dir;
+        if (!dir.empty())
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+        }
+    }
+
+    std::string ProgramCache::directory()
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex());
+        return cache_directory();
+    }
+
+    cl_program ProgramCache::load(cl_context ctx, cl_device_id device, const std::string &source, const std::string &options)
+    {
+        const std::string identity = program_identity(source, options);
+        const std::string dir = directory();
+        if (dir.empty())
+        {
+            return nullptr;
+        }
+
+        std::ifstream file(entry_path(dir, device, identity), std::ios::binary);
+        if (!file)
+        {
+            return nullptr;
+        }
+        std::string magic, name, driver, source_hash, size_line;
+        std::getline(file, magic);
+        std::getline(file, name);
+        std::getline(file, driver);
+        std::getline(file, source_hash);
+        std::getline(file, size_line);
+        if (!file)
+        {
+            return nullptr;
+        }
+        const size_t binary_size = std::strtoull(size_line.c_str(), nullptr, 10);
+        // a hash collision or a driver update makes the entry stale
+        const std::string header = magic + "\n" + name + "\n" + driver + "\n" + source_hash + "\n" + size_line + "\n";
+        if (binary_size == 0 || header != entry_header(device, identity, binary_size))
+        {
+            return nullptr;
+        }
+
+        std::vector<unsigned char> binary(binary_size);
+        file.read(reinterpret_cast<char *>(binary.data()), binary_size);
+        if (static_cast<size_t>(file.gcount()) != binary_size)
+        {
+            return nullptr;
+        }
+
+        const unsigned char *binary_ptr = binary.data();
+        cl_int binary_status = CL_SUCCESS;
+        cl_int err;
+        cl_program program = clCreateProgramWithBinary(ctx, 1, &device, &binary_size, &binary_ptr, &binary_status, &err);
+        if (err != CL_SUCCESS || binary_status != CL_SUCCESS)
+        {
+            if (program)
+            {
+                clReleaseProgram(program);
+            }
+            return nullptr;
+        }
+        // binaries still have to be built, which only links them
+        err = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+        if (err != CL_SUCCESS)
+        {
+            clReleaseProgram(program);
+            return nullptr;
+        }
+        return program;
+    }
+
+    void ProgramCache::store(cl_device_id device, cl_program program, const std::string &source, const std::string &options)
+    {
+        const std::string identity = program_identity(source, options);
+        const std::string dir = directory();
+        if (dir.empty())
+        {
+            return;
+        }
+
+        // the program has one binary per device of its context
+        cl_uint num_devices = 0;
+        if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(num_devices), &num_devices, nullptr) != CL_SUCCESS || num_devices == 0)
+        {
+            return;
+        }
+        std::vector<cl_device_id> devices(num_devices);
+        clGetProgramInfo(program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * num_devices, devices.data(), nullptr);
+        std::vector<size_t> sizes(num_devices);
+        clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * num_devices, sizes.data(), nullptr);
+
+        size_t index = 0;
+        while (index < num_devices && devices[index] != device)
+        {
+            ++index;
+        }
+        if (index == num_devices || sizes[index] == 0)
+        {
+            return;
+        }
+
+        std::vector<std::vector<unsigned char>> binaries(num_devices);
+        std::vector<unsigned char *> binary_ptrs(num_devices);
+        for (cl_uint i = 0; i < num_devices; ++i)
+        {
+            binaries[i].resize(sizes[i]);
+            binary_ptrs[i] = binaries[i].data();
+        }
+        if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *) * num_devices, binary_ptrs.data(), nullptr) != CL_SUCCESS)
+        {
+            return;
+        }
+
+        // write aside and rename, so concurrent processes never read a partial entry
+        const std::string path = entry_path(dir, device, identity);
+        const std::string tmp_path = path + ".tmp" + to_hex(std::random_device()());
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                return;
+            }
+            const std::string header = entry_header(device, identity, sizes[index]);
+            file.write(header.data(), header.size());
+            file.write(reinterpret_cast<const char *>(binaries[index].data()), sizes[index]);
+            if (!file)
+            {
+                file.close();
+                std::remove(tmp_path.c_str());
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec)
+        {
+            std::remove(tmp_path.c_str());
+        }
+    }
+
+    cl_program ProgramCache::acquire(cl_context ctx, cl_device_id device, const std::string &source, const std::string &options)
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex());
+        auto it = shared_programs().find(SharedKey(ctx, device, program_identity(source, options)));
+        if (it == shared_programs().end())
+        {
+            return nullptr;
+        }
+        ++it->second.users;
+        return it->second.program;
+    }
+
+    cl_program ProgramCache::share(cl_context ctx, cl_device_id device, cl_program program, const std::string &source,
+                                   const std::string &options)
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex());
+        auto inserted = shared_programs().emplace(SharedKey(ctx, device, program_identity(source, options)), SharedProgram{program, 0});
+        SharedProgram &shared = inserted.first->second;
+        ++shared.users;
+        if (!inserted.second)
+        {
+            // built twice by concurrent first uses, the first one wins
+            clReleaseProgram(program);
+        }
+        return shared.program;
+    }
+
+    void ProgramCache::release(cl_program program)
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex());
+        for (auto it = shared_programs().begin(); it != shared_programs().end(); ++it)
+        {
+            if (it->second.program == program)
+            {
+                if (--it->second.users == 0)
+                {
+                    clReleaseProgram(program);
+                    shared_programs().erase(it);
+                }
+                return;
+            }
+        }
+        // not shared, e.g. its build failed
+        clReleaseProgram(program);
+    }
+} // namespace sgmcl
@@ -0,0 +1,43 @@
+#ifndef PROGRAM_CACHE_H_
+#define PROGRAM_CACHE_H_
+
+#include <string>
+
+#include <CL/cl.h>
+
+namespace sgmcl
+{
+    /**
+        On-disk cache of built OpenCL programs used by DeviceProgram.
+        Entries are keyed by device name, driver version and a hash of the
+        preprocessed source and the build options, they hold the CL_PROGRAM_BINARIES of the device.
+        The cache is disabled while the directory is empty, every failure
+        (missing or stale entry, rejected binary) falls back to building from source.
+
+        Independent of the directory, built programs are shared in the process: the engines
+        of several pipeline slots get the same cl_program for the same source, context and
+        device, so it is built once and only the kernels are created per engine.
+        */
+    class ProgramCache
+    {
+    public:
+        // Set before the kernels are first enqueued, the directory is created if needed.
+        static void setDirectory(const std::string &dir);
+        static std::string directory();
+
+        // Returns a built program or nullptr if there is no usable entry.
+        static cl_program load(cl_context ctx, cl_device_id device, const std::string &source, const std::string &options);
+        static void store(cl_device_id device, cl_program program, const std::string &source, const std::string &options);
+
+        // A program built before in the process with one more user, or nullptr.
+        static cl_program acquire(cl_context ctx, cl_device_id device, const std::string &source, const std::string &options);
+        // Registers a built program with one user and returns the program to use, the one
+        // shared meanwhile by another thread if there is one (program is released then).
+        static cl_program share(cl_context ctx, cl_device_id device, cl_program program, const std::string &source,
+                                const std::string &options);
+        // Drops a user of an acquired or shared program, the last one releases it.
+        static void release(cl_program program);
+    };
+} // namespace sgmcl
+
+#endif // PROGRAM_CACHE_H_
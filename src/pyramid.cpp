@@ -0,0 +1,131 @@
+#include "pyramid.h"
+#include "sgm_details.h"
+
+namespace sgmcl
+{
+    Pyramid::Pyramid(cl_context ctx, cl_device_id device, int band_width, const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device), m_band_width(band_width),
+          m_tile_width(tuning.get("details.tile_width", SGMDetails::DEFAULT_TILE_WIDTH)),
+          m_tile_height(tuning.get("details.tile_height", SGMDetails::DEFAULT_TILE_HEIGHT))
+    {
+    }
+
+    Pyramid::~Pyramid()
+    {
+        if (m_kernel_downsample)
+        {
+            clReleaseKernel(m_kernel_downsample);
+            m_kernel_downsample = nullptr;
+        }
+        if (m_kernel_band)
+        {
+            clReleaseKernel(m_kernel_band);
+            m_kernel_band = nullptr;
+        }
+    }
+
+    void Pyramid::init()
+    {
+        std::ifstream fileInput1, fileInput2;
+        fileInput1.open("data/ocl/inttypes.cl");
+        fileInput2.open("data/ocl/pyramid.cl");
+        std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                         std::istreambuf_iterator<char>()};
+        std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                         std::istreambuf_iterator<char>()};
+        std::string kernel_src = src1 + src2;
+
+        std::string kernel_BAND_WIDTH = "#define BAND_WIDTH " + std::to_string(m_band_width) + "\n";
+        kernel_src = std::regex_replace(kernel_src, std::regex("@BAND_WIDTH@"), kernel_BAND_WIDTH);
+
+        m_program.init(m_cl_context, m_cl_device_id, kernel_src);
+        m_kernel_downsample = m_program.getKernel("downsample_kernel");
+        m_kernel_band = m_program.getKernel("disparity_band_kernel");
+    }
+
+    void Pyramid::downsample(const DeviceBuffer<uint8_t> &src,
+                             DeviceBuffer<uint8_t> &dest,
+                             int width,
+                             int height,
+                             int batch_size,
+                             int src_pitch,
+                             int factor,
+                             cl_command_queue stream,
+                             cl_event *event)
+    {
+        if (m_kernel_downsample == nullptr)
+        {
+            init();
+        }
+
+        cl_int err = clSetKernelArg(m_kernel_downsample, 0, sizeof(cl_mem), &dest.data());
+        err = clSetKernelArg(m_kernel_downsample, 1, sizeof(cl_mem), &src.data());
+        err = clSetKernelArg(m_kernel_downsample, 2, sizeof(width), &width);
+        err = clSetKernelArg(m_kernel_downsample, 3, sizeof(height), &height);
+        err = clSetKernelArg(m_kernel_downsample, 4, sizeof(src_pitch), &src_pitch);
+        err = clSetKernelArg(m_kernel_downsample, 5, sizeof(factor), &factor);
+
+        const size_t dest_width = width / factor;
+        const size_t dest_height = height / factor;
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((dest_width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((dest_height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_kernel_downsample,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing downsample kernel");
+    }
+
+    void Pyramid::disparity_band(DeviceBuffer<uint16_t> &band,
+                                 const DeviceBuffer<uint16_t> &coarse,
+                                 int width,
+                                 int height,
+                                 int batch_size,
+                                 int factor,
+                                 int shift,
+                                 int coarse_base,
+                                 int max_offset,
+                                 cl_command_queue stream,
+                                 cl_event *event)
+    {
+        if (m_kernel_band == nullptr)
+        {
+            init();
+        }
+
+        const int coarse_width = width / factor;
+        const int coarse_height = height / factor;
+        cl_int err = clSetKernelArg(m_kernel_band, 0, sizeof(cl_mem), &band.data());
+        err = clSetKernelArg(m_kernel_band, 1, sizeof(cl_mem), &coarse.data());
+        err = clSetKernelArg(m_kernel_band, 2, sizeof(width), &width);
+        err = clSetKernelArg(m_kernel_band, 3, sizeof(height), &height);
+        err = clSetKernelArg(m_kernel_band, 4, sizeof(coarse_width), &coarse_width);
+        err = clSetKernelArg(m_kernel_band, 5, sizeof(coarse_height), &coarse_height);
+        err = clSetKernelArg(m_kernel_band, 6, sizeof(factor), &factor);
+        err = clSetKernelArg(m_kernel_band, 7, sizeof(shift), &shift);
+        err = clSetKernelArg(m_kernel_band, 8, sizeof(coarse_base), &coarse_base);
+        err = clSetKernelArg(m_kernel_band, 9, sizeof(max_offset), &max_offset);
+
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_kernel_band,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing disparity band kernel");
+    }
+} // namespace sgmcl
@@ -0,0 +1,59 @@
+#include "common.h"
+
+namespace sgmcl
+{
+
+    /**
+        Kernels between the levels of HierarchicalSemiGlobalMatching: the box filtered
+        coarse images and the per pixel disparity band derived from the coarse result.
+        */
+    class Pyramid
+    {
+    public:
+        // band_width is the number of disparities aggregated at full resolution.
+        Pyramid(cl_context ctx, cl_device_id device, int band_width, const TuningProfile &tuning = TuningProfile());
+        ~Pyramid();
+
+        // dest gets (width / factor) x (height / factor) pixels per image, without padding.
+        void downsample(const DeviceBuffer<uint8_t> &src,
+                        DeviceBuffer<uint8_t> &dest,
+                        int width,
+                        int height,
+                        int batch_size,
+                        int src_pitch,
+                        int factor,
+                        cl_command_queue stream,
+                        cl_event *event = nullptr);
+
+        // band gets the first disparity of the band_width wide band of every pixel,
+        // relative to min_disp, clamped to [0, max_offset]. The coarse disparities are
+        // shifted right by shift, coarse_base is the full resolution disparity of
+        // coarse disparity 0 relative to min_disp.
+        void disparity_band(DeviceBuffer<uint16_t> &band,
+                            const DeviceBuffer<uint16_t> &coarse,
+                            int width,
+                            int height,
+                            int batch_size,
+                            int factor,
+                            int shift,
+                            int coarse_base,
+                            int max_offset,
+                            cl_command_queue stream,
+                            cl_event *event = nullptr);
+
+    private:
+        void init();
+
+        cl_context m_cl_context = nullptr;
+        cl_device_id m_cl_device_id = nullptr;
+
+        DeviceProgram m_program;
+        cl_kernel m_kernel_downsample = nullptr;
+        cl_kernel m_kernel_band = nullptr;
+        int m_band_width;
+
+        // work group of the per pixel kernels, the one of SGMDetails
+        size_t m_tile_width;
+        size_t m_tile_height;
+    };
+} // namespace sgmcl
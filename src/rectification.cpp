@@ -0,0 +1,141 @@
+#include "rectification.h"
+#include "sgm_details.h"
+
+#include <cmath>
+
+namespace sgmcl
+{
+    namespace
+    {
+        // bits of the map fractions, cv::INTER_BITS
+        constexpr int INTER_BITS = 5;
+        constexpr int INTER_TAB_SIZE = 1 << INTER_BITS;
+
+        int16_t saturate_int16(int value)
+        {
+            return static_cast<int16_t>(std::min(std::max(value, -32768), 32767));
+        }
+
+        // same rounding as cv::convertMaps to CV_16SC2 + CV_16UC1
+        void convert_map(const float *map_x, const float *map_y, size_t n,
+                         std::vector<int16_t> &coords, std::vector<uint16_t> &fractions)
+        {
+            coords.resize(2 * n);
+            fractions.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const int ix = static_cast<int>(std::lrint(map_x[i] * INTER_TAB_SIZE));
+                const int iy = static_cast<int>(std::lrint(map_y[i] * INTER_TAB_SIZE));
+                coords[2 * i] = saturate_int16(ix >> INTER_BITS);
+                coords[2 * i + 1] = saturate_int16(iy >> INTER_BITS);
+                fractions[i] = static_cast<uint16_t>((iy & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (ix & (INTER_TAB_SIZE - 1)));
+            }
+        }
+    } // namespace
+
+    Rectification::Rectification(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device),
+          m_coords{DeviceBuffer<int16_t>(ctx), DeviceBuffer<int16_t>(ctx)},
+          m_fractions{DeviceBuffer<uint16_t>(ctx), DeviceBuffer<uint16_t>(ctx)},
+          m_tile_width(tuning.get("details.tile_width", SGMDetails::DEFAULT_TILE_WIDTH)),
+          m_tile_height(tuning.get("details.tile_height", SGMDetails::DEFAULT_TILE_HEIGHT))
+    {
+    }
+
+    Rectification::~Rectification()
+    {
+        if (m_kernel)
+        {
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
+        }
+    }
+
+    void Rectification::set_maps(const float *map11,
+                                 const float *map12,
+                                 const float *map21,
+                                 const float *map22,
+                                 int width,
+                                 int height,
+                                 cl_command_queue stream)
+    {
+        if (map11 == nullptr && map12 == nullptr && map21 == nullptr && map22 == nullptr)
+        {
+            m_has_maps = false;
+            return;
+        }
+        if (map11 == nullptr || map12 == nullptr || map21 == nullptr || map22 == nullptr)
+        {
+            throw std::logic_error("rectification needs the x and y maps of both cameras");
+        }
+
+        const size_t n = static_cast<size_t>(width) * height;
+        const float *maps[2][2] = {{map11, map12}, {map21, map22}};
+        std::vector<int16_t> coords;
+        std::vector<uint16_t> fractions;
+        for (int camera = 0; camera < 2; ++camera)
+        {
+            // new buffers instead of overwriting the old ones, frames in flight on the other
+            // queues may still remap with them. Their release waits for those frames.
+            DeviceBuffer<int16_t> new_coords(m_cl_context, 2 * n);
+            DeviceBuffer<uint16_t> new_fractions(m_cl_context, n);
+            convert_map(maps[camera][0], maps[camera][1], n, coords, fractions);
+            cl_int err = clEnqueueWriteBuffer(stream, new_coords.data(), CL_TRUE, 0,
+                                              coords.size() * sizeof(int16_t), coords.data(), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error uploading rectification map");
+            err = clEnqueueWriteBuffer(stream, new_fractions.data(), CL_TRUE, 0,
+                                       fractions.size() * sizeof(uint16_t), fractions.data(), 0, nullptr, nullptr);
+            CHECK_OCL_ERROR(err, "Error uploading rectification map");
+            m_coords[camera] = std::move(new_coords);
+            m_fractions[camera] = std::move(new_fractions);
+        }
+        m_has_maps = true;
+    }
+
+    void Rectification::enqueue(const DeviceBuffer<uint8_t> &src,
+                                DeviceBuffer<uint8_t> &dest,
+                                int camera,
+                                int width,
+                                int height,
+                                int batch_size,
+                                int pitch,
+                                cl_command_queue stream,
+                                cl_event *event)
+    {
+        if (m_kernel == nullptr)
+        {
+            std::ifstream fileInput1, fileInput2;
+            fileInput1.open("data/ocl/inttypes.cl");
+            fileInput2.open("data/ocl/rectify.cl");
+            std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                             std::istreambuf_iterator<char>()};
+            std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                             std::istreambuf_iterator<char>()};
+            m_program.init(m_cl_context, m_cl_device_id, src1 + src2);
+            m_kernel = m_program.getKernel("remap_kernel");
+        }
+
+        cl_int err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &dest.data());
+        err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &src.data());
+        err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &m_coords[camera].data());
+        err = clSetKernelArg(m_kernel, 3, sizeof(cl_mem), &m_fractions[camera].data());
+        err = clSetKernelArg(m_kernel, 4, sizeof(width), &width);
+        err = clSetKernelArg(m_kernel, 5, sizeof(height), &height);
+        err = clSetKernelArg(m_kernel, 6, sizeof(pitch), &pitch);
+
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_kernel,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing remap kernel");
+    }
+} // namespace sgmcl
@@ -0,0 +1,54 @@
+#include "common.h"
+
+namespace sgmcl
+{
+
+    /**
+        Remaps both camera images with the maps of cv::initUndistortRectifyMap on the device.
+        The maps are uploaded once in the fixed point layout of cv::convertMaps, a 16 bit integer
+        coordinate pair and a 1/32 pixel fraction index per pixel (6 instead of 8 bytes).
+        */
+    class Rectification
+    {
+    public:
+        Rectification(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
+        ~Rectification();
+
+        // CV_32FC1 x and y maps of the left (map11, map12) and the right camera (map21, map22),
+        // width x height floats each. All nullptr removes the maps. Blocks until uploaded.
+        void set_maps(const float *map11,
+                      const float *map12,
+                      const float *map21,
+                      const float *map22,
+                      int width,
+                      int height,
+                      cl_command_queue stream);
+
+        bool empty() const { return !m_has_maps; }
+
+        // camera is 0 for the left and 1 for the right image, dest must not alias src.
+        void enqueue(const DeviceBuffer<uint8_t> &src,
+                     DeviceBuffer<uint8_t> &dest,
+                     int camera,
+                     int width,
+                     int height,
+                     int batch_size,
+                     int pitch,
+                     cl_command_queue stream,
+                     cl_event *event = nullptr);
+
+    private:
+        cl_context m_cl_context = nullptr;
+        cl_device_id m_cl_device_id = nullptr;
+
+        DeviceProgram m_program;
+        cl_kernel m_kernel = nullptr;
+
+        DeviceBuffer<int16_t> m_coords[2];
+        DeviceBuffer<uint16_t> m_fractions[2];
+        bool m_has_maps = false;
+
+        size_t m_tile_width;
+        size_t m_tile_height;
+    };
+} // namespace sgmcl
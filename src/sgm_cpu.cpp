@@ -0,0 +1,454 @@
+#include "sgm_cpu.h"
+#include "sgm_reference.h"
+
+#include <algorithm>
+
+// SGM_CPU_AVX2 builds AVX2 variants of the inner loops next to the plain ones. Only those
+// functions are compiled for AVX2, the CPU is checked once at run time before they are used.
+#if defined(SGM_CPU_AVX2) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define SGM_CPU_AVX2_PATH
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SGM_AVX2_TARGET
+#else
+#define SGM_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace sgmcl
+{
+    namespace cpu
+    {
+        static constexpr int WINDOW_WIDTH = 9;
+        static constexpr int WINDOW_HEIGHT = 7;
+        // dp values stay below p1 + p2 + 32, 16 bit lanes are exact for penalties up to this
+        static constexpr unsigned int MAX_PENALTY = 32000;
+        // padding of each dp state, saturates the d - 1 / d + 1 terms at the range ends
+        static constexpr uint16_t DP_SENTINEL = 0xffff;
+        // columns handed to one task of the vertical paths
+        static constexpr int COLUMNS_PER_TASK = 16;
+
+        static inline uint32_t popcount(uint32_t v)
+        {
+            v = v - ((v >> 1) & 0x55555555u);
+            v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+            return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+        }
+
+#ifdef SGM_CPU_AVX2_PATH
+        static bool cpu_has_avx2()
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+            {
+                return false;
+            }
+            __cpuid(info, 1);
+            // the OS saves the ymm registers
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+            {
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        static bool use_avx2()
+        {
+            static const bool supported = cpu_has_avx2();
+            return supported;
+        }
+
+        SGM_AVX2_TARGET static inline __m256i load_u8x8(const uint8_t *p)
+        {
+            return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+        }
+
+        SGM_AVX2_TARGET static inline __m256i popcount_epi32(__m256i v)
+        {
+            const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i low_mask = _mm256_set1_epi8(0x0f);
+            const __m256i lo = _mm256_and_si256(v, low_mask);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+            const __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+            const __m256i words = _mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1));
+            return _mm256_madd_epi16(words, _mm256_set1_epi16(1));
+        }
+
+        // census of the pixels of row y from x on, 8 at a time, returns the first pixel left over
+        SGM_AVX2_TARGET static int census_row_avx2(const uint8_t *src, uint32_t *dest, int x, int y, int width, int pitch)
+        {
+            const int half_kw = WINDOW_WIDTH / 2;
+            const int half_kh = WINDOW_HEIGHT / 2;
+            // the window pairs are compared as 32 bit lanes
+            for (; x + 8 <= width - half_kw; x += 8)
+            {
+                __m256i f = _mm256_setzero_si256();
+                for (int dy = -half_kh; dy < 0; ++dy)
+                {
+                    for (int dx = -half_kw; dx <= half_kw; ++dx)
+                    {
+                        const __m256i a = load_u8x8(src + (x + dx) + (y + dy) * pitch);
+                        const __m256i b = load_u8x8(src + (x - dx) + (y - dy) * pitch);
+                        f = _mm256_or_si256(_mm256_slli_epi32(f, 1), _mm256_srli_epi32(_mm256_cmpgt_epi32(a, b), 31));
+                    }
+                }
+                for (int dx = -half_kw; dx < 0; ++dx)
+                {
+                    const __m256i a = load_u8x8(src + (x + dx) + y * pitch);
+                    const __m256i b = load_u8x8(src + (x - dx) + y * pitch);
+                    f = _mm256_or_si256(_mm256_slli_epi32(f, 1), _mm256_srli_epi32(_mm256_cmpgt_epi32(a, b), 31));
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + x), f);
+            }
+            return x;
+        }
+#endif
+
+        static inline uint32_t census_pixel(const uint8_t *src, int x, int y, int pitch)
+        {
+            const int half_kw = WINDOW_WIDTH / 2;
+            const int half_kh = WINDOW_HEIGHT / 2;
+            uint32_t f = 0;
+            for (int dy = -half_kh; dy < 0; ++dy)
+            {
+                for (int dx = -half_kw; dx <= half_kw; ++dx)
+                {
+                    f = (f << 1) | (src[(x + dx) + (y + dy) * pitch] > src[(x - dx) + (y - dy) * pitch]);
+                }
+            }
+            for (int dx = -half_kw; dx < 0; ++dx)
+            {
+                f = (f << 1) | (src[(x + dx) + y * pitch] > src[(x - dx) + y * pitch]);
+            }
+            return f;
+        }
+
+        void census_transform(ThreadPool &pool,
+                              const uint8_t *src,
+                              uint32_t *feature_buffer,
+                              int width,
+                              int height,
+                              int pitch)
+        {
+            const int half_kw = WINDOW_WIDTH / 2;
+            const int half_kh = WINDOW_HEIGHT / 2;
+
+            pool.parallel_for(0, height, [&](int y) {
+                uint32_t *dest = feature_buffer + y * width;
+                std::fill(dest, dest + width, 0);
+                if (y < half_kh || y >= height - half_kh)
+                {
+                    return;
+                }
+
+                int x = half_kw;
+#ifdef SGM_CPU_AVX2_PATH
+                if (use_avx2())
+                {
+                    x = census_row_avx2(src, dest, x, y, width, pitch);
+                }
+#endif
+                for (; x < width - half_kw; ++x)
+                {
+                    dest[x] = census_pixel(src, x, y, pitch);
+                }
+            });
+        }
+
+        // right_row is a padded row of right features, right_row[x + MAX_DISPARITY - 1 - d]
+        // holds the feature matched with left pixel x at disparity d (0 outside the image).
+        template <size_t MAX_DISPARITY>
+        static inline void compute_costs(uint16_t *costs, uint32_t left_value, const uint32_t *right_row, int x)
+        {
+            const uint32_t *base = right_row + x + MAX_DISPARITY - 1;
+            for (int d = 0; d < static_cast<int>(MAX_DISPARITY); ++d)
+            {
+                costs[d] = static_cast<uint16_t>(popcount(left_value ^ base[-d]));
+            }
+        }
+
+        // One step of the recurrence. prev[-1] and prev[MAX_DISPARITY] hold DP_SENTINEL,
+        // adds the uint8 truncated path costs to sum and returns the minimum of cur.
+        template <size_t MAX_DISPARITY>
+        static inline uint16_t update(uint16_t *cur,
+                                      const uint16_t *prev,
+                                      uint16_t last_min,
+                                      const uint16_t *costs,
+                                      uint16_t p1,
+                                      uint16_t p2,
+                                      uint16_t *sum)
+        {
+            uint16_t local_min = 0xffff;
+            for (int d = 0; d < static_cast<int>(MAX_DISPARITY); ++d)
+            {
+                unsigned int out = std::min<unsigned int>(prev[d] - last_min, p2);
+                if (d > 0)
+                {
+                    out = std::min<unsigned int>(out, prev[d - 1] - last_min + p1);
+                }
+                if (d + 1 < static_cast<int>(MAX_DISPARITY))
+                {
+                    out = std::min<unsigned int>(out, prev[d + 1] - last_min + p1);
+                }
+                cur[d] = static_cast<uint16_t>(out + costs[d]);
+                local_min = std::min(local_min, cur[d]);
+                sum[d] += static_cast<uint8_t>(cur[d]);
+            }
+            return local_min;
+        }
+
+        // the matching costs of pixel x and one step of the recurrence, returns the minimum of cur
+        template <size_t MAX_DISPARITY>
+        static uint16_t path_step(uint16_t *cur,
+                                  const uint16_t *prev,
+                                  uint16_t last_min,
+                                  uint16_t *costs,
+                                  uint32_t left_value,
+                                  const uint32_t *right_row,
+                                  int x,
+                                  uint16_t p1,
+                                  uint16_t p2,
+                                  uint16_t *sum)
+        {
+            compute_costs<MAX_DISPARITY>(costs, left_value, right_row, x);
+            return update<MAX_DISPARITY>(cur, prev, last_min, costs, p1, p2, sum);
+        }
+
+#ifdef SGM_CPU_AVX2_PATH
+        template <size_t MAX_DISPARITY>
+        SGM_AVX2_TARGET static inline void compute_costs_avx2(uint16_t *costs, uint32_t left_value, const uint32_t *right_row, int x)
+        {
+            const uint32_t *base = right_row + x + MAX_DISPARITY - 1;
+            const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+            const __m256i l = _mm256_set1_epi32(static_cast<int>(left_value));
+            for (int d = 0; d < static_cast<int>(MAX_DISPARITY); d += 16)
+            {
+                const __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base - d - 7));
+                const __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base - d - 15));
+                const __m256i c0 = popcount_epi32(_mm256_xor_si256(l, _mm256_permutevar8x32_epi32(r0, reverse)));
+                const __m256i c1 = popcount_epi32(_mm256_xor_si256(l, _mm256_permutevar8x32_epi32(r1, reverse)));
+                // packus interleaves the 128 bit halves, permute restores d order
+                const __m256i c = _mm256_permute4x64_epi64(_mm256_packus_epi32(c0, c1), 0xd8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(costs + d), c);
+            }
+        }
+
+        template <size_t MAX_DISPARITY>
+        SGM_AVX2_TARGET static inline uint16_t update_avx2(uint16_t *cur,
+                                                           const uint16_t *prev,
+                                                           uint16_t last_min,
+                                                           const uint16_t *costs,
+                                                           uint16_t p1,
+                                                           uint16_t p2,
+                                                           uint16_t *sum)
+        {
+            const __m256i vmin = _mm256_set1_epi16(static_cast<short>(last_min));
+            const __m256i vp1 = _mm256_set1_epi16(static_cast<short>(p1));
+            const __m256i vp2 = _mm256_set1_epi16(static_cast<short>(p2));
+            const __m256i low_byte = _mm256_set1_epi16(0xff);
+            __m256i local_min = _mm256_set1_epi16(static_cast<short>(0xffff));
+            for (int d = 0; d < static_cast<int>(MAX_DISPARITY); d += 16)
+            {
+                const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + d));
+                const __m256i lower = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + d - 1));
+                const __m256i upper = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + d + 1));
+                __m256i out = _mm256_min_epu16(_mm256_sub_epi16(center, vmin), vp2);
+                out = _mm256_min_epu16(out, _mm256_adds_epu16(_mm256_sub_epi16(lower, vmin), vp1));
+                out = _mm256_min_epu16(out, _mm256_adds_epu16(_mm256_sub_epi16(upper, vmin), vp1));
+                out = _mm256_add_epi16(out, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(costs + d)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(cur + d), out);
+                local_min = _mm256_min_epu16(local_min, out);
+
+                __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum + d));
+                s = _mm256_add_epi16(s, _mm256_and_si256(out, low_byte));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum + d), s);
+            }
+            const __m128i m = _mm_min_epu16(_mm256_castsi256_si128(local_min), _mm256_extracti128_si256(local_min, 1));
+            return static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(m)));
+        }
+
+        template <size_t MAX_DISPARITY>
+        SGM_AVX2_TARGET static uint16_t path_step_avx2(uint16_t *cur,
+                                                       const uint16_t *prev,
+                                                       uint16_t last_min,
+                                                       uint16_t *costs,
+                                                       uint32_t left_value,
+                                                       const uint32_t *right_row,
+                                                       int x,
+                                                       uint16_t p1,
+                                                       uint16_t p2,
+                                                       uint16_t *sum)
+        {
+            compute_costs_avx2<MAX_DISPARITY>(costs, left_value, right_row, x);
+            return update_avx2<MAX_DISPARITY>(cur, prev, last_min, costs, p1, p2, sum);
+        }
+#endif
+
+        template <size_t MAX_DISPARITY>
+        void aggregate_path(ThreadPool &pool,
+                            uint16_t *cost_sum,
+                            const uint32_t *left,
+                            const uint32_t *right,
+                            int width,
+                            int height,
+                            int dx,
+                            int dy,
+                            unsigned int p1,
+                            unsigned int p2,
+                            int min_disp)
+        {
+            if (p1 > MAX_PENALTY || p2 > MAX_PENALTY)
+            {
+                reference::aggregate_path<MAX_DISPARITY>(cost_sum, left, right, width, height, dx, dy, p1, p2, min_disp);
+                return;
+            }
+
+            // right features padded so that the costs of a pixel are one contiguous load
+            const int padded_width = width + MAX_DISPARITY - 1;
+            const int offset = min_disp + MAX_DISPARITY - 1;
+            std::vector<uint32_t> right_padded(static_cast<size_t>(padded_width) * height);
+            pool.parallel_for(0, height, [&](int y) {
+                uint32_t *row = &right_padded[static_cast<size_t>(y) * padded_width];
+                for (int i = 0; i < padded_width; ++i)
+                {
+                    const int right_x = i - offset;
+                    row[i] = (0 <= right_x && right_x < width) ? right[right_x + y * width] : 0;
+                }
+            });
+
+            const int dp_stride = MAX_DISPARITY + 2;
+            std::vector<uint16_t> zero_state(dp_stride, 0);
+            zero_state.front() = zero_state.back() = DP_SENTINEL;
+            const uint16_t *initial = zero_state.data() + 1;
+
+            const uint16_t penalty1 = static_cast<uint16_t>(p1);
+            const uint16_t penalty2 = static_cast<uint16_t>(p2);
+
+            auto path_step_fn = &path_step<MAX_DISPARITY>;
+#ifdef SGM_CPU_AVX2_PATH
+            if (use_avx2())
+            {
+                path_step_fn = &path_step_avx2<MAX_DISPARITY>;
+            }
+#endif
+
+            auto step = [&](uint16_t *cur, const uint16_t *prev, uint16_t last_min, uint16_t *costs, int x, int y) {
+                uint16_t *sum = &cost_sum[(static_cast<size_t>(x) + static_cast<size_t>(y) * width) * MAX_DISPARITY];
+                return path_step_fn(cur, prev, last_min, costs, left[x + y * width],
+                                    &right_padded[static_cast<size_t>(y) * padded_width], x, penalty1, penalty2, sum);
+            };
+
+            if (dy == 0)
+            {
+                // every row is a scanline
+                pool.parallel_for(0, height, [&](int y) {
+                    std::vector<uint16_t> state(2 * dp_stride, DP_SENTINEL);
+                    uint16_t costs[MAX_DISPARITY];
+                    uint16_t *cur = state.data() + 1;
+                    uint16_t *next = state.data() + dp_stride + 1;
+                    const uint16_t *prev = initial;
+                    uint16_t last_min = 0;
+                    for (int ix = 0; ix < width; ++ix)
+                    {
+                        const int x = dx > 0 ? ix : width - 1 - ix;
+                        last_min = step(cur, prev, last_min, costs, x, y);
+                        prev = cur;
+                        std::swap(cur, next);
+                    }
+                });
+            }
+            else if (dx == 0)
+            {
+                // every column is a scanline, a task walks a block of neighbouring columns row by row
+                const int num_tasks = (width + COLUMNS_PER_TASK - 1) / COLUMNS_PER_TASK;
+                pool.parallel_for(0, num_tasks, [&](int task) {
+                    const int x0 = task * COLUMNS_PER_TASK;
+                    const int columns = std::min(COLUMNS_PER_TASK, width - x0);
+                    std::vector<uint16_t> state(2 * columns * dp_stride, DP_SENTINEL);
+                    std::vector<uint16_t> mins(2 * columns, 0);
+                    uint16_t costs[MAX_DISPARITY];
+                    uint16_t *prev_state = state.data();
+                    uint16_t *cur_state = state.data() + columns * dp_stride;
+                    uint16_t *prev_min = mins.data();
+                    uint16_t *cur_min = mins.data() + columns;
+                    for (int iy = 0; iy < height; ++iy)
+                    {
+                        const int y = dy > 0 ? iy : height - 1 - iy;
+                        for (int i = 0; i < columns; ++i)
+                        {
+                            const uint16_t *prev = iy == 0 ? initial : prev_state + i * dp_stride + 1;
+                            cur_min[i] = step(cur_state + i * dp_stride + 1, prev, prev_min[i], costs, x0 + i, y);
+                        }
+                        std::swap(prev_state, cur_state);
+                        std::swap(prev_min, cur_min);
+                    }
+                });
+            }
+            else
+            {
+                // every diagonal is a scanline, diagonal s meets row iy at x = s - (height - 1) + iy for dx > 0
+                // and at x = s - iy for dx < 0, counting iy from the row the path starts at
+                pool.parallel_for(0, width + height - 1, [&](int s) {
+                    const int x_start = dx > 0 ? s - (height - 1) : s;
+                    // rows where the diagonal lies inside the image
+                    const int iy_begin = std::max(0, dx > 0 ? -x_start : x_start - (width - 1));
+                    const int iy_end = std::min(height, dx > 0 ? width - x_start : x_start + 1);
+
+                    std::vector<uint16_t> state(2 * dp_stride, DP_SENTINEL);
+                    uint16_t costs[MAX_DISPARITY];
+                    uint16_t *cur = state.data() + 1;
+                    uint16_t *next = state.data() + dp_stride + 1;
+                    const uint16_t *prev = initial;
+                    uint16_t last_min = 0;
+                    for (int iy = iy_begin; iy < iy_end; ++iy)
+                    {
+                        const int x = x_start + iy * dx;
+                        const int y = dy > 0 ? iy : height - 1 - iy;
+                        last_min = step(cur, prev, last_min, costs, x, y);
+                        prev = cur;
+                        std::swap(cur, next);
+                    }
+                });
+            }
+        }
+
+        template <size_t MAX_DISPARITY>
+        void winner_takes_all(ThreadPool &pool,
+                              uint16_t *left_dest,
+                              uint16_t *right_dest,
+                              const uint16_t *cost_sum,
+                              int width,
+                              int height,
+                              int pitch,
+                              float uniqueness,
+                              bool subpixel)
+        {
+            // rows are independent
+            pool.parallel_for(0, height, [&](int y) {
+                reference::winner_takes_all<MAX_DISPARITY>(left_dest + y * pitch,
+                                                           right_dest + y * pitch,
+                                                           cost_sum + static_cast<size_t>(y) * width * MAX_DISPARITY,
+                                                           width, 1, pitch,
+                                                           uniqueness, subpixel);
+            });
+        }
+
+        template void aggregate_path<64>(ThreadPool &, uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+        template void aggregate_path<128>(ThreadPool &, uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+        template void aggregate_path<256>(ThreadPool &, uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+
+        template void winner_takes_all<64>(ThreadPool &, uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+        template void winner_takes_all<128>(ThreadPool &, uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+        template void winner_takes_all<256>(ThreadPool &, uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+    } // namespace cpu
+} // namespace sgmcl
@@ -0,0 +1,54 @@
+#ifndef SGM_CPU_H_
+#define SGM_CPU_H_
+
+#include "common.h"
+#include "thread_pool.h"
+
+namespace sgmcl
+{
+    /**
+        Multithreaded host implementations of census, path aggregation and winner takes all.
+        They give the same results as the reference namespace, the inner loops use AVX2
+        when built with SGM_CPU_AVX2 and the CPU has it, plain C++ otherwise.
+        All images are row major, pitches are given in elements.
+        */
+    namespace cpu
+    {
+        // Census border pixels (where the 9x7 window leaves the image) are set to 0.
+        void census_transform(ThreadPool &pool,
+                              const uint8_t *src,
+                              uint32_t *feature_buffer,
+                              int width,
+                              int height,
+                              int pitch);
+
+        // Aggregates one scanline direction (dx, dy) and adds the 8 bit path costs
+        // to cost_sum, which holds MAX_DISPARITY values per pixel.
+        // Independent scanlines of the direction are spread over the pool.
+        template <size_t MAX_DISPARITY>
+        void aggregate_path(ThreadPool &pool,
+                            uint16_t *cost_sum,
+                            const uint32_t *left,
+                            const uint32_t *right,
+                            int width,
+                            int height,
+                            int dx,
+                            int dy,
+                            unsigned int p1,
+                            unsigned int p2,
+                            int min_disp);
+
+        template <size_t MAX_DISPARITY>
+        void winner_takes_all(ThreadPool &pool,
+                              uint16_t *left_dest,
+                              uint16_t *right_dest,
+                              const uint16_t *cost_sum,
+                              int width,
+                              int height,
+                              int pitch,
+                              float uniqueness,
+                              bool subpixel);
+    } // namespace cpu
+} // namespace sgmcl
+
+#endif // SGM_CPU_H_
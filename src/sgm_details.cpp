@@ -2,8 +2,10 @@
 
 namespace sgmcl
 {
-    SGMDetails::SGMDetails(cl_context ctx, cl_device_id device)
-        : m_cl_context(ctx), m_cl_device_id(device)
+    SGMDetails::SGMDetails(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device),
+          m_tile_width(tuning.get("details.tile_width", DEFAULT_TILE_WIDTH)),
+          m_tile_height(tuning.get("details.tile_height", DEFAULT_TILE_HEIGHT))
     {
     }
 
@@ -26,14 +28,21 @@ namespace sgmcl
             m_kernel_disp_corr = nullptr;
             // m_kernel_cast_16uto8u = nullptr;
         }
+        if (m_kernel_count_invalid)
+        {
+            clReleaseKernel(m_kernel_count_invalid);
+            m_kernel_count_invalid = nullptr;
+        }
     }
 
     void SGMDetails::median_filter(const DeviceBuffer<uint16_t> &d_src,
                                    const DeviceBuffer<uint16_t> &d_dst,
                                    int width,
                                    int height,
+                                   int batch_size,
                                    int pitch,
-                                   cl_command_queue stream)
+                                   cl_command_queue stream,
+                                   cl_event *event)
     {
         if (nullptr == m_kernel_median)
         {
@@ -53,19 +62,19 @@ namespace sgmcl
         err = clSetKernelArg(m_kernel_median, 3, sizeof(height), &height);
         err = clSetKernelArg(m_kernel_median, 4, sizeof(pitch), &pitch);
 
-        static constexpr int SIZE = 16;
-        size_t local_size[2] = {SIZE, SIZE};
-        size_t global_size[2] = {
-            ((width + SIZE - 1) / SIZE) * local_size[0],
-            ((height + SIZE - 1) / SIZE) * local_size[1]};
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
 
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel_median,
-                                     2,
+                                     3,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     0, nullptr, event);
         CHECK_OCL_ERROR(err, "Error enequeuing winner_takes_all kernel");
     }
 
@@ -74,11 +83,13 @@ namespace sgmcl
                                        const DeviceBuffer<uint8_t> &d_src_left,
                                        int width,
                                        int height,
+                                       int batch_size,
                                        int src_pitch,
                                        int dst_pitch,
                                        bool subpixel,
                                        int LR_max_diff,
-                                       cl_command_queue stream)
+                                       cl_command_queue stream,
+                                       cl_event *event)
     {
         if (nullptr == m_kernel_check_consistency)
         {
@@ -98,11 +109,11 @@ namespace sgmcl
             m_kernel_check_consistency = m_program_check_consistency.getKernel("check_consistency_kernel");
         }
 
-        static constexpr int SIZE = 16;
-        size_t local_size[2] = {SIZE, SIZE};
-        size_t global_size[2] = {
-            ((width + SIZE - 1) / SIZE) * local_size[0],
-            ((height + SIZE - 1) / SIZE) * local_size[1]};
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
         cl_int err = clSetKernelArg(m_kernel_check_consistency,
                                     0,
                                     sizeof(cl_mem),
@@ -119,21 +130,23 @@ namespace sgmcl
 
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel_check_consistency,
-                                     2,
+                                     3,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     0, nullptr, event);
         CHECK_OCL_ERROR(err, "Error enequeuing winner_takes_all kernel");
     }
 
     void SGMDetails::correct_disparity_range(DeviceBuffer<uint16_t> &d_disp,
                                              int width,
                                              int height,
+                                             int batch_size,
                                              int pitch,
                                              bool subpixel,
                                              int min_disp,
-                                             cl_command_queue stream)
+                                             cl_command_queue stream,
+                                             cl_event *event)
     {
         if (!subpixel && min_disp == 0)
         {
@@ -159,22 +172,67 @@ namespace sgmcl
         err = clSetKernelArg(m_kernel_disp_corr, 4, sizeof(min_disp_scaled), &min_disp_scaled);
         err = clSetKernelArg(m_kernel_disp_corr, 5, sizeof(invalid_disp_scaled), &invalid_disp_scaled);
 
-        static constexpr int SIZE = 16;
-        size_t local_size[2] = {SIZE, SIZE};
-        size_t global_size[2] = {
-            ((width + SIZE - 1) / SIZE) * local_size[0],
-            ((height + SIZE - 1) / SIZE) * local_size[1]};
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
 
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel_disp_corr,
-                                     2,
+                                     3,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     0, nullptr, event);
         CHECK_OCL_ERROR(err, "Error enequeuing correct disparity range kernel");
     }
 
+    void SGMDetails::count_invalid(const DeviceBuffer<uint16_t> &d_disp,
+                                   DeviceBuffer<uint32_t> &d_count,
+                                   int width,
+                                   int height,
+                                   int batch_size,
+                                   int pitch,
+                                   cl_command_queue stream,
+                                   cl_event *event)
+    {
+        if (nullptr == m_kernel_count_invalid)
+        {
+            std::ifstream fileInput1, fileInput2;
+            fileInput1.open("data/ocl/inttypes.cl");
+            fileInput2.open("data/ocl/count_invalid.cl");
+            std::string src1{std::istreambuf_iterator<char>(fileInput1),
+                             std::istreambuf_iterator<char>()};
+            std::string src2{std::istreambuf_iterator<char>(fileInput2),
+                             std::istreambuf_iterator<char>()};
+            m_program_count_invalid.init(m_cl_context, m_cl_device_id, src1 + src2);
+            m_kernel_count_invalid = m_program_count_invalid.getKernel("count_invalid_kernel");
+        }
+
+        d_count.fillZero(stream);
+        cl_int err = clSetKernelArg(m_kernel_count_invalid, 0, sizeof(cl_mem), &d_disp.data());
+        err = clSetKernelArg(m_kernel_count_invalid, 1, sizeof(cl_mem), &d_count.data());
+        err = clSetKernelArg(m_kernel_count_invalid, 2, sizeof(width), &width);
+        err = clSetKernelArg(m_kernel_count_invalid, 3, sizeof(height), &height);
+        err = clSetKernelArg(m_kernel_count_invalid, 4, sizeof(pitch), &pitch);
+
+        size_t local_size[3] = {m_tile_width, m_tile_height, 1};
+        size_t global_size[3] = {
+            ((width + m_tile_width - 1) / m_tile_width) * local_size[0],
+            ((height + m_tile_height - 1) / m_tile_height) * local_size[1],
+            (size_t)batch_size};
+
+        err = clEnqueueNDRangeKernel(stream,
+                                     m_kernel_count_invalid,
+                                     3,
+                                     nullptr,
+                                     global_size,
+                                     local_size,
+                                     0, nullptr, event);
+        CHECK_OCL_ERROR(err, "Error enequeuing count invalid kernel");
+    }
+
     void SGMDetails::initDispRangeCorrection()
     {
         std::ifstream fileInput;
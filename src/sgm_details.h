@@ -22,33 +22,53 @@ namespace sgmcl
     class SGMDetails
     {
     public:
-        SGMDetails(cl_context ctx, cl_device_id device);
+        // Defaults of the tuning keys "details.tile_width" and "details.tile_height".
+        static constexpr unsigned int DEFAULT_TILE_WIDTH = 16;
+        static constexpr unsigned int DEFAULT_TILE_HEIGHT = 16;
+
+        SGMDetails(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
         ~SGMDetails();
         void median_filter(const DeviceBuffer<uint16_t> &d_src,
                            const DeviceBuffer<uint16_t> &d_dst,
                            int width,
                            int height,
+                           int batch_size,
                            int pitch,
-                           cl_command_queue stream);
+                           cl_command_queue stream,
+                           cl_event *event = nullptr);
 
         void check_consistency(DeviceBuffer<uint16_t> &d_left_disp,
                                const DeviceBuffer<uint16_t> &d_right_disp,
                                const DeviceBuffer<uint8_t> &d_src_left,
                                int width,
                                int height,
+                               int batch_size,
                                int src_pitch,
                                int dst_pitch,
                                bool subpixel,
                                int LR_max_diff,
-                               cl_command_queue stream);
+                               cl_command_queue stream,
+                               cl_event *event = nullptr);
 
         void correct_disparity_range(DeviceBuffer<uint16_t> &d_disp,
                                      int width,
                                      int height,
+                                     int batch_size,
                                      int pitch,
                                      bool subpixel,
                                      int min_disp,
-                                     cl_command_queue stream);
+                                     cl_command_queue stream,
+                                     cl_event *event = nullptr);
+
+        // Writes the number of INVALID_DISP pixels of the batch to d_count[0].
+        void count_invalid(const DeviceBuffer<uint16_t> &d_disp,
+                           DeviceBuffer<uint32_t> &d_count,
+                           int width,
+                           int height,
+                           int batch_size,
+                           int pitch,
+                           cl_command_queue stream,
+                           cl_event *event = nullptr);
 
     private:
         void initDispRangeCorrection();
@@ -62,10 +82,16 @@ namespace sgmcl
         cl_kernel m_kernel_check_consistency = nullptr;
         DeviceProgram m_program_disp_corr;
         cl_kernel m_kernel_disp_corr = nullptr;
+        DeviceProgram m_program_count_invalid;
+        cl_kernel m_kernel_count_invalid = nullptr;
         // cl_kernel m_kernel_cast_16uto8u = nullptr;
 
         static constexpr unsigned int WARP_SIZE = 32;
         static constexpr unsigned int WARPS_PER_BLOCK = 8u;
         static constexpr unsigned int BLOCK_SIZE = WARPS_PER_BLOCK * WARP_SIZE;
+
+        // work group of the per pixel kernels
+        size_t m_tile_width;
+        size_t m_tile_height;
     };
 } // namespace sgmcl
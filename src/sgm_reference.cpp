@@ -0,0 +1,309 @@
+#include "sgm_reference.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace sgmcl
+{
+    namespace reference
+    {
+        static constexpr int WINDOW_WIDTH = 9;
+        static constexpr int WINDOW_HEIGHT = 7;
+        static constexpr uint16_t INVALID_DISP = static_cast<uint16_t>(-1);
+
+        static inline uint32_t popcount(uint32_t v)
+        {
+            v = v - ((v >> 1) & 0x55555555u);
+            v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+            return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+        }
+
+        void census_transform(const uint8_t *src,
+                              uint32_t *feature_buffer,
+                              int width,
+                              int height,
+                              int pitch)
+        {
+            const int half_kw = WINDOW_WIDTH / 2;
+            const int half_kh = WINDOW_HEIGHT / 2;
+
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    if (x < half_kw || x >= width - half_kw || y < half_kh || y >= height - half_kh)
+                    {
+                        feature_buffer[x + y * width] = 0;
+                        continue;
+                    }
+                    // same bit order as census_transform_kernel
+                    uint32_t f = 0;
+                    for (int dy = -half_kh; dy < 0; ++dy)
+                    {
+                        for (int dx = -half_kw; dx <= half_kw; ++dx)
+                        {
+                            const uint8_t a = src[(x + dx) + (y + dy) * pitch];
+                            const uint8_t b = src[(x - dx) + (y - dy) * pitch];
+                            f = (f << 1) | (a > b);
+                        }
+                    }
+                    for (int dx = -half_kw; dx < 0; ++dx)
+                    {
+                        const uint8_t a = src[(x + dx) + y * pitch];
+                        const uint8_t b = src[(x - dx) + y * pitch];
+                        f = (f << 1) | (a > b);
+                    }
+                    feature_buffer[x + y * width] = f;
+                }
+            }
+        }
+
+        template <size_t MAX_DISPARITY>
+        void aggregate_path(uint16_t *cost_sum,
+                            const uint32_t *left,
+                            const uint32_t *right,
+                            int width,
+                            int height,
+                            int dx,
+                            int dy,
+                            unsigned int p1,
+                            unsigned int p2,
+                            int min_disp)
+        {
+            // dp state of the previous and the current line, the predecessor of
+            // (x, y) is (x - dx, y - dy) and lives in prev_line unless dy == 0
+            std::vector<uint32_t> prev_line(width * MAX_DISPARITY), cur_line(width * MAX_DISPARITY);
+            std::vector<uint32_t> prev_min(width), cur_min(width);
+
+            for (int iy = 0; iy < height; ++iy)
+            {
+                const int y = dy >= 0 ? iy : height - 1 - iy;
+                for (int ix = 0; ix < width; ++ix)
+                {
+                    const int x = dx >= 0 ? ix : width - 1 - ix;
+                    const int px = x - dx;
+                    const int py = y - dy;
+                    const bool has_prev = 0 <= px && px < width && 0 <= py && py < height;
+
+                    const uint32_t *prev = nullptr;
+                    uint32_t last_min = 0;
+                    if (has_prev)
+                    {
+                        prev = dy == 0 ? &cur_line[px * MAX_DISPARITY] : &prev_line[px * MAX_DISPARITY];
+                        last_min = dy == 0 ? cur_min[px] : prev_min[px];
+                    }
+
+                    uint32_t *cur = &cur_line[x * MAX_DISPARITY];
+                    uint16_t *sum = &cost_sum[(x + y * width) * MAX_DISPARITY];
+                    const uint32_t left_value = left[x + y * width];
+                    uint32_t local_min = 0xffffffffu;
+                    for (int d = 0; d < static_cast<int>(MAX_DISPARITY); ++d)
+                    {
+                        const int right_x = x - d - min_disp;
+                        const uint32_t right_value = (0 <= right_x && right_x < width) ? right[right_x + y * width] : 0;
+                        uint32_t out = 0;
+                        if (has_prev)
+                        {
+                            out = std::min(prev[d] - last_min, p2);
+                            if (d > 0)
+                            {
+                                out = std::min(out, prev[d - 1] - last_min + p1);
+                            }
+                            if (d + 1 < static_cast<int>(MAX_DISPARITY))
+                            {
+                                out = std::min(out, prev[d + 1] - last_min + p1);
+                            }
+                        }
+                        cur[d] = out + popcount(left_value ^ right_value);
+                        local_min = std::min(local_min, cur[d]);
+                        // the kernels store path costs as uint8
+                        sum[d] += static_cast<uint8_t>(cur[d]);
+                    }
+                    cur_min[x] = local_min;
+                }
+                std::swap(prev_line, cur_line);
+                std::swap(prev_min, cur_min);
+            }
+        }
+
+        template <size_t MAX_DISPARITY>
+        void winner_takes_all(uint16_t *left_dest,
+                              uint16_t *right_dest,
+                              const uint16_t *cost_sum,
+                              int width,
+                              int height,
+                              int pitch,
+                              float uniqueness,
+                              bool subpixel)
+        {
+            const int max_disparity = static_cast<int>(MAX_DISPARITY);
+            for (int y = 0; y < height; ++y)
+            {
+                const uint16_t *row_costs = &cost_sum[y * width * MAX_DISPARITY];
+                for (int x = 0; x < width; ++x)
+                {
+                    const uint16_t *costs = &row_costs[x * MAX_DISPARITY];
+                    // lowest cost wins, ties go to the lower disparity
+                    int best_disp = 0;
+                    uint32_t best_cost = costs[0];
+                    for (int d = 1; d < max_disparity; ++d)
+                    {
+                        if (costs[d] < best_cost)
+                        {
+                            best_cost = costs[d];
+                            best_disp = d;
+                        }
+                    }
+
+                    bool uniq = true;
+                    for (int d = 0; d < max_disparity; ++d)
+                    {
+                        const bool uniq1 = static_cast<float>(costs[d]) * uniqueness >= static_cast<float>(best_cost);
+                        const bool uniq2 = std::abs(d - best_disp) <= 1;
+                        uniq &= uniq1 || uniq2;
+                    }
+                    if (!uniq)
+                    {
+                        left_dest[x + y * pitch] = INVALID_DISP;
+                        continue;
+                    }
+
+                    int disp = best_disp;
+                    if (subpixel)
+                    {
+                        disp <<= SubpixelShift();
+                        if (best_disp > 0 && best_disp < max_disparity - 1)
+                        {
+                            const int left = costs[best_disp - 1];
+                            const int right = costs[best_disp + 1];
+                            const int numer = left - right;
+                            const int denom = left - 2 * static_cast<int>(best_cost) + right;
+                            if (denom != 0)
+                            {
+                                disp += ((numer << SubpixelShift()) + denom) / (2 * denom);
+                            }
+                        }
+                    }
+                    left_dest[x + y * pitch] = static_cast<uint16_t>(disp);
+                }
+
+                // right disparity of p is the best d over the left pixels p + d
+                for (int p = 0; p < width; ++p)
+                {
+                    int best_disp = 0;
+                    uint32_t best_cost = 0xffffffffu;
+                    for (int d = 0; d < max_disparity && p + d < width; ++d)
+                    {
+                        const uint32_t cost = row_costs[(p + d) * MAX_DISPARITY + d];
+                        if (cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_disp = d;
+                        }
+                    }
+                    right_dest[p + y * pitch] = static_cast<uint16_t>(best_disp);
+                }
+            }
+        }
+
+        void median_filter(const uint16_t *src,
+                           uint16_t *dst,
+                           int width,
+                           int height,
+                           int pitch)
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    uint16_t window[9];
+                    int i = 0;
+                    for (int wy = -1; wy <= 1; ++wy)
+                    {
+                        for (int wx = -1; wx <= 1; ++wx)
+                        {
+                            // clamped border as in median3x3
+                            const int sx = std::min(std::max(x + wx, 0), width - 1);
+                            const int sy = std::min(std::max(y + wy, 0), height - 1);
+                            window[i++] = src[sx + sy * pitch];
+                        }
+                    }
+                    std::nth_element(window, window + 4, window + 9);
+                    dst[x + y * pitch] = window[4];
+                }
+            }
+        }
+
+        void check_consistency(uint16_t *left_disp,
+                               const uint16_t *right_disp,
+                               const uint8_t *src_left,
+                               int width,
+                               int height,
+                               int src_pitch,
+                               int dst_pitch,
+                               bool subpixel,
+                               int LR_max_diff)
+        {
+            for (int i = 0; i < height; ++i)
+            {
+                for (int j = 0; j < width; ++j)
+                {
+                    const uint8_t mask = src_left[i * src_pitch + j];
+                    const uint16_t org = left_disp[i * dst_pitch + j];
+                    int d = org;
+                    if (subpixel)
+                    {
+                        d >>= SubpixelShift();
+                    }
+                    const int k = j - d;
+                    if (mask == 0 ||
+                        org == INVALID_DISP ||
+                        (k >= 0 && k < width && LR_max_diff >= 0 && std::abs(right_disp[i * dst_pitch + k] - d) > LR_max_diff))
+                    {
+                        left_disp[i * dst_pitch + j] = INVALID_DISP;
+                    }
+                }
+            }
+        }
+
+        void correct_disparity_range(uint16_t *disp,
+                                     int width,
+                                     int height,
+                                     int pitch,
+                                     bool subpixel,
+                                     int min_disp)
+        {
+            if (!subpixel && min_disp == 0)
+            {
+                return;
+            }
+
+            const int scale = subpixel ? SubpixelScale() : 1;
+            const int min_disp_scaled = min_disp * scale;
+            const int invalid_disp_scaled = (min_disp - 1) * scale;
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    uint16_t &d = disp[y * pitch + x];
+                    if (d == INVALID_DISP)
+                    {
+                        d = static_cast<uint16_t>(invalid_disp_scaled);
+                    }
+                    else
+                    {
+                        d = static_cast<uint16_t>(d + min_disp_scaled);
+                    }
+                }
+            }
+        }
+
+        template void aggregate_path<64>(uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+        template void aggregate_path<128>(uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+        template void aggregate_path<256>(uint16_t *, const uint32_t *, const uint32_t *, int, int, int, int, unsigned int, unsigned int, int);
+
+        template void winner_takes_all<64>(uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+        template void winner_takes_all<128>(uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+        template void winner_takes_all<256>(uint16_t *, uint16_t *, const uint16_t *, int, int, int, float, bool);
+    } // namespace reference
+} // namespace sgmcl
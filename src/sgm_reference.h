@@ -0,0 +1,72 @@
+#ifndef SGM_REFERENCE_H_
+#define SGM_REFERENCE_H_
+
+#include "common.h"
+
+namespace sgmcl
+{
+    /**
+        Scalar host implementations of every pipeline stage.
+        They follow the OpenCL kernels in data/ocl bit by bit and serve as
+        correctness oracle and as fallback when no OpenCL device is present.
+        All images are row major, pitches are given in elements.
+        */
+    namespace reference
+    {
+        // Census border pixels (where the 9x7 window leaves the image) are set to 0.
+        void census_transform(const uint8_t *src,
+                              uint32_t *feature_buffer,
+                              int width,
+                              int height,
+                              int pitch);
+
+        // Aggregates one scanline direction (dx, dy) and adds the 8 bit path costs
+        // to cost_sum, which holds MAX_DISPARITY values per pixel.
+        template <size_t MAX_DISPARITY>
+        void aggregate_path(uint16_t *cost_sum,
+                            const uint32_t *left,
+                            const uint32_t *right,
+                            int width,
+                            int height,
+                            int dx,
+                            int dy,
+                            unsigned int p1,
+                            unsigned int p2,
+                            int min_disp);
+
+        template <size_t MAX_DISPARITY>
+        void winner_takes_all(uint16_t *left_dest,
+                              uint16_t *right_dest,
+                              const uint16_t *cost_sum,
+                              int width,
+                              int height,
+                              int pitch,
+                              float uniqueness,
+                              bool subpixel);
+
+        void median_filter(const uint16_t *src,
+                           uint16_t *dst,
+                           int width,
+                           int height,
+                           int pitch);
+
+        void check_consistency(uint16_t *left_disp,
+                               const uint16_t *right_disp,
+                               const uint8_t *src_left,
+                               int width,
+                               int height,
+                               int src_pitch,
+                               int dst_pitch,
+                               bool subpixel,
+                               int LR_max_diff);
+
+        void correct_disparity_range(uint16_t *disp,
+                                     int width,
+                                     int height,
+                                     int pitch,
+                                     bool subpixel,
+                                     int min_disp);
+    } // namespace reference
+} // namespace sgmcl
+
+#endif // SGM_REFERENCE_H_
@@ -0,0 +1,89 @@
+#include "libsgm_ocl.h"
+
+namespace sgmcl
+{
+    TemporalSemiGlobalMatching::TemporalSemiGlobalMatching(cl_context ctx,
+                                                           cl_device_id device,
+                                                           int disparity_size,
+                                                           int band_width,
+                                                           std::unique_ptr<SemiGlobalMatchingBase> full_search,
+                                                           const TuningProfile &tuning)
+        : m_disparity_size(disparity_size),
+          m_full_search(std::move(full_search)),
+          m_pyramid(ctx, device, band_width, tuning),
+          m_census(ctx, device, tuning),
+          m_aggregation(ctx, device, band_width, tuning),
+          m_band(ctx)
+    {
+        if (band_width > disparity_size)
+        {
+            throw std::logic_error("temporal band must not be wider than the disparity size");
+        }
+    }
+
+    void TemporalSemiGlobalMatching::execute(DeviceBuffer<uint16_t> &dest_left,
+                                             DeviceBuffer<uint16_t> &dest_right,
+                                             const DeviceBuffer<uint8_t> &src_left,
+                                             const DeviceBuffer<uint8_t> &src_right,
+                                             DeviceBuffer<uint32_t> &feature_buffer_left,
+                                             DeviceBuffer<uint32_t> &feature_buffer_right,
+                                             int width,
+                                             int height,
+                                             int batch_size,
+                                             int src_pitch,
+                                             int dst_pitch,
+                                             const Parameters &param,
+                                             cl_command_queue queue,
+                                             StageEvents *events)
+    {
+        if (m_prior == nullptr || batch_size != 1)
+        {
+            m_full_search->execute(dest_left, dest_right, src_left, src_right,
+                                   feature_buffer_left, feature_buffer_right,
+                                   width, height, batch_size, src_pitch, dst_pitch,
+                                   param, queue, events);
+            return;
+        }
+
+        // the band of every pixel is centered on its previous disparity, like a
+        // coarse level of the same size
+        m_band.allocate(static_cast<size_t>(width) * height);
+        m_pyramid.disparity_band(m_band,
+                                 *m_prior,
+                                 width,
+                                 height,
+                                 1,
+                                 1,
+                                 param.subpixel ? SubpixelShift() : 0,
+                                 0,
+                                 m_disparity_size - static_cast<int>(m_aggregation.band_width()),
+                                 queue);
+
+        m_census.enqueue(src_left, feature_buffer_left, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_left : nullptr);
+        m_census.enqueue(src_right, feature_buffer_right, width, height, batch_size, src_pitch, queue,
+                         events ? &events->census_right : nullptr);
+        if (events)
+        {
+            events->num_paths = param.path_type == PathType::SCAN_4PATH ? 4 : 8;
+        }
+        m_aggregation.enqueue(feature_buffer_left,
+                              feature_buffer_right,
+                              m_band,
+                              width, height, batch_size,
+                              param.path_type,
+                              param.P1,
+                              param.P2,
+                              param.min_disp,
+                              param.fused_aggregation,
+                              queue,
+                              events ? events->paths : nullptr);
+        m_aggregation.winner_takes_all(dest_left, dest_right,
+                                       m_band,
+                                       width, height, batch_size, dst_pitch,
+                                       param.uniqueness, param.subpixel, param.path_type,
+                                       param.fused_aggregation,
+                                       queue,
+                                       events ? &events->winner_takes_all : nullptr);
+    }
+} // namespace sgmcl
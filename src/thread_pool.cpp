@@ -0,0 +1,96 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace sgmcl
+{
+    ThreadPool::ThreadPool(unsigned int num_threads)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned int i = 1; i < num_threads; ++i)
+        {
+            m_workers.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::parallel_for(int begin, int end, const std::function<void(int)> &func)
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+        if (m_workers.empty() || end - begin == 1)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                func(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_func = &func;
+            m_next = begin;
+            m_end = end;
+            m_pending = static_cast<unsigned int>(m_workers.size());
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        run_jobs();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending == 0; });
+        m_func = nullptr;
+    }
+
+    void ThreadPool::worker_loop()
+    {
+        uint64_t generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+                if (m_stop)
+                {
+                    return;
+                }
+                generation = m_generation;
+            }
+
+            run_jobs();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::run_jobs()
+    {
+        for (int i = m_next++; i < m_end; i = m_next++)
+        {
+            (*m_func)(i);
+        }
+    }
+} // namespace sgmcl
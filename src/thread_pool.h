@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sgmcl
+{
+    /**
+        Fixed set of worker threads for data parallel loops of the CPU backend.
+        */
+    class ThreadPool
+    {
+    public:
+        // num_threads counts the calling thread, 0 uses every hardware thread.
+        explicit ThreadPool(unsigned int num_threads = 0);
+        ~ThreadPool();
+
+        /**
+            * Calls func(i) for every i in [begin, end) and returns when all calls are done.
+            * Indices are handed out one by one, so uneven work is balanced between threads.
+            * The calling thread takes part, calls must not be nested.
+            */
+        void parallel_for(int begin, int end, const std::function<void(int)> &func);
+
+        unsigned int size() const
+        {
+            return static_cast<unsigned int>(m_workers.size()) + 1;
+        }
+
+    private:
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void worker_loop();
+        void run_jobs();
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        const std::function<void(int)> *m_func = nullptr;
+        std::atomic<int> m_next{0};
+        int m_end = 0;
+        unsigned int m_pending = 0;
+        uint64_t m_generation = 0;
+        bool m_stop = false;
+    };
+} // namespace sgmcl
+
+#endif // THREAD_POOL_H_
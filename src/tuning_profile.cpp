@@ -0,0 +1,173 @@
+#include "tuning_profile.h"
+#include "cl_utilities.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace sgmcl
+{
+    namespace
+    {
+        // bump when the file layout changes
+        const char PROFILE_MAGIC[] = "# SGMCL_TUNING_PROFILE 1";
+
+        std::string trim(const std::string &str)
+        {
+            const size_t begin = str.find_first_not_of(" \t\r");
+            if (begin == std::string::npos)
+            {
+                return std::string();
+            }
+            const size_t end = str.find_last_not_of(" \t\r");
+            return str.substr(begin, end - begin + 1);
+        }
+
+        // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE of a trivial kernel, which is the SIMD
+        // width of the device (32 on NVIDIA, 64 on AMD GCN). Built once per device, 32 if it fails.
+        size_t preferred_work_group_multiple(cl_context ctx, cl_device_id device)
+        {
+            static std::mutex mutex;
+            static std::map<cl_device_id, size_t> multiples;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = multiples.find(device);
+            if (it != multiples.end())
+            {
+                return it->second;
+            }
+
+            size_t multiple = 32;
+            const char *src = "kernel void probe(global int* dst) { dst[get_global_id(0)] = 0; }";
+            cl_int err;
+            cl_program program = clCreateProgramWithSource(ctx, 1, &src, nullptr, &err);
+            if (err == CL_SUCCESS && clBuildProgram(program, 1, &device, nullptr, nullptr, nullptr) == CL_SUCCESS)
+            {
+                cl_kernel kernel = clCreateKernel(program, "probe", &err);
+                if (err == CL_SUCCESS)
+                {
+                    size_t value = 0;
+                    if (clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                                 sizeof(value), &value, nullptr) == CL_SUCCESS &&
+                        value > 0)
+                    {
+                        multiple = value;
+                    }
+                    clReleaseKernel(kernel);
+                }
+            }
+            if (program)
+            {
+                clReleaseProgram(program);
+            }
+            multiples[device] = multiple;
+            return multiple;
+        }
+    } // namespace
+
+    int TuningProfile::get(const std::string &key, int default_value) const
+    {
+        auto it = m_values.find(key);
+        return it == m_values.end() ? default_value : it->second;
+    }
+
+    void TuningProfile::set(const std::string &key, int value)
+    {
+        m_values[key] = value;
+    }
+
+    unsigned int TuningProfile::warp_size(cl_context ctx, cl_device_id device, unsigned int min_size, unsigned int max_size) const
+    {
+        auto it = m_values.find("device.warp_size");
+        const size_t preferred = it != m_values.end() ? static_cast<size_t>(it->second)
+                                                      : preferred_work_group_multiple(ctx, device);
+        unsigned int size = 1;
+        while (size < preferred && size < max_size)
+        {
+            size <<= 1;
+        }
+        return std::max(size, min_size);
+    }
+
+    bool TuningProfile::load(const std::string &path, cl_device_id device)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+        std::string line;
+        if (!std::getline(file, line) || trim(line) != PROFILE_MAGIC)
+        {
+            return false;
+        }
+
+        std::string device_name, driver_version;
+        std::map<std::string, int> values;
+        while (std::getline(file, line))
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            const size_t eq = line.find('=');
+            if (eq == std::string::npos)
+            {
+                return false;
+            }
+            const std::string key = trim(line.substr(0, eq));
+            const std::string value = trim(line.substr(eq + 1));
+            if (key == "device")
+            {
+                device_name = value;
+            }
+            else if (key == "driver")
+            {
+                driver_version = value;
+            }
+            else
+            {
+                char *end = nullptr;
+                const long number = std::strtol(value.c_str(), &end, 10);
+                if (key.empty() || value.empty() || *end != '\0' || number <= 0)
+                {
+                    return false;
+                }
+                values[key] = static_cast<int>(number);
+            }
+        }
+
+        // the best geometry of one device says nothing about another
+        if (device_name != device_info_string(device, CL_DEVICE_NAME) ||
+            driver_version != device_info_string(device, CL_DRIVER_VERSION))
+        {
+            std::cout << "Tuning profile " << path << " was measured on another device or driver, ignoring it" << std::endl;
+            return false;
+        }
+        m_values = std::move(values);
+        return true;
+    }
+
+    void TuningProfile::save(const std::string &path, cl_device_id device) const
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot write tuning profile " + path);
+        }
+        file << PROFILE_MAGIC << "\n"
+             << "device = " << device_info_string(device, CL_DEVICE_NAME) << "\n"
+             << "driver = " << device_info_string(device, CL_DRIVER_VERSION) << "\n";
+        for (const auto &entry : m_values)
+        {
+            file << entry.first << " = " << entry.second << "\n";
+        }
+        if (!file)
+        {
+            throw std::runtime_error("Cannot write tuning profile " + path);
+        }
+    }
+} // namespace sgmcl
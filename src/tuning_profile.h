@@ -0,0 +1,42 @@
+#ifndef TUNING_PROFILE_H_
+#define TUNING_PROFILE_H_
+
+#include <map>
+#include <string>
+
+#include <CL/cl.h>
+
+namespace sgmcl
+{
+    /**
+        Launch geometry of the kernels for one device, e.g. "census.block_size" or
+        "vertical.d128.dp_block_size". The kernel classes read it when they inject
+        their template values and fall back to the built-in defaults for missing keys.
+        Profiles are written by autotune() as "key = value" lines and are tied to the
+        device name and driver version they were measured on.
+        */
+    class TuningProfile
+    {
+    public:
+        int get(const std::string &key, int default_value) const;
+        void set(const std::string &key, int value);
+        bool empty() const { return m_values.empty(); }
+        const std::map<std::string, int> &values() const { return m_values; }
+
+        // Lanes of a warp in the kernels: "device.warp_size" if set, otherwise the
+        // device's CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, rounded up to a power
+        // of two and clamped to [min_size, max_size] which the calling kernel supports.
+        unsigned int warp_size(cl_context ctx, cl_device_id device, unsigned int min_size, unsigned int max_size) const;
+
+        // Returns false and leaves the profile unchanged if the file is missing,
+        // malformed or was measured on another device or driver.
+        bool load(const std::string &path, cl_device_id device);
+        // Throws std::runtime_error if the file cannot be written.
+        void save(const std::string &path, cl_device_id device) const;
+
+    private:
+        std::map<std::string, int> m_values;
+    };
+} // namespace sgmcl
+
+#endif // TUNING_PROFILE_H_
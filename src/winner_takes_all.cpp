@@ -3,9 +3,20 @@
 namespace sgmcl
 {
 
+    unsigned int wta_warp_size(cl_context ctx, cl_device_id device, const TuningProfile &tuning,
+                               unsigned int max_disparity)
+    {
+        // a lane reduces max_disparity / warp size costs, at most the 16 it accumulates
+        return tuning.warp_size(ctx, device, std::max<unsigned int>(max_disparity / 16, 1), max_disparity);
+    }
+
     template <size_t MAX_DISPARITY>
-    inline WinnerTakesAll<MAX_DISPARITY>::WinnerTakesAll(cl_context ctx, cl_device_id device)
-        : m_cl_context(ctx), m_cl_device_id(device)
+    inline WinnerTakesAll<MAX_DISPARITY>::WinnerTakesAll(cl_context ctx, cl_device_id device, const TuningProfile &tuning)
+        : m_cl_context(ctx), m_cl_device_id(device),
+          m_warp_size(wta_warp_size(ctx, device, tuning, MAX_DISPARITY)),
+          m_warps_per_block(tuning.get("wta.d" + std::to_string(MAX_DISPARITY) + ".warps_per_block",
+                                       fit_warps_per_block(device, m_warp_size, DEFAULT_WARPS_PER_BLOCK))),
+          m_block_size(m_warps_per_block * m_warp_size)
     {
     }
 
@@ -15,14 +26,57 @@ namespace sgmcl
                                                 const DeviceBuffer<uint8_t> &src,
                                                 int width,
                                                 int height,
+                                                int batch_size,
                                                 int pitch,
                                                 float uniqueness,
                                                 bool subpixel,
                                                 PathType path_type,
-                                                cl_command_queue stream)
+                                                cl_command_queue stream,
+                                                cl_event *event)
     {
+        launch(left, right, src.data(), width, height, batch_size, pitch, uniqueness, subpixel, path_type, false, stream, event);
+    }
+
+    template <size_t MAX_DISPARITY>
+    void WinnerTakesAll<MAX_DISPARITY>::enqueue(DeviceBuffer<uint16_t> &left,
+                                                DeviceBuffer<uint16_t> &right,
+                                                const DeviceBuffer<uint16_t> &src,
+                                                int width,
+                                                int height,
+                                                int batch_size,
+                                                int pitch,
+                                                float uniqueness,
+                                                bool subpixel,
+                                                PathType path_type,
+                                                cl_command_queue stream,
+                                                cl_event *event)
+    {
+        launch(left, right, src.data(), width, height, batch_size, pitch, uniqueness, subpixel, path_type, true, stream, event);
+    }
+
+    template <size_t MAX_DISPARITY>
+    void WinnerTakesAll<MAX_DISPARITY>::launch(DeviceBuffer<uint16_t> &left,
+                                               DeviceBuffer<uint16_t> &right,
+                                               const cl_mem &src,
+                                               int width,
+                                               int height,
+                                               int batch_size,
+                                               int pitch,
+                                               float uniqueness,
+                                               bool subpixel,
+                                               PathType path_type,
+                                               bool fused,
+                                               cl_command_queue stream,
+                                               cl_event *event)
+    {
+        if (m_kernel != nullptr && m_fused != fused)
+        {
+            clReleaseKernel(m_kernel);
+            m_kernel = nullptr;
+        }
         if (m_kernel == nullptr)
         {
+            m_fused = fused;
             std::string kernel_template_types;
 
             //resource reading
@@ -44,15 +98,19 @@ namespace sgmcl
             int NUM_PATHS = path_type == PathType::SCAN_4PATH ? 4 : 8;
             std::string kernel_NUM_PATHS = "#define NUM_PATHS " + std::to_string(NUM_PATHS) + "\n";
             std::string kernel_COMPUTE_SUBPIXEL = "#define COMPUTE_SUBPIXEL " + std::to_string(subpixel ? 1 : 0) + "\n";
-            std::string kernel_WARPS_PER_BLOCK = "#define WARPS_PER_BLOCK " + std::to_string(WARPS_PER_BLOCK) + "\n";
-            std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(BLOCK_SIZE) + "\n";
+            std::string kernel_WARPS_PER_BLOCK = "#define WARPS_PER_BLOCK " + std::to_string(m_warps_per_block) + "\n";
+            std::string kernel_BLOCK_SIZE = "#define BLOCK_SIZE " + std::to_string(m_block_size) + "\n";
             std::string kernel_SUBPIXEL_SHIFT = "#define SUBPIXEL_SHIFT " + std::to_string(SubpixelShift()) + "\n";
+            std::string kernel_FUSED_AGGREGATION = "#define FUSED_AGGREGATION " + std::to_string(fused ? 1 : 0) + "\n";
             kernel_src = std::regex_replace(kernel_src, std::regex("@MAX_DISPARITY@"), kernel_max_disparoty);
             kernel_src = std::regex_replace(kernel_src, std::regex("@NUM_PATHS@"), kernel_NUM_PATHS);
             kernel_src = std::regex_replace(kernel_src, std::regex("@COMPUTE_SUBPIXEL@"), kernel_COMPUTE_SUBPIXEL);
             kernel_src = std::regex_replace(kernel_src, std::regex("@WARPS_PER_BLOCK@"), kernel_WARPS_PER_BLOCK);
             kernel_src = std::regex_replace(kernel_src, std::regex("@BLOCK_SIZE@"), kernel_BLOCK_SIZE);
             kernel_src = std::regex_replace(kernel_src, std::regex("@SUBPIXEL_SHIFT@"), kernel_SUBPIXEL_SHIFT);
+            kernel_src = std::regex_replace(kernel_src, std::regex("@FUSED_AGGREGATION@"), kernel_FUSED_AGGREGATION);
+            std::string kernel_WARP_SIZE = "#define WARP_SIZE " + std::to_string(m_warp_size) + "\n";
+            kernel_src = std::regex_replace(kernel_src, std::regex("@WARP_SIZE@"), kernel_WARP_SIZE);
 
             m_program.init(m_cl_context, m_cl_device_id, kernel_src);
             //DEBUG
@@ -62,14 +120,15 @@ namespace sgmcl
         }
 
         //setup kernels
-        size_t global_size[1] = {
-            (height + WARPS_PER_BLOCK - 1) / WARPS_PER_BLOCK * BLOCK_SIZE};
-        size_t local_size[1] = {BLOCK_SIZE};
+        size_t global_size[2] = {
+            (height + m_warps_per_block - 1) / m_warps_per_block * m_block_size,
+            (size_t)batch_size};
+        size_t local_size[2] = {m_block_size, 1};
 
         cl_int err;
         err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &left.data());
         err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &right.data());
-        err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &src.data());
+        err = clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &src);
         err = clSetKernelArg(m_kernel, 3, sizeof(width), &width);
         err = clSetKernelArg(m_kernel, 4, sizeof(height), &height);
         err = clSetKernelArg(m_kernel, 5, sizeof(pitch), &pitch);
@@ -77,11 +136,11 @@ namespace sgmcl
 
         err = clEnqueueNDRangeKernel(stream,
                                      m_kernel,
-                                     1,
+                                     2,
                                      nullptr,
                                      global_size,
                                      local_size,
-                                     0, nullptr, nullptr);
+                                     0, nullptr, event);
         CHECK_OCL_ERROR(err, "Error enequeuing winner_takes_all kernel");
 
         //clFinish(stream);
@@ -18,12 +18,18 @@ limitations under the License.
 
 namespace sgmcl
 {
+    // Lanes of a warp in the winner takes all kernel, a lane reduces at most 16 costs.
+    unsigned int wta_warp_size(cl_context ctx, cl_device_id device, const TuningProfile &tuning,
+                               unsigned int max_disparity);
 
     template <size_t MAX_DISPARITY>
     class WinnerTakesAll
     {
     public:
-        WinnerTakesAll(cl_context ctx, cl_device_id device);
+        // Default of the tuning key "wta.d<MAX_DISPARITY>.warps_per_block".
+        static constexpr unsigned int DEFAULT_WARPS_PER_BLOCK = 8u;
+
+        WinnerTakesAll(cl_context ctx, cl_device_id device, const TuningProfile &tuning = TuningProfile());
 
         void enqueue(
             DeviceBuffer<uint16_t> &left,
@@ -31,21 +37,55 @@ namespace sgmcl
             const DeviceBuffer<uint8_t> &src,
             int width,
             int height,
+            int batch_size,
+            int pitch,
+            float uniqueness,
+            bool subpixel,
+            PathType path_type,
+            cl_command_queue stream,
+            cl_event *event = nullptr);
+
+        // Reads the cost volume produced by a fused path aggregation.
+        void enqueue(
+            DeviceBuffer<uint16_t> &left,
+            DeviceBuffer<uint16_t> &right,
+            const DeviceBuffer<uint16_t> &src,
+            int width,
+            int height,
+            int batch_size,
             int pitch,
             float uniqueness,
             bool subpixel,
             PathType path_type,
-            cl_command_queue stream);
+            cl_command_queue stream,
+            cl_event *event = nullptr);
 
     private:
+        void launch(
+            DeviceBuffer<uint16_t> &left,
+            DeviceBuffer<uint16_t> &right,
+            const cl_mem &src,
+            int width,
+            int height,
+            int batch_size,
+            int pitch,
+            float uniqueness,
+            bool subpixel,
+            PathType path_type,
+            bool fused,
+            cl_command_queue stream,
+            cl_event *event);
+
         cl_context m_cl_context = nullptr;
         cl_device_id m_cl_device_id = nullptr;
 
         DeviceProgram m_program;
         cl_kernel m_kernel = nullptr;
+        bool m_fused = false;
 
-        static constexpr unsigned int WARP_SIZE = 32;
-        static constexpr unsigned int WARPS_PER_BLOCK = 8u;
-        static constexpr unsigned int BLOCK_SIZE = WARPS_PER_BLOCK * WARP_SIZE;
+        // lanes per image row, the device SIMD width within what the kernel supports
+        unsigned int m_warp_size;
+        unsigned int m_warps_per_block;
+        unsigned int m_block_size;
     };
 } // namespace sgmcl